@@ -1,9 +1,16 @@
 #include "App.h"
-#include <DDSTextureLoader.h>
-#include <ResourceUploadBatch.h>
 
 std::vector<std::unique_ptr<FrameResource>> FrameResources;
 unique_ptr<SRVDescriptorHeap> SrvDescriptorHeap;
+unique_ptr<GPUBufferHeap> BufferHeap;
+unique_ptr<UploadManager> Uploader;
+unique_ptr<ModelCache> ModelAssets;
+unique_ptr<TextureIndex> TextureFiles;
+unique_ptr<TextureCache> Textures;
+unique_ptr<TextureStreamer> Streamer;
+unique_ptr<SpatialIndex> SceneIndex;
+unique_ptr<JobSystem> Jobs;
+unique_ptr<ObjectTable> Objects;
 int CurrentSRVOffset = 1;
 
 App::App()
@@ -31,11 +38,20 @@ void App::Run()
 			Draw(frameTime);
 			EndFrame();
 		}
+		else
+		{
+			FinishRender();
+		}
 	}	
+
+	FinishRender();
 }
 
 void App::Initialize()
 {
+	// Worker threads shared by loading, culling, sorting and command recording
+	Jobs = make_unique<JobSystem>();
+
 	// Create window object
 	mWindow = make_unique<Window>(800,600);
 
@@ -51,6 +67,25 @@ void App::Initialize()
 	// Update camera
 	mCamera->Update();
 
+	// Models share imported geometry through this cache
+	ModelAssets = make_unique<ModelCache>();
+
+	// Find every texture file once instead of probing for each map
+	TextureFiles = make_unique<TextureIndex>();
+	TextureFiles->Build(L"Models");
+
+	// Textures are loaded once and shared by every material that uses them
+	Textures = make_unique<TextureCache>(SrvDescriptorHeap->mTextureCacheStart, SrvDescriptorHeap->mMaxTextures - SrvDescriptorHeap->mTextureCacheStart);
+
+	// Mips of dds textures are streamed in by screen size, within a video memory budget
+	Streamer = make_unique<TextureStreamer>(DEFAULT_TEXTURE_BUDGET);
+
+	// Models are found by frustum and ray queries on their bounds
+	SceneIndex = make_unique<SpatialIndex>();
+
+	// Transforms of every model, copied to the frame resources as they change
+	Objects = make_unique<ObjectTable>(mGraphics->mNumFrameResources);
+
 	LoadModels();
 
 	CreateSkybox();
@@ -70,14 +105,6 @@ void App::Initialize()
 	mGUI = make_unique<GUI>(SrvDescriptorHeap.get(), mWindow->mSDLWindow, D3DDevice.Get(),
 		mGraphics->mNumFrameResources, mGraphics->mBackBufferFormat);
 
-	// Start worker threads
-	mNumRenderWorkers = std::thread::hardware_concurrency();
-	if (mNumRenderWorkers == 0)  mNumRenderWorkers = 8;
-	for (int i = 0; i < mNumRenderWorkers; ++i)
-	{
-		mRenderWorkers[i].first.thread = std::thread(&App::RenderThread, this, i);
-	}
-
 }
 
 void App::StartFrame()
@@ -113,119 +140,119 @@ void App::LoadModels()
 
 	// Multiple meshes, full PBR textured per mesh
 
-	Model* model = new Model("Models/polyfox.fbx", commandList);
+	Model* model = new Model("Models/polyfox.fbx", commandList, nullptr, "", true);
 
 	model->SetPosition(XMFLOAT3{ 0.0f, 10.0f, 0.0f });
 	model->SetRotation(XMFLOAT3{ 0.0f, 3.14f, 0.0f });
 	model->SetScale(XMFLOAT3{ 0.01f, 0.01f, 0.01f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "pjemy");
+	model = new Model("Models/octopus.x", commandList, nullptr, "pjemy", true);
 
 	model->SetPosition(XMFLOAT3{ 10.0f, 5.0f, 0.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "tufted-leather");
+	model = new Model("Models/octopus.x", commandList, nullptr, "tufted-leather", true);
 
 	model->SetPosition(XMFLOAT3{ 20.0f, 5.0f, 0.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "octostone");
+	model = new Model("Models/octopus.x", commandList, nullptr, "octostone", true);
 
 	model->SetPosition(XMFLOAT3{ 30.0f, 5.0f, 0.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "galvanizedmetal");
+	model = new Model("Models/octopus.x", commandList, nullptr, "galvanizedmetal", true);
 
 	model->SetPosition(XMFLOAT3{ 40.0f, 5.0f, 0.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "copper-rock1");
+	model = new Model("Models/octopus.x", commandList, nullptr, "copper-rock1", true);
 
 	model->SetPosition(XMFLOAT3{ 10.0f, 10.0f, 10.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "painted-concrete");
+	model = new Model("Models/octopus.x", commandList, nullptr, "painted-concrete", true);
 
 	model->SetPosition(XMFLOAT3{ 20.0f, 10.0f, 10.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "marblefloortiles1");
+	model = new Model("Models/octopus.x", commandList, nullptr, "marblefloortiles1", true);
 
 	model->SetPosition(XMFLOAT3{ 30.0f, 10.0f, 10.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "pjdto2");
+	model = new Model("Models/octopus.x", commandList, nullptr, "pjdto2", true);
 
 	model->SetPosition(XMFLOAT3{ 40.0f, 10.0f, 10.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "rusted-iron2");
+	model = new Model("Models/octopus.x", commandList, nullptr, "rusted-iron2", true);
 
 	model->SetPosition(XMFLOAT3{ 10.0f, 15.0f, 20.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "scuffed-plastic");
+	model = new Model("Models/octopus.x", commandList, nullptr, "scuffed-plastic", true);
 
 	model->SetPosition(XMFLOAT3{ 20.0f, 15.0f, 20.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "subway-floor");
+	model = new Model("Models/octopus.x", commandList, nullptr, "subway-floor", true);
 
 	model->SetPosition(XMFLOAT3{ 30.0f, 15.0f, 20.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "synth-rubber");
+	model = new Model("Models/octopus.x", commandList, nullptr, "synth-rubber", true);
 
 	model->SetPosition(XMFLOAT3{ 40.0f, 15.0f, 20.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "threadplatefloor");
+	model = new Model("Models/octopus.x", commandList, nullptr, "threadplatefloor", true);
 
 	model->SetPosition(XMFLOAT3{ 10.0f, 20.0f, 30.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "bamboo-wood-semigloss");
+	model = new Model("Models/octopus.x", commandList, nullptr, "bamboo-wood-semigloss", true);
 
 	model->SetPosition(XMFLOAT3{ 20.0f, 20.0f, 30.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "greasy-pan-2");
+	model = new Model("Models/octopus.x", commandList, nullptr, "greasy-pan-2", true);
 
 	model->SetPosition(XMFLOAT3{ 30.0f, 20.0f, 30.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
 	model->SetScale(XMFLOAT3{ 1.0f, 1.0f, 1.0f });
 	mModels.push_back(model);
 
-	model = new Model("Models/octopus.x", commandList, nullptr, "harshbricks");
+	model = new Model("Models/octopus.x", commandList, nullptr, "harshbricks", true);
 
 	model->SetPosition(XMFLOAT3{ 40.0f, 20.0f, 30.0f });
 	model->SetRotation(XMFLOAT3{ -XM_PI / 2, 0, 0 });
@@ -236,51 +263,17 @@ void App::LoadModels()
 
 	mTerrainModel = new Model("", commandList, mTerrain->mMesh);
 	
-	// Sort models by PSO
-	int index = 0;
+	// Streamed models are sorted by PSO once they are ready
 	for (auto& model : mModels)
 	{
-		model->mObjConstantBufferIndex = index;
-
-		if (model->mTextured)
-		{
-			if (model->mPerMeshTextured)
-			{
-				if (model->mPerMeshPBR)
-				{
-					mTexModels.push_back(model);
-				}
-				else
-				{
-					mSimpleTexModels.push_back(model);
-				}
-			}
-			else if (model->mModelTextured)
-			{
-				mTexModels.push_back(model);
-			}
-		}
-		else
-		{
-			mColourModels.push_back(model);
-		}		
-		index++;
+		if (model->IsReady()) AddToDrawLists(model);
 	}
 
 	// Terrain and sky are rendered independently
 	mTerrainModel->SetPosition(XMFLOAT3{ float(-mTerrain->mSize / 2) * mTerrain->mSpacing, -20.0f, float(-mTerrain->mSize / 2) * mTerrain->mSpacing });
 	mTerrainModel->SetRotation(XMFLOAT3{ 0.0f, 0.0f, 0.0f });
 	mTerrainModel->SetScale(XMFLOAT3{ 1, 1, 1 });
-	mTerrainModel->mObjConstantBufferIndex = index;
 	mModels.push_back(mTerrainModel);
-	index++;
-
-	//for (auto& model : mTerrainManager->mSpawnedChunkModels)
-	//{
-	//	model->mObjConstantBufferIndex = index;
-	//	index++;
-	//	mModels.push_back(model);
-	//}
 
 
 	// Skybox
@@ -289,7 +282,6 @@ void App::LoadModels()
 	mSkyModel->SetPosition(XMFLOAT3{ 0.0f, 0.0f, 0.0f });
 	mSkyModel->SetRotation(XMFLOAT3{ 0.0f, 0.0f, 0.0f });
 	mSkyModel->SetScale(XMFLOAT3{ 1, 1, 1 });
-	mSkyModel->mObjConstantBufferIndex = index;
 	mModels.push_back(mSkyModel);
 }
 
@@ -297,17 +289,14 @@ void App::BuildFrameResources()
 {
 	for (int i = 0; i < mGraphics->mNumFrameResources; i++)
 	{
-		// Create a frame resource with the number of models, max base planet vertices and indices, and the number of materials 
-		FrameResources.push_back(std::make_unique<FrameResource>(D3DDevice.Get(), 1, mModels.size(), mMaterials.size())); //1 for planet
+		// Create a frame resource with the number of models, max base planet vertices and indices, and room for streamed materials
+		FrameResources.push_back(std::make_unique<FrameResource>(D3DDevice.Get(), 1, MAX_MATERIALS, MAX_INSTANCES, MAX_OBJECTS)); //1 for planet
 	}
 }
 
 void App::CreateSkybox()
 {
-	// Get device and create upload batch
 	auto device = D3DDevice.Get();
-	ResourceUploadBatch upload(device);
-	upload.Begin();
 
 	// Create new sky material
 	mSkyMat = new Material();
@@ -316,15 +305,10 @@ void App::CreateSkybox()
 
 	// Create cube texture
 	Texture* cubeTex = new Texture();
-	DDS_ALPHA_MODE mode = DDS_ALPHA_MODE_OPAQUE;
 	bool cubeMap = true;
 
-	//CreateDDSTextureFromFileEx(D3DDevice.Get(), upload, mSkyMat->Name.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
-	//	(DirectX::DX12::DDS_LOADER_FLAGS)(DirectX::DX12::DDS_LOADER_DEFAULT) | DirectX::DX12::DDS_LOADER_MIP_AUTOGEN,
-	//	cubeTex->Resource.ReleaseAndGetAddressOf(), &mode, &cubeMap);
-
-	// Load cube texture
-	CreateDDSTextureFromFile(D3DDevice.Get(), upload, mSkyMat->Name.c_str(), cubeTex->Resource.ReleaseAndGetAddressOf(), true, 0Ui64, &mode, &cubeMap);
+	// Load cube texture, the upload is sent with the next submit
+	Uploader->LoadDDSTexture(mSkyMat->Name.c_str(), cubeTex->Resource.ReleaseAndGetAddressOf(), &cubeMap);
 
 	// Offset to next descriptor
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(SrvDescriptorHeap->mHeap->GetCPUDescriptorHandleForHeapStart());
@@ -345,12 +329,6 @@ void App::CreateSkybox()
 	// Create SRV
 	device->CreateShaderResourceView(cubeMapRes.Get(), &srvDesc, hDescriptor);
 
-	// Upload the resources to the GPU.
-	auto finish = upload.End(CommandQueue.Get());
-
-	// Wait for the upload thread to terminate
-	finish.wait();
-
 	// Set skymodel material to sky material and push texture
 	mSkyModel->mMeshes[0]->mMaterial = mSkyMat;
 	mSkyModel->mMeshes[0]->mTextures.push_back(cubeTex);
@@ -359,6 +337,23 @@ void App::CreateSkybox()
 
 void App::Update(float frameTime)
 {
+	// Upload assets that finished loading and start drawing the models using them
+	ModelAssets->Update();
+	for (auto& model : mModels)
+	{
+		if (model->Update())
+		{
+			AddMaterials(model);
+			AddToDrawLists(model);
+
+			// Shared geometry has no results of its own, so each optimized mesh is counted once
+			for (auto mesh : model->mMeshes)
+			{
+				mGUI->mSceneOptimizerStats.Add(mesh->mOptimizerStats);
+			}
+		}
+	}
+
 	// Update GUI
 	mGUI->UpdateModelData(mModels[mGUI->mSelectedModel]);
 	mGUI->Update(mNumModels);
@@ -384,12 +379,50 @@ void App::Update(float frameTime)
 	// Update model selected in GUI
 	UpdateSelectedModel();
 
+	// Stream texture mips for the new view
+	UpdateTextureStreaming();
+
 	// Update buffers
-	UpdatePerObjectConstantBuffers();
+	UpdateObjectBuffer();
+	UpdateInstanceBuffer();
 	UpdatePerFrameConstantBuffer();
 	UpdatePerMaterialConstantBuffers();
 }
 
+void App::UpdateTextureStreaming()
+{
+	// Pixels covered by one world unit at distance one
+	float scale = mCamera->mProjectionMatrix._22 * 0.5f * mWindow->mHeight;
+
+	XMMATRIX view = XMLoadFloat4x4(&mCamera->mViewMatrix);
+	XMVECTOR eye = XMMatrixInverse(nullptr, view).r[3];
+
+	for (auto& model : mModels)
+	{
+		if (!model->IsReady()) continue;
+
+		// Size of the model's bounding sphere on screen, every texture on it is sized by that
+		auto bounds = model->GetWorldBounds();
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - eye));
+		float pixels = distance <= bounds.Radius ? FLT_MAX : 2.0f * bounds.Radius / distance * scale;
+
+		for (auto& mesh : model->mMeshes)
+		{
+			for (auto& texture : mesh->mTextures)
+			{
+				if (texture->Cached) Streamer->RequestSize(texture->Cached.get(), pixels);
+			}
+		}
+	}
+
+	Streamer->Update();
+
+	for (auto& model : mModels)
+	{
+		model->UpdateTextureTables();
+	}
+}
+
 void App::UpdateSelectedModel()
 {
 	// If the world matrix has changed
@@ -399,37 +432,39 @@ void App::UpdateSelectedModel()
 		mModels[mGUI->mSelectedModel]->SetPosition(mGUI->mInPosition, false);
 		mModels[mGUI->mSelectedModel]->SetRotation(mGUI->mInRotation, false);
 		mModels[mGUI->mSelectedModel]->SetScale(mGUI->mInScale, true);
-		mModels[mGUI->mSelectedModel]->mNumDirtyFrames += mGraphics->mNumFrameResources;
 
 		mGUI->mWMatrixChanged = false;
 	}
 }
 
-void App::UpdatePerObjectConstantBuffers()
+void App::UpdateObjectBuffer()
 {
-	// Get reference to the current per object constant buffer
-	auto currentObjectConstantBuffer = mGraphics->mCurrentFrameResource->mPerObjectConstantBuffer.get();
-	
-	for (auto& model : mModels)
-	{
-		// If their values have been changed
-		if (model->mNumDirtyFrames > 0)
-		{
-			// Get the world matrix of the item
-			XMMATRIX worldMatrix = XMLoadFloat4x4(&model->mWorldMatrix);
-			bool parallax = model->mParallax;
-			
-			// Transpose data
-			PerObjectConstants objectConstants;
-			XMStoreFloat4x4(&objectConstants.WorldMatrix, XMMatrixTranspose(worldMatrix));
-			objectConstants.parallax = parallax;
-
-			// Copy the structure into the current buffer at the item's index
-			currentObjectConstantBuffer->Copy(model->mObjConstantBufferIndex, objectConstants);
-
-			model->mNumDirtyFrames--;
-		}
-	}
+	// Only models that moved since this frame resource was last used are written
+	mGUI->mObjectsWritten = (int)Objects->Update(CurrentFrameResourceIndex, mGraphics->mCurrentFrameResource->mObjectBuffer.get());
+}
+
+void App::UpdateInstanceBuffer()
+{
+	// Visible instances change with the view, so every one is written each frame
+	XMMATRIX view = XMLoadFloat4x4(&mCamera->mViewMatrix);
+	XMMATRIX proj = XMLoadFloat4x4(&mCamera->mProjectionMatrix);
+	mCuller.SetViewProjection(view, proj);
+
+	// Whole models outside the view are skipped by the scene index, meshes of the rest are culled by the batchers
+	BoundingFrustum frustum;
+	BoundingFrustum::CreateFromMatrix(frustum, proj);
+	frustum.Transform(frustum, XMMatrixInverse(nullptr, view));
+
+	mVisibleModels.clear();
+	SceneIndex->QueryFrustum(frustum, mVisibleModels);
+
+	auto& packet = mPackets[mUpdatePacket];
+	packet.Draws.Build(mVisibleModels, mGraphics->mCurrentFrameResource, view, mCamera->FarZ, &mCuller);
+	BuildRenderPacket(packet);
+
+	// Shown by the GUI next frame
+	mGUI->mVisibleMeshes = (int)mCuller.GetVisibleCount();
+	mGUI->mCulledMeshes = (int)mCuller.GetCulledCount();
 }
 
 void App::UpdatePerFrameConstantBuffer()
@@ -475,33 +510,77 @@ void App::UpdatePerMaterialConstantBuffers()
 {
 	auto currMaterialCB = mGraphics->mCurrentFrameResource->mPerMaterialConstantBuffer.get();
 
-	for (auto& mat : mMaterials)
+	// Only materials changed since this frame resource was last used, each is marked once and written to every frame
+	for (UINT index : mMaterialChanges.Take(CurrentFrameResourceIndex))
 	{
-		// Only update the cbuffer data if the constants have changed. If the cbuffer data changes, it needs to be updated for each FrameResource.
-		if (mat->NumFramesDirty > 0)
-		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+		auto mat = mMaterials[index];
+		XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
 
-			PerMaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			matConstants.Metallic = mat->Metalness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+		PerMaterialConstants matConstants;
+		matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
+		matConstants.FresnelR0 = mat->FresnelR0;
+		matConstants.Roughness = mat->Roughness;
+		matConstants.Metallic = mat->Metalness;
+		matConstants.TextureSlice = (float)mat->TextureSlice;
+		XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
 
-			currMaterialCB->Copy(mat->CBIndex, matConstants);
+		// This frame resource's copy of the material's texture table
+		if (mat->DiffuseSRVIndex > -1) matConstants.TextureIndex = mat->DiffuseSRVIndex + CurrentFrameResourceIndex * mat->SRVFrameStride;
 
-			// Next FrameResource needs to be updated too.
-			mat->NumFramesDirty--;
-		}
+		currMaterialCB->Copy(index, matConstants);
 	}
 }
 
 void App::Draw(float frameTime)
 {
-	// Reset command allocator and create new list on it
-	mGraphics->ResetCommandAllocator(0);
-	auto commandList = mGraphics->StartCommandList(0, 0);
+	auto& packet = mPackets[mUpdatePacket];
+
+	// The last frame is presented first, this frame's GUI goes on the next back buffer
+	FinishRender();
+
+	// The main thread's lists come from one allocator, so it is reset before either is recorded
+	mGraphics->ResetCommandAllocator(0, packet.FrameIndex);
+
+	// The GUI and back buffer belong to the main thread, so their list is always recorded here
+	RecordPost(packet);
+
+	if (!mGUI->mPipelinedFrames)
+	{
+		RecordScene(packet);
+		SubmitFrame(packet);
+		return;
+	}
+
+	// The scene is recorded as a job while the next frame updates, and submitted once that is done
+	mRenderPacket = mUpdatePacket;
+	mRenderPending = true;
+	Jobs->Run([this, &packet]() { RecordScene(packet); }, &mSceneRecorded);
+}
+
+void App::FinishRender()
+{
+	if (!mRenderPending) return;
+
+	Jobs->Wait(mSceneRecorded);
+	SubmitFrame(mPackets[mRenderPacket]);
+	mRenderPending = false;
+}
+
+void App::BuildRenderPacket(RenderPacket& packet)
+{
+	packet.Frame = mGraphics->mCurrentFrameResource;
+	packet.FrameIndex = CurrentFrameResourceIndex;
+
+	// Pipeline for each type of model, wireframe draws them all the same way
+	packet.Pipelines[ColourPipeline] = mGraphics->mSolidPSO.Get();
+	packet.Pipelines[TexPipeline] = mGraphics->mTexPSO.Get();
+	packet.Pipelines[SimpleTexPipeline] = mGraphics->mSimpleTexPSO.Get();
+	if (mWireframe) packet.Pipelines.fill(mGraphics->mInstancedWireframePSO.Get());
+}
+
+void App::RecordScene(RenderPacket& packet)
+{
+	auto commandList = mGraphics->StartCommandList(0, 0, packet.FrameIndex);
 
 	mGraphics->SetViewportAndScissorRects(commandList);
 
@@ -509,68 +588,48 @@ void App::Draw(float frameTime)
 	mGraphics->ClearBackBuffer(commandList);
 	mGraphics->ClearDepthBuffer(commandList);
 
-	// Select MSAA texture as render target
-	mGraphics->SetMSAARenderTarget(commandList);
+	SetFrameState(commandList, 0, 0, packet);
 
-	mGraphics->SetDescriptorHeapsAndRootSignature(0, 0);
+	// Lists are executed in the order they are drawn in
+	packet.CommandLists = { { 0, 0 } };
+	packet.StateChanges = 0;
 
-	// Set SRV heap
-	auto srvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(SrvDescriptorHeap->mHeap->GetGPUDescriptorHandleForHeapStart());
-	commandList->SetGraphicsRootDescriptorTable(0, srvHandle);
+	// Record slices of the draw list as jobs, small lists aren't worth a command list per slice
+	size_t drawCount = packet.Draws.GetDrawCount();
+	size_t maxSlices = std::min<size_t>(Jobs->GetThreadCount(), mGraphics->GetMaxThreads() - 1);
+	int slices = (int)std::min(maxSlices, drawCount / MIN_DRAWS_PER_SLICE);
 
-	// Set per-frame buffer
-	auto perFrameBuffer = mGraphics->mCurrentFrameResource->mPerFrameConstantBuffer->GetBuffer();
-	commandList->SetGraphicsRootConstantBufferView(2, perFrameBuffer->GetGPUVirtualAddress());
+	if (slices > 1)
+	{
+		// Each slice has its own command list and allocator, whichever thread records it
+		std::vector<int> sliceStateChanges(slices);
+		JobCounter recorded;
+		size_t count = (drawCount + slices - 1) / slices;
+		for (int i = 0; i < slices; ++i)
+		{
+			int start = (int)std::min(drawCount, i * count);
+			int end = (int)std::min(drawCount, (i + 1) * count);
+			Jobs->Run([this, i, start, end, &packet, &sliceStateChanges]() { sliceStateChanges[i] = RecordDraws(packet, i + 1, start, end); }, &recorded);
+			packet.CommandLists.push_back({ i + 1, 0 });
+		}
+		Jobs->Wait(recorded);
 
-	// Set skybox texture
-	CD3DX12_GPU_DESCRIPTOR_HANDLE cubeTex(SrvDescriptorHeap->mHeap->GetGPUDescriptorHandleForHeapStart());
-	cubeTex.Offset(mSkyMat->DiffuseSRVIndex, CbvSrvUavDescriptorSize);
-	commandList->SetGraphicsRootDescriptorTable(4, cubeTex);
-	
-	// Draw models
-	DrawModels(commandList);
-
-	// Execute commands
-	//mGraphics->CloseAndExecuteCommandList(0, 0);
-
-	//// Thread planet chunk rendering
-	//int start = 0;
-	//int count = (mPlanet->mTriangleChunks.size() + mNumRenderWorkers - 1) / mNumRenderWorkers;
-	//for (int i = 0; i < mNumRenderWorkers; ++i)
-	//{
-	//	// Prepare work
-	//	auto& work = mRenderWorkers[i].second;
-	//	work.start = start;
-	//	start += count;
-	//	if (start > mPlanet->mTriangleChunks.size())  start = mPlanet->mTriangleChunks.size();
-	//	work.end = start;
-	//	// Flag the work as not yet complete
-	//	auto& workerThread = mRenderWorkers[i].first;
-	//	{
-	//		// Mutex work complete
-	//		std::unique_lock<std::mutex> l(workerThread.lock);
-	//		work.complete = false;
-	//	}
-	//	// Signal the worker to start work
-	//	workerThread.workReady.notify_one();
-	//}
-	//// Wait for each worker to finish
-	//for (int i = 0; i < mNumRenderWorkers; ++i)
-	//{
-	//	auto& workerThread = mRenderWorkers[i].first;
-	//	auto& work = mRenderWorkers[i].second;
-	//	// Wait for work completed signal
-	//	std::unique_lock<std::mutex> l(workerThread.lock);
-	//	workerThread.workReady.wait(l, [&]() { return work.complete; });
-	//}
-
-	// Start a new command list
-	//commandList = mGraphics->StartCommandList(0, 1);
-
-	// Setup command list
-	//mGraphics->SetDescriptorHeapsAndRootSignature(0, 1);
-	//mGraphics->SetViewportAndScissorRects(commandList);
-	//mGraphics->SetMSAARenderTarget(commandList);
+		for (int changes : sliceStateChanges) packet.StateChanges += changes;
+	}
+	else
+	{
+		packet.StateChanges = packet.Draws.Draw(commandList, packet.Pipelines);
+	}
+
+	mGraphics->CloseCommandList(0, 0);
+}
+
+void App::RecordPost(RenderPacket& packet)
+{
+	// Drawn after the scene lists
+	auto commandList = mGraphics->StartCommandList(0, 1, packet.FrameIndex);
+	mGraphics->SetViewportAndScissorRects(commandList);
+	SetFrameState(commandList, 0, 1, packet);
 
 	if (mWireframe) commandList->SetPipelineState(mGraphics->mWireframePSO.Get());
 	else commandList->SetPipelineState(mGraphics->mPlanetPSO.Get());
@@ -587,103 +646,83 @@ void App::Draw(float frameTime)
 	// Render the GUI
 	mGUI->Render(commandList, mGraphics->CurrentBackBuffer(), mGraphics->CurrentBackBufferView(), mGraphics->mDSVHeap.Get(), mGraphics->mDsvDescriptorSize);
 
-	// Execute commands
-	mGraphics->CloseAndExecuteCommandList(0, 0);
-
-	// Swap back buffers with GUI vsync option
-	mGraphics->SwapBackBuffers(mGUI->mVSync);
+	mGraphics->CloseCommandList(0, 1);
 }
 
-void App::DrawModels(ID3D12GraphicsCommandList* commandList)
+void App::SubmitFrame(RenderPacket& packet)
 {
-	// Set the pipeline state for each type of model and draw
-	if (mWireframe) { commandList->SetPipelineState(mGraphics->mWireframePSO.Get()); }
-	else { commandList->SetPipelineState(mGraphics->mSolidPSO.Get()); }
+	// Send any uploads queued since last frame ahead of this frame's commands
+	Uploader->Submit();
 
-	for(int i = 0; i < mColourModels.size(); i++)
-	{		
-		mColourModels[i]->Draw(commandList);
-	}
+	// Execute every list with one submission
+	auto commandLists = packet.CommandLists;
+	commandLists.push_back({ 0, 1 });
+	mGraphics->ExecuteCommandLists(commandLists);
 
-	if (mWireframe) { commandList->SetPipelineState(mGraphics->mWireframePSO.Get()); }
-	else { commandList->SetPipelineState(mGraphics->mTexPSO.Get()); }
+	// Swap back buffers with GUI vsync option
+	mGraphics->SwapBackBuffers(mGUI->mVSync);
 
-	for(int i = 0; i < mTexModels.size(); i++)
-	{
-		mTexModels[i]->Draw(commandList);
-	}
+	// Advance fence value
+	packet.Frame->Fence = ++mGraphics->mCurrentFence;
 
-	if (mWireframe) { commandList->SetPipelineState(mGraphics->mWireframePSO.Get()); }
-	else { commandList->SetPipelineState(mGraphics->mSimpleTexPSO.Get()); }
+	// Set a new fence point when reached by GPU
+	CommandQueue->Signal(mGraphics->mFence.Get(), mGraphics->mCurrentFence);
 
-	for (int i = 0; i < mSimpleTexModels.size(); i++)
-	{
-		mSimpleTexModels[i]->Draw(commandList);
-	}
+	// Buffers freed up to now can be reused once the frame's fence completes, no earlier frame still in flight uses them
+	BufferHeap->FenceFrees(mGraphics->mCurrentFence);
+	Textures->FenceReleases(mGraphics->mCurrentFence);
+
+	// Shown by the GUI next frame
+	mGUI->mDrawCalls = (int)packet.Draws.GetDrawCount();
+	mGUI->mStateChanges = packet.StateChanges;
 }
 
-void App::RenderThread(int thread)
+void App::SetFrameState(ID3D12GraphicsCommandList* commandList, int thread, int list, const RenderPacket& packet)
 {
-	auto& worker = mRenderWorkers[thread].first;
-	auto& work = mRenderWorkers[thread].second;
-	while (true)
-	{
-		{	// Mutex work complete
-			std::unique_lock<std::mutex> l(worker.lock);
+	// Select MSAA texture as render target
+	mGraphics->SetMSAARenderTarget(commandList);
 
-			// Wait for a signal
-			worker.workReady.wait(l, [&]() { return !work.complete; });
-		}
+	mGraphics->SetDescriptorHeapsAndRootSignature(thread, list);
 
-		// Start work
-		RenderChunks(thread + 1, work.start, work.end); // Add one for main thread
+	// Every texture in the SRV heap, materials give shaders the index of their table
+	auto srvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(SrvDescriptorHeap->mHeap->GetGPUDescriptorHandleForHeapStart());
+	commandList->SetGraphicsRootDescriptorTable(0, srvHandle);
 
-		{ 
-			// Mutex work complete
-			std::unique_lock<std::mutex> l(worker.lock);
-			work.complete = true; // Flag work as complete
-		}
+	// Set per-frame buffer
+	auto perFrameBuffer = packet.Frame->mPerFrameConstantBuffer->GetBuffer();
+	commandList->SetGraphicsRootConstantBufferView(2, perFrameBuffer->GetGPUVirtualAddress());
 
-		// Signal work completed to main
-		worker.workReady.notify_one();
-	}
+	// Set skybox texture
+	CD3DX12_GPU_DESCRIPTOR_HANDLE cubeTex(SrvDescriptorHeap->mHeap->GetGPUDescriptorHandleForHeapStart());
+	cubeTex.Offset(mSkyMat->DiffuseSRVIndex, CbvSrvUavDescriptorSize);
+	commandList->SetGraphicsRootDescriptorTable(3, cubeTex);
+
+	// Models are drawn instanced, reading transforms and materials from this frame's buffers
+	commandList->SetGraphicsRootShaderResourceView(4, packet.Frame->mInstanceBuffer->GetBuffer()->GetGPUVirtualAddress());
+	commandList->SetGraphicsRootShaderResourceView(5, packet.Frame->mPerMaterialConstantBuffer->GetBuffer()->GetGPUVirtualAddress());
+	commandList->SetGraphicsRootShaderResourceView(7, packet.Frame->mObjectBuffer->GetBuffer()->GetGPUVirtualAddress());
 }
 
-void App::RenderChunks(int thread, int start, int end)
+int App::RecordDraws(RenderPacket& packet, int thread, int start, int end)
 {
-	// Reset the main thread command allocator and start a new command lists on it
-	mGraphics->ResetCommandAllocator(thread);
-	auto commandList = mGraphics->StartCommandList(thread, 0);
-
-	// Setup command list
-	mGraphics->SetDescriptorHeapsAndRootSignature(thread, 0);
-
-	D3D12_VIEWPORT viewport = { 0.0f, 0.0f, static_cast<float>(mGraphics->GetBackbufferWidth()), static_cast<float>(mGraphics->GetBackbufferHeight()), D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
-	D3D12_RECT     scissorRect = { 0,    0,  static_cast<LONG> (mGraphics->GetBackbufferWidth()), static_cast<LONG> (mGraphics->GetBackbufferWidth()) };
-	commandList->RSSetViewports(1, &viewport);
-	commandList->RSSetScissorRects(1, &scissorRect);
-
-	mGraphics->SetMSAARenderTarget(commandList);
-
-	// Set pipeline state to render planet
-	if(mWireframe) commandList->SetPipelineState(mGraphics->mWireframePSO.Get());
-	else commandList->SetPipelineState(mGraphics->mPlanetPSO.Get());
+	// Reset this slice's command allocator and start a new command list on it
+	mGraphics->ResetCommandAllocator(thread, packet.FrameIndex);
+	auto commandList = mGraphics->StartCommandList(thread, 0, packet.FrameIndex);
 
-	// Render section of chunks
-	for (int i = start; i < end; ++i)
-		//mPlanet->mTriangleChunks[i]->mMesh->Draw(commandList);
+	// Each list starts with no state, set everything the draws need
+	mGraphics->SetViewportAndScissorRects(commandList);
+	SetFrameState(commandList, thread, 0, packet);
 
-	// Execute commands
-	mGraphics->CloseAndExecuteCommandList(thread, 0);
+	// Record a slice of the draw list, the main thread submits it
+	int stateChanges = packet.Draws.Draw(commandList, packet.Pipelines, start, end);
+	mGraphics->CloseCommandList(thread, 0);
+	return stateChanges;
 }
 
 void App::EndFrame()
 {
-	// Advance fence value
-	mGraphics->mCurrentFrameResource->Fence = ++mGraphics->mCurrentFence;
-
-	// Set a new fence point when reached by GPU
-	CommandQueue->Signal(mGraphics->mFence.Get(), mGraphics->mCurrentFence);
+	// The next frame updates the other packet, while this one may still be recording
+	mUpdatePacket = 1 - mUpdatePacket;
 
 	// Cycle through frame resources
 	mGraphics->CycleFrameResources();
@@ -704,6 +743,8 @@ void App::ProcessEvents(SDL_Event& event)
 	// If window resized
 	if (mWindow->mResized)
 	{
+		// Render targets are about to be recreated, the frame recording into them has to finish first
+		FinishRender();
 		mGraphics->Resize(mWindow->mWidth, mWindow->mHeight);
 		mCamera->WindowResized(mWindow.get());
 		mWindow->mResized = false;
@@ -717,6 +758,39 @@ void App::ProcessEvents(SDL_Event& event)
 		mCamera->MouseMoved(event,mWindow.get());
 		mWindow->mMouseMoved = false;
 	}
+
+	// Middle click selects the model under the cursor
+	if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_MIDDLE)
+	{
+		PickModel(event.button.x, event.button.y);
+	}
+}
+
+void App::PickModel(int x, int y)
+{
+	// Ray from the eye through the cursor, unprojected from the near and far planes
+	XMMATRIX view = XMLoadFloat4x4(&mCamera->mViewMatrix);
+	XMMATRIX proj = XMLoadFloat4x4(&mCamera->mProjectionMatrix);
+	XMMATRIX invViewProj = XMMatrixInverse(nullptr, XMMatrixMultiply(view, proj));
+
+	float ndcX = 2.0f * x / mWindow->mWidth - 1.0f;
+	float ndcY = 1.0f - 2.0f * y / mWindow->mHeight;
+	XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), invViewProj);
+	XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), invViewProj);
+
+	float distance = 0.0f;
+	Model* picked = SceneIndex->RayCast(nearPoint, XMVector3Normalize(farPoint - nearPoint), distance);
+	if (!picked) return;
+
+	// Only models the GUI can edit
+	for (int i = 0; i < mNumModels; ++i)
+	{
+		if (mModels[i] == picked)
+		{
+			mGUI->mSelectedModel = i;
+			return;
+		}
+	}
 }
 
 void App::CreateMaterials()
@@ -725,29 +799,75 @@ void App::CreateMaterials()
 	mCurrentMatCBIndex = 0;
 	for (auto& model : mModels)
 	{
-		for (auto& mesh : model->mMeshes)
+		AddMaterials(model);
+	}
+}
+
+void App::AddMaterials(Model* model)
+{
+	for (auto& mesh : model->mMeshes)
+	{
+		// Frame resources are sized for a fixed number of materials
+		if (mCurrentMatCBIndex >= MAX_MATERIALS)
+		{
+			MessageBox(0, L"Too many materials", L"Error", MB_OK);
+			return;
+		}
+
+		mesh->mMaterial->CBIndex = mCurrentMatCBIndex;
+		mMaterials.push_back(mesh->mMaterial);
+		mMaterialChanges.Mark(mCurrentMatCBIndex);
+		mCurrentMatCBIndex++;
+	}
+}
+
+void App::AddToDrawLists(Model* model)
+{
+	// Choose the model's PSO, its meshes are sorted into the draw list each frame it is visible
+	if (model->mTextured)
+	{
+		if (model->mPerMeshTextured)
+		{
+			if (model->mPerMeshPBR)
+			{
+				model->mDrawList = TexPipeline;
+			}
+			else
+			{
+				model->mDrawList = SimpleTexPipeline;
+			}
+		}
+		else if (model->mModelTextured)
 		{
-			mesh->mMaterial->CBIndex = mCurrentMatCBIndex;
-			mMaterials.push_back(mesh->mMaterial);
-			mCurrentMatCBIndex++;
+			model->mDrawList = TexPipeline;
 		}
 	}
+	else
+	{
+		model->mDrawList = ColourPipeline;
+	}
+
+	if (model->mDrawList >= 0) model->AddToSceneIndex();
 }
 
 App::~App()
 {
+	FinishRender();
+
 	// Empty the command queue
 	if (D3DDevice != nullptr) { mGraphics->EmptyCommandQueue(); }
 
-	// Close worker threads
-	for (int i = 0; i < mNumRenderWorkers; ++i)
-	{
-		mRenderWorkers[i].first.thread.detach();
-	}
-
 	for (auto& model : mModels)
 	{
 		delete model;
 	}
 
+	SceneIndex.reset();
+	Objects.reset();
+	ModelAssets.reset();
+	Streamer.reset();
+	Textures.reset();
+
+	// Last, loading jobs above finish on it
+	Jobs.reset();
 }
\ No newline at end of file
@@ -47,6 +47,7 @@
 #include "SRVDescriptorHeap.h"
 #include "TerrainTile.h"
 #include "ChunkManager.h"
+#include "DrawList.h"
 
 #include <fstream>
 
@@ -78,10 +79,17 @@ private:
 
 	void CreateMaterials();
 
+	// Register a model once its meshes exist
+	void AddMaterials(Model* model);
+	void AddToDrawLists(Model* model);
+
 	void CreateSkybox();
 
-	// List of materials
+	// List of materials, by constant buffer index
 	vector<Material*> mMaterials;
+
+	// Materials whose constants each frame resource still needs, mark a material's index after editing it
+	DirtyList mMaterialChanges = DirtyList(Graphics::mNumFrameResources);
 	
 	// Sky and water models
 	Model* mSkyModel;
@@ -95,11 +103,38 @@ private:
 	// Window object
 	unique_ptr<Window> mWindow;
 
-	// Lists of models by PSO
+	// List of models
 	vector<Model*> mModels;
-	vector<Model*> mTexModels;
-	vector<Model*> mSimpleTexModels;
-	vector<Model*> mColourModels;
+
+	// Models in the scene index inside the view frustum
+	vector<Model*> mVisibleModels;
+
+	// Everything recording a frame needs, filled by Update. Frames are pipelined by recording one packet
+	// while the next frame updates the other
+	struct RenderPacket
+	{
+		// Meshes of the visible models sorted into instanced draws
+		DrawList Draws;
+
+		FrameResource* Frame = nullptr;
+		int FrameIndex = 0;
+		std::array<ID3D12PipelineState*, NumDrawPipelines> Pipelines = {};
+
+		// Scene command lists in execution order, set when recorded
+		std::vector<std::pair<int, int>> CommandLists;
+		int StateChanges = 0;
+	};
+
+	RenderPacket mPackets[2];
+	int mUpdatePacket = 0;
+
+	// Packet being recorded by a job, submitted by FinishRender
+	int mRenderPacket = 0;
+	bool mRenderPending = false;
+	JobCounter mSceneRecorded;
+
+	// Meshes outside the view are left out of the batches
+	FrustumCuller mCuller;
 	int mNumModels = 0;
 
 	// Camera object
@@ -124,34 +159,40 @@ private:
 	void CreateLandscape();
 	void LoadModels();
 	void UpdateSelectedModel();
-	void UpdatePerObjectConstantBuffers();
+
+	// Select the model under a window position
+	void PickModel(int x, int y);
+	void UpdateTextureStreaming();
+	void UpdateObjectBuffer();
+	void UpdateInstanceBuffer();
 	void UpdatePerFrameConstantBuffer();
 	void UpdatePerMaterialConstantBuffers();
 
 	void BuildFrameResources();
 
-	void DrawModels(ID3D12GraphicsCommandList* commandList);
-	void StartFrame();
-	void EndFrame();
+	// Fill the parts of a packet that aren't set while updating
+	void BuildRenderPacket(RenderPacket& packet);
 
-	void RenderThread(int thread);
-	void RenderChunks(int thread, int start, int end);
+	// Clear and draw the scene, on worker lists too for big draw lists. Safe to run alongside Update
+	void RecordScene(RenderPacket& packet);
 
-	struct WorkerThread
-	{
-		std::thread             thread;
-		std::condition_variable workReady;
-		std::mutex              lock;
-	};
+	// Sky, MSAA resolve and GUI, on the main thread's second list
+	void RecordPost(RenderPacket& packet);
 
-	struct RenderWork
-	{
-		bool complete = true;
-		int  start = 0;
-		int  end = 0;
-	};
+	// Execute a recorded packet's lists and present
+	void SubmitFrame(RenderPacket& packet);
+
+	// Wait for a pipelined frame still recording and submit it
+	void FinishRender();
+
+	// Render target, root signature and root arguments every command list of the frame starts with
+	void SetFrameState(ID3D12GraphicsCommandList* commandList, int thread, int list, const RenderPacket& packet);
+	void StartFrame();
+	void EndFrame();
+
+	// Record draws [start, end) of the draw list on a thread's command list, returns the state changes
+	int RecordDraws(RenderPacket& packet, int thread, int start, int end);
 
-	static const int MAX_WORKERS = 128;
-	std::pair<WorkerThread, RenderWork> mRenderWorkers[MAX_WORKERS];
-	int mNumRenderWorkers = 0;
+	// Draws each slice needs before recording on several threads is faster than on one
+	static const int MIN_DRAWS_PER_SLICE = 256;
 };
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "BakedModel.h"
+#include "ModelCache.h"
+#include <fstream>
+#include <vector>
+
+// Map a whole file for reading, returns false if it could not be opened
+static bool MapFile(const std::string& fileName, HANDLE& file, HANDLE& mapping, const uint8_t*& data, uint64_t& size)
+{
+	file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	size = (uint64_t)fileSize.QuadPart;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	return true;
+}
+
+static void UnmapFile(HANDLE& file, HANDLE& mapping, const uint8_t*& data)
+{
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	data = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+}
+
+BakedModelFile::~BakedModelFile()
+{
+	Close();
+}
+
+bool BakedModelFile::Open(const std::string& fileName, uint64_t sourceHash, uint32_t importFlags)
+{
+	Close();
+	if (!MapFile(fileName, mFile, mMapping, mData, mSize)) return false;
+
+	// Reject anything baked by another version, from other data, or with another vertex layout
+	auto header = GetHeader();
+	bool valid = mSize >= sizeof(BakedModelHeader) &&
+		header->Magic == BAKED_MODEL_MAGIC &&
+		header->Version == BAKED_MODEL_VERSION &&
+		header->SourceHash == sourceHash &&
+		header->ImportFlags == importFlags &&
+		header->VertexSize == sizeof(Vertex);
+
+	uint64_t tablesEnd = sizeof(BakedModelHeader);
+	if (valid)
+	{
+		tablesEnd += (uint64_t)header->MaterialCount * sizeof(BakedMaterial) + (uint64_t)header->MeshCount * sizeof(BakedMesh);
+		valid = tablesEnd <= mSize;
+	}
+
+	// Every mesh's data must lie inside the file
+	for (uint32_t i = 0; valid && i < header->MeshCount; i++)
+	{
+		auto& mesh = GetMeshes()[i];
+		valid = mesh.VertexOffset + (uint64_t)mesh.VertexCount * sizeof(Vertex) <= mSize &&
+			mesh.IndexOffset + (uint64_t)mesh.IndexCount * sizeof(uint32_t) <= mSize &&
+			mesh.MaterialIndex < (int32_t)header->MaterialCount;
+	}
+
+	if (!valid) Close();
+	return valid;
+}
+
+void BakedModelFile::Close()
+{
+	UnmapFile(mFile, mMapping, mData);
+	mSize = 0;
+}
+
+const BakedMaterial* BakedModelFile::GetMaterials() const
+{
+	return reinterpret_cast<const BakedMaterial*>(mData + sizeof(BakedModelHeader));
+}
+
+const BakedMesh* BakedModelFile::GetMeshes() const
+{
+	return reinterpret_cast<const BakedMesh*>(mData + sizeof(BakedModelHeader) + GetHeader()->MaterialCount * sizeof(BakedMaterial));
+}
+
+bool BakedModelFile::Write(const std::string& fileName, uint64_t sourceHash, uint32_t importFlags, const ModelAsset& asset)
+{
+	BakedModelHeader header = {};
+	header.Magic = BAKED_MODEL_MAGIC;
+	header.Version = BAKED_MODEL_VERSION;
+	header.SourceHash = sourceHash;
+	header.ImportFlags = importFlags;
+	header.VertexSize = sizeof(Vertex);
+	header.MeshCount = (uint32_t)asset.Meshes.size();
+	header.MaterialCount = (uint32_t)asset.Materials.size();
+
+	std::vector<BakedMaterial> materials(asset.Materials.size());
+	for (size_t i = 0; i < asset.Materials.size(); i++)
+	{
+		auto& source = asset.Materials[i];
+		auto& material = materials[i];
+		memset(&material, 0, sizeof(material));
+		strncpy_s(material.Name, source.Name.C_Str(), _TRUNCATE);
+		material.DiffuseAlbedo[0] = source.DiffuseAlbedo.x;
+		material.DiffuseAlbedo[1] = source.DiffuseAlbedo.y;
+		material.DiffuseAlbedo[2] = source.DiffuseAlbedo.z;
+		material.DiffuseAlbedo[3] = source.DiffuseAlbedo.w;
+		material.Roughness = source.Roughness;
+		material.Metalness = source.Metalness;
+	}
+
+	// Geometry follows the tables, each mesh's vertices then its indices
+	uint64_t offset = sizeof(BakedModelHeader) + materials.size() * sizeof(BakedMaterial) + asset.Meshes.size() * sizeof(BakedMesh);
+	std::vector<BakedMesh> meshes(asset.Meshes.size());
+	for (size_t i = 0; i < asset.Meshes.size(); i++)
+	{
+		auto geometry = asset.Meshes[i].Geometry;
+		auto& mesh = meshes[i];
+		mesh = {};
+		mesh.MaterialIndex = asset.Meshes[i].MaterialIndex;
+		mesh.VertexCount = (uint32_t)geometry->mVertices.size();
+		mesh.IndexCount = (uint32_t)geometry->mIndices.size();
+		mesh.VertexOffset = offset;
+		offset += mesh.VertexCount * sizeof(Vertex);
+		mesh.IndexOffset = offset;
+		offset += mesh.IndexCount * sizeof(uint32_t);
+	}
+
+	// Write to a temporary file first so a failed write never leaves a damaged bake behind
+	std::string tempFileName = fileName + ".tmp";
+	{
+		std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+		if (!file) return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(materials.data()), materials.size() * sizeof(BakedMaterial));
+		file.write(reinterpret_cast<const char*>(meshes.data()), meshes.size() * sizeof(BakedMesh));
+		for (auto& assetMesh : asset.Meshes)
+		{
+			auto geometry = assetMesh.Geometry;
+			file.write(reinterpret_cast<const char*>(geometry->mVertices.data()), geometry->mVertices.size() * sizeof(Vertex));
+			file.write(reinterpret_cast<const char*>(geometry->mIndices.data()), geometry->mIndices.size() * sizeof(uint32_t));
+		}
+		if (!file) return false;
+	}
+
+	return MoveFileExA(tempFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool BakedModelFile::HashFile(const std::string& fileName, uint64_t& hash)
+{
+	HANDLE file, mapping;
+	const uint8_t* data;
+	uint64_t size;
+	if (!MapFile(fileName, file, mapping, data, size)) return false;
+
+	hash = HashBytes(data, (size_t)size);
+
+	UnmapFile(file, mapping, data);
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <string>
+#include "Utility.h"
+
+struct ModelAsset;
+
+// Baked files are rebuilt when any of these change
+const uint32_t BAKED_MODEL_MAGIC = 0x4C444D42; // "BMDL"
+const uint32_t BAKED_MODEL_VERSION = 1;
+
+// File layout: header, materials, mesh table, then vertex and index data at the offsets in the table
+struct BakedModelHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t SourceHash;
+	uint32_t ImportFlags;
+	uint32_t VertexSize;
+	uint32_t MeshCount;
+	uint32_t MaterialCount;
+};
+
+struct BakedMaterial
+{
+	char Name[256];
+	float DiffuseAlbedo[4];
+	float Roughness;
+	float Metalness;
+};
+
+struct BakedMesh
+{
+	int32_t MaterialIndex;
+	uint32_t VertexCount;
+	uint32_t IndexCount;
+	uint32_t Padding;
+	uint64_t VertexOffset;
+	uint64_t IndexOffset;
+};
+
+// Processed model data saved after the first import, read back through a file mapping
+// so geometry can be uploaded without assimp or any intermediate copies
+class BakedModelFile
+{
+public:
+	~BakedModelFile();
+
+	// Map a baked file, fails if it is missing, damaged, or baked from other source data or flags
+	bool Open(const std::string& fileName, uint64_t sourceHash, uint32_t importFlags);
+	void Close();
+
+	const BakedModelHeader* GetHeader() const { return reinterpret_cast<const BakedModelHeader*>(mData); }
+	const BakedMaterial* GetMaterials() const;
+	const BakedMesh* GetMeshes() const;
+	const Vertex* GetVertices(const BakedMesh& mesh) const { return reinterpret_cast<const Vertex*>(mData + mesh.VertexOffset); }
+	const uint32_t* GetIndices(const BakedMesh& mesh) const { return reinterpret_cast<const uint32_t*>(mData + mesh.IndexOffset); }
+
+	// Save an asset whose meshes still hold their optimized CPU geometry
+	static bool Write(const std::string& fileName, uint64_t sourceHash, uint32_t importFlags, const ModelAsset& asset);
+
+	// Hash of a source file's contents, used to spot stale baked files
+	static bool HashFile(const std::string& fileName, uint64_t& hash);
+
+	static std::string GetBakedFileName(const std::string& sourceFileName) { return sourceFileName + ".baked"; }
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const uint8_t* mData = nullptr;
+	uint64_t mSize = 0;
+};
@@ -0,0 +1,51 @@
+#include "Benchmarks.h"
+#include "TextureDecoder.h"
+#include "JobSystem.h"
+#include "BuddyAllocator.h"
+#include <filesystem>
+#include <vector>
+#include <cwctype>
+#include <cstdio>
+
+// Texture files the decoder handles, found the same way on every platform
+static std::vector<std::wstring> FindImages(const std::wstring& directory)
+{
+	std::vector<std::wstring> paths;
+	std::error_code error;
+	for (auto& entry : std::filesystem::recursive_directory_iterator(directory, error))
+	{
+		if (!entry.is_regular_file()) continue;
+
+		std::wstring extension = entry.path().extension().wstring();
+		for (auto& c : extension) c = (wchar_t)std::towlower(c);
+		if (extension == L".png" || extension == L".jpg" || extension == L".jpeg") paths.push_back(entry.path().wstring());
+	}
+	return paths;
+}
+
+std::string Benchmarks::Run(const std::wstring& textureDirectory)
+{
+	char line[256];
+	std::string report;
+
+	// Its own job system, the benchmarks run before or without the engine
+	JobSystem jobs;
+
+	auto images = FindImages(textureDirectory);
+	auto decode = TextureDecoder::Benchmark(jobs, images);
+	snprintf(line, sizeof(line), "Texture decode: %zu of %zu files, %.1f megapixels\n", decode.Files, images.size(), decode.Megapixels);
+	report += line;
+	if (decode.Files > 0)
+	{
+		snprintf(line, sizeof(line), "  One thread: %.1f ms, %.1f megapixels/s\n", decode.SerialMs, decode.Megapixels / (decode.SerialMs / 1000.0));
+		report += line;
+		snprintf(line, sizeof(line), "  Job system: %.1f ms, %.1fx\n", decode.ParallelMs, decode.SerialMs / decode.ParallelMs);
+		report += line;
+	}
+
+	auto buddy = BuddyAllocator::Benchmark();
+	snprintf(line, sizeof(line), "Buddy allocator: %.0f ns allocate, %.0f ns free, %.0f%% fragmented, %s\n", buddy.AllocateNs, buddy.FreeNs,
+		buddy.Fragmentation * 100.0, buddy.Passed ? "passed" : "FAILED");
+	report += line;
+	return report;
+}
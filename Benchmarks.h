@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+// CPU-only benchmarks that need no window, device or Windows API. Run with "DX12Engine.exe -benchmark",
+// or on any platform through HeadlessBenchmark.cpp
+class Benchmarks
+{
+public:
+	// Decodes every png and jpg under textureDirectory and runs the buddy allocator benchmark. Returns a readable report
+	static std::string Run(const std::wstring& textureDirectory);
+};
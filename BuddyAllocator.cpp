@@ -0,0 +1,152 @@
+#include "BuddyAllocator.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+static uint64_t NextPowerOfTwo(uint64_t value)
+{
+	uint64_t result = 1;
+	while (result < value) result <<= 1;
+	return result;
+}
+
+BuddyAllocator::BuddyAllocator(uint64_t size, uint64_t minBlockSize)
+{
+	mMinBlockSize = NextPowerOfTwo(std::max<uint64_t>(minBlockSize, 1));
+	mSize = std::max(NextPowerOfTwo(size), mMinBlockSize);
+
+	// One level per halving down to the minimum block size
+	mNumLevels = LevelForBlockSize(mMinBlockSize) + 1;
+	mFreeLists.resize(mNumLevels);
+
+	// Whole range starts free
+	mFreeLists[0].insert(0);
+}
+
+uint64_t BuddyAllocator::GetBlockSize(uint64_t size) const
+{
+	return std::max(NextPowerOfTwo(std::max<uint64_t>(size, 1)), mMinBlockSize);
+}
+
+int BuddyAllocator::LevelForBlockSize(uint64_t blockSize) const
+{
+	int level = 0;
+	while ((mSize >> level) > blockSize) level++;
+	return level;
+}
+
+uint64_t BuddyAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+	// Blocks are aligned to their size so a larger alignment means a larger block
+	uint64_t blockSize = std::max(GetBlockSize(size), NextPowerOfTwo(std::max<uint64_t>(alignment, 1)));
+	if (blockSize > mSize) return INVALID_OFFSET;
+
+	const int level = LevelForBlockSize(blockSize);
+
+	// Find the smallest free block that fits
+	int freeLevel = level;
+	while (freeLevel >= 0 && mFreeLists[freeLevel].empty()) freeLevel--;
+	if (freeLevel < 0) return INVALID_OFFSET;
+
+	// Take the lowest free block to keep allocations packed at the start of the range
+	uint64_t offset = *mFreeLists[freeLevel].begin();
+	mFreeLists[freeLevel].erase(mFreeLists[freeLevel].begin());
+
+	// Split down to the requested size, freeing the upper half each time
+	while (freeLevel < level)
+	{
+		freeLevel++;
+		mFreeLists[freeLevel].insert(offset + BlockSizeForLevel(freeLevel));
+	}
+
+	mAllocations[offset] = level;
+	mUsedSize += blockSize;
+	return offset;
+}
+
+void BuddyAllocator::Free(uint64_t offset)
+{
+	auto allocation = mAllocations.find(offset);
+	if (allocation == mAllocations.end()) return;
+
+	int level = allocation->second;
+	mAllocations.erase(allocation);
+	mUsedSize -= BlockSizeForLevel(level);
+
+	// Merge with the buddy while it is also free
+	while (level > 0)
+	{
+		uint64_t buddy = offset ^ BlockSizeForLevel(level);
+		auto found = mFreeLists[level].find(buddy);
+		if (found == mFreeLists[level].end()) break;
+
+		mFreeLists[level].erase(found);
+		offset = std::min(offset, buddy);
+		level--;
+	}
+
+	mFreeLists[level].insert(offset);
+}
+
+uint64_t BuddyAllocator::GetLargestFreeBlock() const
+{
+	// Lower levels hold larger blocks
+	for (int level = 0; level < mNumLevels; ++level)
+	{
+		if (!mFreeLists[level].empty()) return BlockSizeForLevel(level);
+	}
+	return 0;
+}
+
+BuddyAllocator::BenchmarkResults BuddyAllocator::Benchmark(int allocationCount)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	BenchmarkResults results;
+
+	// Only offsets are handed out, so the range can be far larger than any real heap
+	const uint64_t maxSize = 4096;
+	BuddyAllocator allocator(allocationCount * maxSize, 256);
+
+	// Same sizes every run so results compare
+	std::mt19937 random(1);
+	std::uniform_int_distribution<uint64_t> sizes(1, maxSize);
+
+	std::vector<std::pair<uint64_t, uint64_t>> blocks;
+	blocks.reserve(allocationCount);
+
+	auto start = Clock::now();
+	for (int i = 0; i < allocationCount; ++i)
+	{
+		uint64_t size = sizes(random);
+		uint64_t offset = allocator.Allocate(size);
+		if (offset == INVALID_OFFSET) return results;
+		blocks.push_back({ offset, allocator.GetBlockSize(size) });
+	}
+	results.AllocateNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / allocationCount;
+
+	// Blocks must be aligned to their size and must not overlap
+	auto sorted = blocks;
+	std::sort(sorted.begin(), sorted.end());
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		if (sorted[i].first % sorted[i].second != 0) return results;
+		if (i + 1 < sorted.size() && sorted[i].first + sorted[i].second > sorted[i + 1].first) return results;
+	}
+
+	// Freeing every other block leaves holes that can't merge
+	start = Clock::now();
+	for (size_t i = 0; i < blocks.size(); i += 2) allocator.Free(blocks[i].first);
+	auto freeTime = Clock::now() - start;
+
+	uint64_t freeSize = allocator.GetSize() - allocator.GetUsedSize();
+	results.Fragmentation = freeSize > 0 ? 1.0 - (double)allocator.GetLargestFreeBlock() / freeSize : 0.0;
+
+	start = Clock::now();
+	for (size_t i = 1; i < blocks.size(); i += 2) allocator.Free(blocks[i].first);
+	freeTime += Clock::now() - start;
+	results.FreeNs = std::chrono::duration<double, std::nano>(freeTime).count() / allocationCount;
+
+	// With nothing allocated every buddy should have merged back into the whole range
+	results.Passed = allocator.GetUsedSize() == 0 && allocator.GetAllocationCount() == 0 && allocator.GetLargestFreeBlock() == allocator.GetSize();
+	return results;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <set>
+#include <unordered_map>
+
+// Buddy allocator handing out offsets into a range, has no graphics API dependency
+// Blocks are powers of two and aligned to their own size
+class BuddyAllocator
+{
+public:
+	static const uint64_t INVALID_OFFSET = UINT64_MAX;
+
+	// Size is rounded up to a power of two
+	BuddyAllocator(uint64_t size, uint64_t minBlockSize = 256);
+
+	// Returns INVALID_OFFSET if there is no free block large enough
+	uint64_t Allocate(uint64_t size, uint64_t alignment = 1);
+
+	// Free a block returned by Allocate and merge it with its buddies
+	void Free(uint64_t offset);
+
+	// Size of the block actually used for a request
+	uint64_t GetBlockSize(uint64_t size) const;
+
+	uint64_t GetSize() const { return mSize; }
+	uint64_t GetUsedSize() const { return mUsedSize; }
+	size_t GetAllocationCount() const { return mAllocations.size(); }
+
+	// Size of the largest block that could be allocated right now
+	uint64_t GetLargestFreeBlock() const;
+
+	// Runs the allocator on its own over random sizes and checks the blocks it hands out
+	struct BenchmarkResults
+	{
+		double AllocateNs = 0;		// Per allocation, including splits
+		double FreeNs = 0;			// Per free, including merges
+		double Fragmentation = 0;	// Free space outside the largest free block, with every other allocation freed
+		bool Passed = false;		// No overlapping or misaligned blocks, and everything merged back into one block
+	};
+	static BenchmarkResults Benchmark(int allocationCount = 100000);
+
+private:
+	uint64_t mSize = 0;
+	uint64_t mMinBlockSize = 0;
+	uint64_t mUsedSize = 0;
+	int mNumLevels = 0;
+
+	// Free block offsets per level, level 0 is the whole range
+	std::vector<std::set<uint64_t>> mFreeLists;
+
+	// Level of each allocated block
+	std::unordered_map<uint64_t, int> mAllocations;
+
+	int LevelForBlockSize(uint64_t blockSize) const;
+	uint64_t BlockSizeForLevel(int level) const { return mSize >> level; }
+};
@@ -40,6 +40,7 @@ void ChunkManager::Update(const XMFLOAT3& playerPosition)
                 TerrainChunk* chunk = CreateChunk(chunkPosition);
                 mSpawnedChunks.push_back(chunk);
                 Model* newModel = new Model("", mCommandList, chunk->mMesh);
+                newModel->AddToSceneIndex();
                 mSpawnedChunkModels.push_back(newModel);
             }
         }
@@ -58,7 +59,7 @@ void ChunkManager::Update(const XMFLOAT3& playerPosition)
     );
 }
 
-void ChunkManager::Draw(ID3D12GraphicsCommandList* commandList)
+void ChunkManager::Draw(ID3D12GraphicsCommandList* commandList, FrustumCuller* culler)
 {
     //// Get reference to current per object constant buffer
     //auto objectCB = FrameResources[CurrentFrameResourceIndex]->mPerObjectConstantBuffer->GetBuffer();
@@ -74,9 +75,20 @@ void ChunkManager::Draw(ID3D12GraphicsCommandList* commandList)
     //auto objCBAddress = objectCB->GetGPUVirtualAddress() + mObjConstBufferIndex * objCBByteSize;
     //commandList->SetGraphicsRootConstantBufferView(1, objCBAddress);
 
-    for (auto& chunk : mSpawnedChunkModels)
+    if (culler)
     {
-        chunk->Draw(commandList);
+        culler->Clear();
+        for (auto& chunk : mSpawnedChunkModels)
+        {
+            culler->Add(chunk->GetWorldBounds());
+        }
+        culler->Cull();
+    }
+
+    for (size_t i = 0; i < mSpawnedChunkModels.size(); ++i)
+    {
+        if (culler && !culler->IsVisible(i)) continue;
+        mSpawnedChunkModels[i]->Draw(commandList);
     }
 }
 
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include "TerrainTile.h"
 #include "Model.h"
+#include "FrustumCuller.h"
 
 class ChunkManager
 {
@@ -11,7 +12,8 @@ public:
     ~ChunkManager();
 
     void Update(const XMFLOAT3& playerPosition);
-    void Draw(ID3D12GraphicsCommandList* commandList);
+    // Chunks outside the culler's frustum are skipped, all are drawn without one
+    void Draw(ID3D12GraphicsCommandList* commandList, FrustumCuller* culler = nullptr);
     int mObjConstBufferIndex = 0;
     std::vector<Model*> mSpawnedChunkModels;
 
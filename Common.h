@@ -2,14 +2,42 @@
 
 #include "FrameResource.h"
 #include "SRVDescriptorHeap.h"
+#include "GPUBufferHeap.h"
+#include "UploadManager.h"
+#include "TextureIndex.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "SpatialIndex.h"
+#include "JobSystem.h"
+#include "ObjectTable.h"
 #include <vector>
 #include <memory>
 
+class ModelCache;
+
 const int MAX_PLANET_VERTS = 25000;
 
+// Materials have constant buffer slots reserved up front so models can stream in
+const int MAX_MATERIALS = 1024;
+
+// Instances of batched draws each frame to start with, frame resources grow as needed
+const int MAX_INSTANCES = 16384;
+
+// Objects with a transform in the frame resources' object buffers
+const int MAX_OBJECTS = 131072;
+
 extern std::vector<std::unique_ptr<FrameResource>> FrameResources;
 extern int CurrentFrameResourceIndex;
 extern unique_ptr<SRVDescriptorHeap> SrvDescriptorHeap;
+extern unique_ptr<GPUBufferHeap> BufferHeap;
+extern unique_ptr<UploadManager> Uploader;
+extern unique_ptr<ModelCache> ModelAssets;
+extern unique_ptr<TextureIndex> TextureFiles;
+extern unique_ptr<TextureCache> Textures;
+extern unique_ptr<TextureStreamer> Streamer;
+extern unique_ptr<SpatialIndex> SceneIndex;
+extern unique_ptr<JobSystem> Jobs;
+extern unique_ptr<ObjectTable> Objects;
 extern UINT CbvSrvUavDescriptorSize;
 extern ComPtr<ID3D12CommandQueue> CommandQueue;
 extern ComPtr<ID3D12Device> D3DDevice;
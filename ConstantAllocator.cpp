@@ -0,0 +1,95 @@
+#include "ConstantAllocator.h"
+#include <algorithm>
+
+ConstantAllocator::ConstantAllocator(ID3D12Device* device, UINT64 pageSize) : mDevice(device), mPageSize(pageSize)
+{
+	CreatePage(mPageSize);
+}
+
+ConstantAllocator::~ConstantAllocator()
+{
+	for (auto& page : mPages)
+	{
+		page.Resource->Unmap(0, nullptr);
+	}
+}
+
+ConstantAllocation ConstantAllocator::Allocate(UINT64 size)
+{
+	const UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+	size = (size + alignment - 1) & ~(alignment - 1);
+
+	std::lock_guard<std::mutex> lock(mLock);
+
+	// Move on to the next page that fits, adding one when every page is used
+	while (mCurrentPage < mPages.size() && mOffset + size > mPages[mCurrentPage].Size)
+	{
+		mCurrentPage++;
+		mOffset = 0;
+	}
+	if (mCurrentPage == mPages.size() && !CreatePage(std::max(mPageSize, size)))
+	{
+		return ConstantAllocation();
+	}
+
+	Page& page = mPages[mCurrentPage];
+	ConstantAllocation allocation;
+	allocation.CPUAddress = page.CPUAddress + mOffset;
+	allocation.GPUAddress = page.GPUAddress + mOffset;
+
+	mOffset += size;
+	mUsedBytes += size;
+	return allocation;
+}
+
+void ConstantAllocator::Reset()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	mCurrentPage = 0;
+	mOffset = 0;
+	mUsedBytes = 0;
+}
+
+UINT64 ConstantAllocator::GetUsedBytes() const
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	return mUsedBytes;
+}
+
+UINT64 ConstantAllocator::GetCapacity() const
+{
+	// Workers can add pages while the GUI reads this
+	std::lock_guard<std::mutex> lock(mLock);
+	UINT64 capacity = 0;
+	for (auto& page : mPages) capacity += page.Size;
+	return capacity;
+}
+
+bool ConstantAllocator::CreatePage(UINT64 size)
+{
+	Page page;
+	page.Size = size;
+
+	if (FAILED(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&page.Resource))))
+	{
+		MessageBox(0, L"Constant page creation failed", L"Error", MB_OK);
+		return false;
+	}
+
+	// Upload memory stays mapped for the life of the page
+	if (FAILED(page.Resource->Map(0, nullptr, reinterpret_cast<void**>(&page.CPUAddress))))
+	{
+		MessageBox(0, L"Constant page map failed", L"Error", MB_OK);
+		return false;
+	}
+
+	page.GPUAddress = page.Resource->GetGPUVirtualAddress();
+	mPages.push_back(page);
+	return true;
+}
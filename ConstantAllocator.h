@@ -0,0 +1,68 @@
+#pragma once
+
+#include "d3dx12.h"
+#include <wrl.h>
+#include <d3d12.h>
+#include <vector>
+#include <mutex>
+
+using Microsoft::WRL::ComPtr;
+
+// Constants written this frame and where the GPU reads them
+struct ConstantAllocation
+{
+	void* CPUAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS GPUAddress = 0;
+};
+
+// Hands out constant buffer memory for one frame resource from persistently mapped upload pages, by bumping an
+// offset. Pages are added when a frame needs more and kept for later frames; everything is reused once the frame
+// resource's fence has retired and Reset is called, so draws can allocate constants without reserving slots
+class ConstantAllocator
+{
+public:
+	ConstantAllocator(ID3D12Device* device, UINT64 pageSize = DEFAULT_PAGE_SIZE);
+	~ConstantAllocator();
+
+	// Room for size bytes, aligned for a constant buffer view. Safe to call from any thread
+	ConstantAllocation Allocate(UINT64 size);
+
+	// Copy constants in and return their GPU address, 0 if no page could be created
+	template<typename T>
+	D3D12_GPU_VIRTUAL_ADDRESS Allocate(const T& constants)
+	{
+		ConstantAllocation allocation = Allocate(sizeof(T));
+		if (!allocation.CPUAddress) return 0;
+		memcpy(allocation.CPUAddress, &constants, sizeof(T));
+		return allocation.GPUAddress;
+	}
+
+	// Start again from the first page, only once the GPU has finished with the frame
+	void Reset();
+
+	UINT64 GetUsedBytes() const;
+	UINT64 GetCapacity() const;
+
+	static const UINT64 DEFAULT_PAGE_SIZE = 64 * 1024;
+
+private:
+	struct Page
+	{
+		ComPtr<ID3D12Resource> Resource;
+		BYTE* CPUAddress = nullptr;
+		D3D12_GPU_VIRTUAL_ADDRESS GPUAddress = 0;
+		UINT64 Size = 0;
+	};
+
+	// A mapped page of at least size bytes
+	bool CreatePage(UINT64 size);
+
+	ID3D12Device* mDevice;
+	UINT64 mPageSize;
+
+	mutable std::mutex mLock;
+	std::vector<Page> mPages;
+	size_t mCurrentPage = 0;
+	UINT64 mOffset = 0;
+	UINT64 mUsedBytes = 0;
+};
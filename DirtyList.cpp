@@ -0,0 +1,36 @@
+#include "DirtyList.h"
+#include <algorithm>
+#include <cassert>
+
+DirtyList::DirtyList(int frameCount) : mFrameCount(frameCount), mFrameIDs(frameCount)
+{
+	assert(frameCount > 0 && frameCount <= 8);
+}
+
+void DirtyList::Mark(uint32_t id)
+{
+	if (id >= mQueued.size()) mQueued.resize(id + 1, 0);
+
+	// Frames it isn't already waiting in
+	uint8_t all = (uint8_t)((1u << mFrameCount) - 1);
+	uint8_t missing = all & ~mQueued[id];
+	if (!missing) return;
+
+	for (int frame = 0; frame < mFrameCount; ++frame)
+	{
+		if (missing & (1u << frame)) mFrameIDs[frame].push_back(id);
+	}
+	mQueued[id] = all;
+}
+
+const std::vector<uint32_t>& DirtyList::Take(int frame)
+{
+	mTaken.swap(mFrameIDs[frame]);
+	mFrameIDs[frame].clear();
+
+	uint8_t bit = (uint8_t)(1u << frame);
+	for (uint32_t id : mTaken) mQueued[id] &= ~bit;
+
+	std::sort(mTaken.begin(), mTaken.end());
+	return mTaken;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Ids of entries changed since each frame resource last copied them. An id marked any number of times is handed
+// out once to every frame resource, so entries that never change cost nothing however many there are
+class DirtyList
+{
+public:
+	// Up to 8 frame resources
+	DirtyList(int frameCount);
+
+	// The entry has changed and every frame's copy needs rewriting
+	void Mark(uint32_t id);
+
+	// Ids to write into this frame's copy, ascending so the writes stream through the buffer. Clears them
+	const std::vector<uint32_t>& Take(int frame);
+
+private:
+	int mFrameCount;
+
+	// Bit per frame an id is already waiting in
+	std::vector<uint8_t> mQueued;
+	std::vector<std::vector<uint32_t>> mFrameIDs;
+	std::vector<uint32_t> mTaken;
+};
@@ -0,0 +1,219 @@
+#include "DrawList.h"
+#include "Common.h"
+#include <algorithm>
+
+// Key layout from the most significant bit: pass, pipeline, geometry, depth
+const int KEY_DEPTH_BITS = 16;
+const int KEY_GEOMETRY_BITS = 24;
+const int KEY_PIPELINE_BITS = 4;
+
+const int KEY_GEOMETRY_SHIFT = KEY_DEPTH_BITS;
+const int KEY_PIPELINE_SHIFT = KEY_GEOMETRY_SHIFT + KEY_GEOMETRY_BITS;
+const int KEY_PASS_SHIFT = KEY_PIPELINE_SHIFT + KEY_PIPELINE_BITS;
+
+// Lists shorter than this sort faster on one thread than they take to share out
+const size_t PARALLEL_SORT_MIN = 16384;
+const unsigned int MAX_SORT_JOBS = 8;
+
+uint64_t DrawList::MakeKey(int pass, int pipeline, uint32_t geometry, uint32_t depth)
+{
+	return (uint64_t)pass << KEY_PASS_SHIFT
+		| (uint64_t)pipeline << KEY_PIPELINE_SHIFT
+		| (uint64_t)geometry << KEY_GEOMETRY_SHIFT
+		| depth;
+}
+
+uint32_t DrawList::GetGeometryID(const Mesh* mesh)
+{
+	const void* geometry = mesh->mSharedGeometry ? mesh->mSharedGeometry : mesh;
+	auto found = mGeometryIDs.find(geometry);
+	if (found != mGeometryIDs.end()) return found->second;
+
+	uint32_t id = (uint32_t)mGeometryIDs.size();
+	mGeometryIDs.emplace(geometry, id);
+	return id;
+}
+
+DrawList::Batch DrawList::MakeBatch(Mesh* mesh, int pipeline, UINT firstInstance)
+{
+	// Edited geometry is copied into this frame's buffers before its views are taken
+	if (mesh->mDynamicVertexBuffer) mesh->UpdateDynamicBuffers();
+
+	Batch batch;
+	batch.VertexBufferView = mesh->GetVertexBufferView();
+	batch.IndexBufferView = mesh->GetIndexBufferView();
+	batch.IndexCount = mesh->mSharedGeometry ? mesh->mSharedGeometry->mIndicesCount : mesh->mIndicesCount;
+	batch.Pipeline = pipeline;
+	batch.FirstInstance = firstInstance;
+	batch.InstanceCount = 0;
+	return batch;
+}
+
+UINT DrawList::Build(const std::vector<Model*>& models, FrameResource* frame, FXMMATRIX view, float farZ, FrustumCuller* culler)
+{
+	mItems.clear();
+	mBatches.clear();
+
+	// Ids of freed meshes are only dropped once the key bits run out
+	if (mGeometryIDs.size() >= (1u << KEY_GEOMETRY_BITS)) mGeometryIDs.clear();
+
+	for (auto& model : models)
+	{
+		// Models past MAX_OBJECTS have no transform to draw with
+		if (!model->IsReady() || model->mDrawList < 0 || model->GetObjectID() == UINT_MAX) continue;
+
+		if (model->mConstructorMesh)
+		{
+			mItems.push_back({ 0, model, model->mConstructorMesh });
+			continue;
+		}
+
+		for (auto& mesh : model->mMeshes)
+		{
+			mItems.push_back({ 0, model, mesh });
+		}
+	}
+
+	if (culler) culler->Clear();
+	for (auto& item : mItems)
+	{
+		// Each mesh's sphere in world space, for the culler and the depth
+		BoundingSphere sphere;
+		item.Mesh->GetBoundingSphere().Transform(sphere, XMLoadFloat4x4(&item.Model->mWorldMatrix));
+		if (culler) culler->Add(sphere);
+
+		// Front to back within a batch, quantized over the view distance
+		float z = XMVectorGetZ(XMVector3TransformCoord(XMLoadFloat3(&sphere.Center), view));
+		uint32_t depth = (uint32_t)(std::clamp(z / farZ, 0.0f, 1.0f) * ((1 << KEY_DEPTH_BITS) - 1));
+
+		item.Key = MakeKey(OpaquePass, item.Model->mDrawList, GetGeometryID(item.Mesh), depth);
+	}
+
+	if (culler)
+	{
+		culler->Cull();
+
+		size_t visible = 0;
+		for (size_t i = 0; i < mItems.size(); ++i)
+		{
+			if (culler->IsVisible(i)) mItems[visible++] = mItems[i];
+		}
+		mItems.resize(visible);
+	}
+
+	Sort();
+
+	InstanceConstants* instances = frame->ReserveInstances((UINT)mItems.size())->GetElements();
+	UINT next = 0;
+	for (auto& item : mItems)
+	{
+		// Everything above the depth bits matches, so the pipeline and geometry do too, whatever the materials
+		if (mBatches.empty() || (mItems[next - 1].Key >> KEY_GEOMETRY_SHIFT) != (item.Key >> KEY_GEOMETRY_SHIFT))
+		{
+			mBatches.push_back(MakeBatch(item.Mesh, item.Model->mDrawList, next));
+		}
+
+		// Transforms are already in the object buffer, instances only point at them
+		UINT materialIndex = item.Mesh->mMaterial ? item.Mesh->mMaterial->CBIndex : 0;
+		instances[next] = { item.Model->GetObjectID(), materialIndex };
+
+		mBatches.back().InstanceCount++;
+		next++;
+	}
+
+	return next;
+}
+
+void DrawList::Sort()
+{
+	size_t count = mItems.size();
+	if (count < 2) return;
+	mSortScratch.resize(count);
+
+	unsigned int jobCount = 1;
+	if (count >= PARALLEL_SORT_MIN) jobCount = std::min(Jobs->GetThreadCount(), MAX_SORT_JOBS);
+	size_t rangeSize = (count + jobCount - 1) / jobCount;
+	mHistograms.resize(jobCount);
+
+	// Each job handles the same range of the list in every step
+	auto runJobs = [&](auto&& work)
+	{
+		JobCounter counter;
+		for (unsigned int t = 1; t < jobCount; ++t)
+		{
+			Jobs->Run([&work, t, rangeSize, count]() { work(t, t * rangeSize, std::min(count, (t + 1) * rangeSize)); }, &counter);
+		}
+		work(0u, (size_t)0, std::min(count, rangeSize));
+		Jobs->Wait(counter);
+	};
+
+	Item* source = mItems.data();
+	Item* destination = mSortScratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		runJobs([&](unsigned int t, size_t begin, size_t end)
+		{
+			auto& histogram = mHistograms[t];
+			histogram.fill(0);
+			for (size_t i = begin; i < end; ++i) histogram[(source[i].Key >> shift) & 0xFF]++;
+		});
+
+		// Bytes every key shares, like the pass, need no pass of their own
+		size_t firstBucket = (source[0].Key >> shift) & 0xFF;
+		size_t inFirstBucket = 0;
+		for (auto& histogram : mHistograms) inFirstBucket += histogram[firstBucket];
+		if (inFirstBucket == count) continue;
+
+		// Turn counts into where each job writes each byte value, in list order so the sort is stable
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; ++bucket)
+		{
+			for (auto& histogram : mHistograms)
+			{
+				size_t bucketCount = histogram[bucket];
+				histogram[bucket] = offset;
+				offset += bucketCount;
+			}
+		}
+
+		runJobs([&](unsigned int t, size_t begin, size_t end)
+		{
+			auto& histogram = mHistograms[t];
+			for (size_t i = begin; i < end; ++i) destination[histogram[(source[i].Key >> shift) & 0xFF]++] = source[i];
+		});
+
+		std::swap(source, destination);
+	}
+
+	if (source != mItems.data()) mItems.swap(mSortScratch);
+}
+
+int DrawList::Draw(ID3D12GraphicsCommandList* commandList, const std::array<ID3D12PipelineState*, NumDrawPipelines>& pipelines,
+	size_t first, size_t last) const
+{
+	int stateChanges = 0;
+	last = std::min(last, mBatches.size());
+
+	ID3D12PipelineState* boundPipeline = nullptr;
+	for (size_t i = first; i < last; ++i)
+	{
+		auto& batch = mBatches[i];
+		auto pipeline = pipelines[batch.Pipeline];
+		if (pipeline != boundPipeline)
+		{
+			boundPipeline = pipeline;
+			commandList->SetPipelineState(pipeline);
+			stateChanges++;
+		}
+
+		// Instances give their material, which gives its textures, so the first instance is all a batch sets
+		commandList->SetGraphicsRoot32BitConstant(6, batch.FirstInstance, 0);
+		commandList->IASetVertexBuffers(0, 1, &batch.VertexBufferView);
+		commandList->IASetIndexBuffer(&batch.IndexBufferView);
+		commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		commandList->DrawIndexedInstanced(batch.IndexCount, batch.InstanceCount, 0, 0, 0);
+	}
+
+	return stateChanges;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Model.h"
+#include "UploadBuffer.h"
+#include "FrustumCuller.h"
+#include <d3d12.h>
+#include <vector>
+#include <array>
+#include <unordered_map>
+
+// Pipelines the draw list switches between, Model::mDrawList holds one of these
+enum DrawPipeline
+{
+	ColourPipeline,
+	TexPipeline,
+	SimpleTexPipeline,
+	NumDrawPipelines
+};
+
+// Every visible mesh of a frame as one list, ordered by a 64 bit key of pass, pipeline, geometry and depth. Keys
+// are radix sorted, across the job system for big lists, so meshes sharing a pipeline end up together and runs of
+// the same geometry become one instanced draw, even with different materials since shaders find textures by the
+// material's index into the SRV heap. Replaying the list only sets a pipeline when it differs from the last one.
+// Buffer views are taken from the meshes when the list is built, so it can be drawn on another thread while the
+// meshes are updated for the next frame
+class DrawList
+{
+public:
+	// Sort the visible meshes of these models, writing their instances into the frame's instance buffer, which grows to
+	// fit them. Returns the instance count. Without a culler every mesh is drawn
+	UINT Build(const std::vector<Model*>& models, FrameResource* frame, FXMMATRIX view, float farZ, FrustumCuller* culler = nullptr);
+
+	// Draw batches [first, last) with these pipelines, returns how many pipelines were set
+	// Instance and material buffers must already be set. Separate ranges can be recorded on separate threads
+	int Draw(ID3D12GraphicsCommandList* commandList, const std::array<ID3D12PipelineState*, NumDrawPipelines>& pipelines,
+		size_t first = 0, size_t last = SIZE_MAX) const;
+
+	size_t GetDrawCount() const { return mBatches.size(); }
+	size_t GetInstanceCount() const { return mItems.size(); }
+
+private:
+	// Only opaque geometry is drawn through the list so far
+	enum Pass { OpaquePass };
+
+	struct Item
+	{
+		uint64_t Key;
+		Model* Model;
+		Mesh* Mesh;
+	};
+
+	struct Batch
+	{
+		D3D12_VERTEX_BUFFER_VIEW VertexBufferView;
+		D3D12_INDEX_BUFFER_VIEW IndexBufferView;
+		UINT IndexCount;
+
+		int Pipeline;
+		UINT FirstInstance;
+		UINT InstanceCount;
+	};
+
+	static Batch MakeBatch(Mesh* mesh, int pipeline, UINT firstInstance);
+
+	static uint64_t MakeKey(int pass, int pipeline, uint32_t geometry, uint32_t depth);
+
+	// Small ids for the key, kept across frames
+	uint32_t GetGeometryID(const Mesh* mesh);
+
+	// Least significant byte first, skipping bytes every key shares
+	void Sort();
+
+	std::vector<Item> mItems;
+	std::vector<Item> mSortScratch;
+	std::vector<std::array<size_t, 256>> mHistograms;
+	std::vector<Batch> mBatches;
+
+	std::unordered_map<const void*, uint32_t> mGeometryIDs;
+};
@@ -0,0 +1,132 @@
+#include "DynamicBuffer.h"
+#include <algorithm>
+
+// Copies are placed at this alignment within the buffer
+const UINT64 DYNAMIC_COPY_ALIGNMENT = 256;
+
+static UINT64 AlignUp(UINT64 value, UINT64 alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+DynamicBuffer::DynamicBuffer(ID3D12Device* device, UINT64 capacity, UINT frameCount)
+	: mDevice(device), mFrameCount(frameCount), mDirtyRanges(frameCount)
+{
+	Create(capacity);
+}
+
+DynamicBuffer::~DynamicBuffer()
+{
+	if (mBuffer) { mBuffer->Unmap(0, nullptr); mData = nullptr; }
+}
+
+bool DynamicBuffer::Create(UINT64 capacity)
+{
+	capacity = AlignUp(std::max<UINT64>(capacity, 1), DYNAMIC_COPY_ALIGNMENT);
+
+	ComPtr<ID3D12Resource> buffer;
+	if (FAILED(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(capacity * mFrameCount),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(buffer.GetAddressOf()))))
+	{
+		MessageBox(0, L"Dynamic buffer creation failed", L"Error", MB_OK);
+		return false;
+	}
+
+	BYTE* data = nullptr;
+	if (FAILED(buffer->Map(0, nullptr, reinterpret_cast<void**>(&data))))
+	{
+		MessageBox(0, L"Dynamic buffer map failed", L"Error", MB_OK);
+		return false;
+	}
+
+	// Earlier frames may still be drawing from the old buffer
+	if (mBuffer)
+	{
+		mBuffer->Unmap(0, nullptr);
+		mRetiredBuffers.push_back({ mBuffer, mFrameCount });
+	}
+
+	mBuffer = buffer;
+	mData = data;
+	mCapacity = capacity;
+
+	// New copies hold nothing yet
+	MarkAllDirty();
+	return true;
+}
+
+void DynamicBuffer::MarkDirty(UINT64 offset, UINT64 size)
+{
+	if (size == 0) return;
+
+	for (auto& ranges : mDirtyRanges)
+	{
+		ranges.push_back({ offset, offset + size });
+	}
+}
+
+void DynamicBuffer::MarkAllDirty()
+{
+	for (auto& ranges : mDirtyRanges)
+	{
+		ranges.clear();
+		ranges.push_back({ 0, UINT64_MAX });
+	}
+}
+
+bool DynamicBuffer::Update(UINT frameIndex, const void* source, UINT64 sourceSize)
+{
+	mLastUpdateSize = 0;
+
+	// Each update is one frame later, so retired buffers age out after a full cycle
+	for (auto& retired : mRetiredBuffers) retired.second--;
+	mRetiredBuffers.erase(std::remove_if(mRetiredBuffers.begin(), mRetiredBuffers.end(),
+		[](const std::pair<ComPtr<ID3D12Resource>, UINT>& retired) { return retired.second == 0; }),
+		mRetiredBuffers.end());
+
+	if (sourceSize > mCapacity)
+	{
+		// Grow with headroom so slowly growing geometry does not resize every frame
+		if (!Create(std::max(sourceSize, mCapacity * 2))) return false;
+	}
+
+	auto& ranges = mDirtyRanges[frameIndex];
+	if (ranges.empty()) return true;
+
+	// Merge overlapping and touching ranges so each byte is copied once
+	std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.Begin < b.Begin; });
+
+	BYTE* destination = mData + mCapacity * frameIndex;
+	const BYTE* sourceBytes = static_cast<const BYTE*>(source);
+
+	size_t i = 0;
+	while (i < ranges.size())
+	{
+		UINT64 begin = ranges[i].Begin;
+		UINT64 end = ranges[i].End;
+		for (i++; i < ranges.size() && ranges[i].Begin <= end; i++)
+		{
+			end = std::max(end, ranges[i].End);
+		}
+
+		end = std::min(end, sourceSize);
+		if (begin < end)
+		{
+			memcpy(destination + begin, sourceBytes + begin, end - begin);
+			mLastUpdateSize += end - begin;
+		}
+	}
+
+	ranges.clear();
+	return true;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS DynamicBuffer::GetGPUAddress(UINT frameIndex) const
+{
+	return mBuffer ? mBuffer->GetGPUVirtualAddress() + mCapacity * frameIndex : 0;
+}
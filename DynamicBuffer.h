@@ -0,0 +1,57 @@
+#pragma once
+#include "d3dx12.h"
+
+#include <windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+#include <vector>
+
+using Microsoft::WRL::ComPtr;
+
+// Upload heap buffer for geometry that changes while it is being drawn
+// Holds one copy per frame resource so the CPU never writes a copy the GPU may still be reading,
+// and only copies the byte ranges that changed since each copy was last written
+class DynamicBuffer
+{
+public:
+	DynamicBuffer(ID3D12Device* device, UINT64 capacity, UINT frameCount);
+	~DynamicBuffer();
+
+	// Mark a byte range of the source data as changed, every frame copy will pick it up
+	void MarkDirty(UINT64 offset, UINT64 size);
+	void MarkAllDirty();
+
+	// Bring this frame's copy up to date with the source, returns false if the buffer could not grow
+	bool Update(UINT frameIndex, const void* source, UINT64 sourceSize);
+
+	D3D12_GPU_VIRTUAL_ADDRESS GetGPUAddress(UINT frameIndex) const;
+	UINT64 GetCapacity() const { return mCapacity; }
+
+	// Bytes written by the last update, for checking how much is actually being copied
+	UINT64 GetLastUpdateSize() const { return mLastUpdateSize; }
+
+private:
+	struct Range
+	{
+		UINT64 Begin;
+		UINT64 End;
+	};
+
+	// Create and map a buffer large enough for every frame copy
+	bool Create(UINT64 capacity);
+
+	ID3D12Device* mDevice = nullptr;
+	UINT mFrameCount = 0;
+	UINT64 mCapacity = 0;
+
+	ComPtr<ID3D12Resource> mBuffer;
+	BYTE* mData = nullptr;
+
+	// Buffers replaced by a resize, with the number of updates left before no frame can be using them
+	std::vector<std::pair<ComPtr<ID3D12Resource>, UINT>> mRetiredBuffers;
+
+	// Ranges each frame copy has not received yet
+	std::vector<std::vector<Range>> mDirtyRanges;
+
+	UINT64 mLastUpdateSize = 0;
+};
@@ -1,9 +1,24 @@
 #include "FrameResource.h"
+#include <algorithm>
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT materialCount, UINT instanceCount, UINT objectCount)
 {
+	mDevice = device;
 	device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(mCommandAllocator.GetAddressOf()));
 	mPerFrameConstantBuffer = std::make_unique<UploadBuffer<PerFrameConstants>>(device, passCount, true);
-	mPerObjectConstantBuffer = std::make_unique<UploadBuffer<PerObjectConstants>>(device, objectCount, true);
-	mPerMaterialConstantBuffer = std::make_unique<UploadBuffer<PerMaterialConstants>>(device, materialCount, true);
+	mPerMaterialConstantBuffer = std::make_unique<UploadBuffer<PerMaterialConstants>>(device, materialCount, false);
+	mInstanceBuffer = std::make_unique<UploadBuffer<InstanceConstants>>(device, instanceCount, false);
+	mObjectBuffer = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, false);
+	mConstants = std::make_unique<ConstantAllocator>(device);
+}
+
+UploadBuffer<InstanceConstants>* FrameResource::ReserveInstances(UINT count)
+{
+	UINT capacity = mInstanceBuffer->GetElementCount();
+	if (count > capacity)
+	{
+		// Grow with headroom so a slowly growing scene does not reallocate every frame
+		mInstanceBuffer = std::make_unique<UploadBuffer<InstanceConstants>>(mDevice, std::max(count, capacity * 2), false);
+	}
+	return mInstanceBuffer.get();
 }
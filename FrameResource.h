@@ -3,6 +3,7 @@
 
 #include "d3dx12.h"
 #include "UploadBuffer.h"
+#include "ConstantAllocator.h"
 #include <d3d12.h>
 #include <memory>
 
@@ -10,15 +11,28 @@
 class FrameResource
 {
 public:
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT materialCount, UINT instanceCount, UINT objectCount);
 
 	ComPtr<ID3D12CommandAllocator> mCommandAllocator;
 
-    std::unique_ptr <UploadBuffer<PerObjectConstants>> mPerObjectConstantBuffer;
     std::unique_ptr <UploadBuffer<PerFrameConstants>> mPerFrameConstantBuffer;
+    // Every material by index, read by shaders as a structured buffer
     std::unique_ptr <UploadBuffer<PerMaterialConstants>> mPerMaterialConstantBuffer;
 
+    // Object and material indices of batched draws
+    std::unique_ptr <UploadBuffer<InstanceConstants>> mInstanceBuffer;
+
+    // Instance buffer with room for count instances, replaced by a larger one when it is too small
+    // Only called while the GPU is done with this frame resource
+    UploadBuffer<InstanceConstants>* ReserveInstances(UINT count);
+
+    // Transforms by object id, only rewritten for objects that have moved since this frame was last used
+    std::unique_ptr <UploadBuffer<ObjectConstants>> mObjectBuffer;
+
+    // Constants allocated by draws as they are recorded, reset when the frame is reused
+    std::unique_ptr<ConstantAllocator> mConstants;
+
     UINT64 Fence = 0;
 private:
-
+    ID3D12Device* mDevice;
 };
\ No newline at end of file
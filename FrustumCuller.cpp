@@ -0,0 +1,101 @@
+#include "FrustumCuller.h"
+#include <cmath>
+#include "Common.h"
+
+// Spheres per job when culling across the job system
+const size_t CULL_JOB_SIZE = 4096;
+
+using namespace DirectX;
+
+void FrustumCuller::SetViewProjection(FXMMATRIX view, CXMMATRIX projection)
+{
+	// With row vectors each plane is a sum of columns of the view projection matrix
+	XMMATRIX columns = XMMatrixTranspose(XMMatrixMultiply(view, projection));
+	XMVECTOR planes[PLANE_COUNT] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]),		// Left
+		XMVectorSubtract(columns.r[3], columns.r[0]),	// Right
+		XMVectorAdd(columns.r[3], columns.r[1]),		// Bottom
+		XMVectorSubtract(columns.r[3], columns.r[1]),	// Top
+		columns.r[2],									// Near, depth starts at 0
+		XMVectorSubtract(columns.r[3], columns.r[2]),	// Far
+	};
+
+	for (int i = 0; i < PLANE_COUNT; ++i)
+	{
+		XMVECTOR plane = XMPlaneNormalize(planes[i]);
+		mPlaneX[i] = XMVectorSplatX(plane);
+		mPlaneY[i] = XMVectorSplatY(plane);
+		mPlaneZ[i] = XMVectorSplatZ(plane);
+		mPlaneW[i] = XMVectorSplatW(plane);
+	}
+
+	mVisibleCount = 0;
+	mCulledCount = 0;
+}
+
+void FrustumCuller::Clear()
+{
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mRadius.clear();
+	mCount = 0;
+}
+
+size_t FrustumCuller::Add(const BoundingSphere& sphere)
+{
+	mCenterX.push_back(sphere.Center.x);
+	mCenterY.push_back(sphere.Center.y);
+	mCenterZ.push_back(sphere.Center.z);
+	mRadius.push_back(sphere.Radius);
+	return mCount++;
+}
+
+void FrustumCuller::Cull()
+{
+	// Fill the last group of four, an infinite radius is inside every plane
+	while (mCenterX.size() % 4 != 0)
+	{
+		mCenterX.push_back(0.0f);
+		mCenterY.push_back(0.0f);
+		mCenterZ.push_back(0.0f);
+		mRadius.push_back(INFINITY);
+	}
+	mVisible.resize(mCenterX.size());
+
+	// Groups of four are independent, so large lists are split across the job system
+	Jobs->ParallelFor(mCenterX.size() / 4, CULL_JOB_SIZE / 4, [this](size_t firstGroup, size_t lastGroup)
+	{
+		for (size_t i = firstGroup * 4; i < lastGroup * 4; i += 4)
+		{
+			XMVECTOR x = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterX[i]));
+			XMVECTOR y = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterY[i]));
+			XMVECTOR z = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterZ[i]));
+			XMVECTOR negativeRadius = XMVectorNegate(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mRadius[i])));
+
+			// Visible unless the sphere is entirely behind one of the planes
+			XMVECTOR inside = XMVectorTrueInt();
+			for (int plane = 0; plane < PLANE_COUNT; ++plane)
+			{
+				XMVECTOR distance = XMVectorMultiplyAdd(mPlaneX[plane], x,
+					XMVectorMultiplyAdd(mPlaneY[plane], y,
+					XMVectorMultiplyAdd(mPlaneZ[plane], z, mPlaneW[plane])));
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(distance, negativeRadius));
+			}
+
+			XMUINT4 result;
+			XMStoreUInt4(&result, inside);
+			mVisible[i + 0] = result.x != 0;
+			mVisible[i + 1] = result.y != 0;
+			mVisible[i + 2] = result.z != 0;
+			mVisible[i + 3] = result.w != 0;
+		}
+	});
+
+	for (size_t i = 0; i < mCount; ++i)
+	{
+		if (mVisible[i]) mVisibleCount++;
+		else mCulledCount++;
+	}
+}
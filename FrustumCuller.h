@@ -0,0 +1,50 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include <cstdint>
+
+// Tests bounding spheres against the view frustum four at a time. Spheres are kept as separate arrays of
+// centre x, y, z and radius so each SIMD lane holds one sphere and a plane test is three multiply-adds
+// Add every sphere for a pass, Cull once, then read the results by index
+class FrustumCuller
+{
+public:
+	// Planes from this frame's view and projection, also resets the frame's counts
+	void SetViewProjection(DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection);
+
+	// Start a new set of spheres
+	void Clear();
+
+	// World space sphere, returns its index
+	size_t Add(const DirectX::BoundingSphere& sphere);
+
+	// Test every sphere added since the last Clear
+	void Cull();
+
+	bool IsVisible(size_t index) const { return mVisible[index] != 0; }
+
+	// Totals for every pass since SetViewProjection
+	size_t GetVisibleCount() const { return mVisibleCount; }
+	size_t GetCulledCount() const { return mCulledCount; }
+
+private:
+	// Each plane component broadcast across a vector, normals point into the frustum
+	static const int PLANE_COUNT = 6;
+	DirectX::XMVECTOR mPlaneX[PLANE_COUNT];
+	DirectX::XMVECTOR mPlaneY[PLANE_COUNT];
+	DirectX::XMVECTOR mPlaneZ[PLANE_COUNT];
+	DirectX::XMVECTOR mPlaneW[PLANE_COUNT];
+
+	// Padded to a multiple of four with spheres that are always visible
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mRadius;
+	std::vector<uint8_t> mVisible;
+	size_t mCount = 0;
+
+	size_t mVisibleCount = 0;
+	size_t mCulledCount = 0;
+};
@@ -0,0 +1,138 @@
+#include "GPUBufferHeap.h"
+#include <algorithm>
+
+// Smallest range handed out, keeps offsets aligned for any index or vertex format
+const UINT64 MIN_BUFFER_ALLOCATION = 256;
+
+GPUBufferHeap::GPUBufferHeap(ID3D12Device* device, UINT64 blockSize) : mDevice(device), mBlockSize(blockSize)
+{
+	CreateBlock(mBlockSize);
+}
+
+GPUBufferHeap::~GPUBufferHeap()
+{
+}
+
+bool GPUBufferHeap::CreateBlock(UINT64 size)
+{
+	Block block;
+	block.Allocator = std::make_unique<BuddyAllocator>(size, MIN_BUFFER_ALLOCATION);
+
+	if (FAILED(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(block.Allocator->GetSize()),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(block.Resource.GetAddressOf()))))
+	{
+		MessageBox(0, L"Buffer heap block creation failed", L"Error", MB_OK);
+		return false;
+	}
+
+	mBlocks.push_back(std::move(block));
+	return true;
+}
+
+GPUBufferAllocation GPUBufferHeap::Allocate(UINT64 size)
+{
+	GPUBufferAllocation allocation;
+
+	// Try existing blocks first, then add one large enough for the request
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		for (int i = 0; i < (int)mBlocks.size(); i++)
+		{
+			UINT64 offset = mBlocks[i].Allocator->Allocate(size);
+			if (offset != BuddyAllocator::INVALID_OFFSET)
+			{
+				allocation.Resource = mBlocks[i].Resource.Get();
+				allocation.Offset = offset;
+				allocation.Size = size;
+				allocation.Block = i;
+				return allocation;
+			}
+		}
+
+		if (!CreateBlock(std::max(mBlockSize, size))) break;
+	}
+
+	return allocation;
+}
+
+void GPUBufferHeap::CopyToAllocation(ID3D12GraphicsCommandList* commandList, const GPUBufferAllocation& allocation, ID3D12Resource* source, UINT64 sourceOffset)
+{
+	// Blocks stay readable as vertex and index data, and move to copy dest once per submit however many copies
+	// land in them. Copies never overlap, a freed range is only reused after the GPU is done with it
+	auto& block = mBlocks[allocation.Block];
+	if (block.State != D3D12_RESOURCE_STATE_COPY_DEST)
+	{
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(allocation.Resource,
+			block.State, D3D12_RESOURCE_STATE_COPY_DEST));
+		block.State = D3D12_RESOURCE_STATE_COPY_DEST;
+	}
+
+	commandList->CopyBufferRegion(allocation.Resource, allocation.Offset, source, sourceOffset, allocation.Size);
+}
+
+void GPUBufferHeap::FinishCopies(ID3D12GraphicsCommandList* commandList)
+{
+	// One batch for every block written to
+	std::vector<D3D12_RESOURCE_BARRIER> barriers;
+	for (auto& block : mBlocks)
+	{
+		if (block.State != D3D12_RESOURCE_STATE_COPY_DEST) continue;
+
+		barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(block.Resource.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+		block.State = D3D12_RESOURCE_STATE_GENERIC_READ;
+	}
+
+	if (!barriers.empty()) commandList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+}
+
+void GPUBufferHeap::Free(GPUBufferAllocation& allocation)
+{
+	if (!allocation.IsValid()) return;
+
+	// The GPU may still be reading the range, so wait for the next fence
+	mPendingFrees.push_back({ allocation, 0 });
+	allocation = GPUBufferAllocation();
+}
+
+void GPUBufferHeap::FenceFrees(UINT64 fenceValue)
+{
+	for (auto& pending : mPendingFrees)
+	{
+		if (pending.second == 0) pending.second = fenceValue;
+	}
+}
+
+void GPUBufferHeap::ReleaseCompletedFrees(UINT64 completedFenceValue)
+{
+	auto completed = std::partition(mPendingFrees.begin(), mPendingFrees.end(),
+		[completedFenceValue](const std::pair<GPUBufferAllocation, UINT64>& pending)
+		{
+			return pending.second == 0 || pending.second > completedFenceValue;
+		});
+
+	for (auto pending = completed; pending != mPendingFrees.end(); pending++)
+	{
+		mBlocks[pending->first.Block].Allocator->Free(pending->first.Offset);
+	}
+	mPendingFrees.erase(completed, mPendingFrees.end());
+}
+
+UINT64 GPUBufferHeap::GetUsedSize() const
+{
+	UINT64 used = 0;
+	for (auto& block : mBlocks) used += block.Allocator->GetUsedSize();
+	return used;
+}
+
+UINT64 GPUBufferHeap::GetReservedSize() const
+{
+	UINT64 reserved = 0;
+	for (auto& block : mBlocks) reserved += block.Allocator->GetSize();
+	return reserved;
+}
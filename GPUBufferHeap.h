@@ -0,0 +1,75 @@
+#pragma once
+#include "d3dx12.h"
+
+#include <windows.h>
+#include <d3d12.h>
+#include <wrl.h>
+#include <vector>
+#include <memory>
+#include "BuddyAllocator.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Size of each large buffer that meshes are placed into
+const UINT64 DEFAULT_BUFFER_BLOCK_SIZE = 64 * 1024 * 1024;
+
+// Range of a block buffer owned by one vertex or index buffer
+struct GPUBufferAllocation
+{
+	ID3D12Resource* Resource = nullptr;
+	UINT64 Offset = 0;
+	UINT64 Size = 0;
+	int Block = -1;
+
+	bool IsValid() const { return Resource != nullptr; }
+	// 0 when not allocated, which binds an empty view
+	D3D12_GPU_VIRTUAL_ADDRESS GetGPUAddress() const { return Resource ? Resource->GetGPUVirtualAddress() + Offset : 0; }
+};
+
+// Sub-allocates vertex and index buffers out of a few large default heap buffers
+class GPUBufferHeap
+{
+public:
+	GPUBufferHeap(ID3D12Device* device, UINT64 blockSize = DEFAULT_BUFFER_BLOCK_SIZE);
+	~GPUBufferHeap();
+
+	// Reserve a range, adding a new block if none have space
+	GPUBufferAllocation Allocate(UINT64 size);
+
+	// Record a copy from an upload resource into an allocation. Its block stays a copy dest until FinishCopies
+	void CopyToAllocation(ID3D12GraphicsCommandList* commandList, const GPUBufferAllocation& allocation, ID3D12Resource* source, UINT64 sourceOffset);
+
+	// Make blocks copied into since the last call readable again, recorded once before the command list is closed
+	void FinishCopies(ID3D12GraphicsCommandList* commandList);
+
+	// Return a range once the GPU has stopped using it
+	void Free(GPUBufferAllocation& allocation);
+
+	// Mark frees requested so far as safe when the GPU reaches this fence value
+	void FenceFrees(UINT64 fenceValue);
+
+	// Return ranges whose fence has completed to the allocators
+	void ReleaseCompletedFrees(UINT64 completedFenceValue);
+
+	// Memory stats
+	UINT64 GetUsedSize() const;
+	UINT64 GetReservedSize() const;
+	int GetBlockCount() const { return (int)mBlocks.size(); }
+
+private:
+	struct Block
+	{
+		ComPtr<ID3D12Resource> Resource;
+		std::unique_ptr<BuddyAllocator> Allocator;
+		D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+	};
+
+	bool CreateBlock(UINT64 size);
+
+	ID3D12Device* mDevice = nullptr;
+	UINT64 mBlockSize = 0;
+	std::vector<Block> mBlocks;
+
+	// Frees waiting on a fence value (0 until submitted)
+	std::vector<std::pair<GPUBufferAllocation, UINT64>> mPendingFrees;
+};
@@ -80,6 +80,7 @@ void GUI::Update(int numModels)
 	}
 
 	if (ImGui::Checkbox("VSync", &mVSync));
+	if (ImGui::Checkbox("Pipelined frames", &mPipelinedFrames));
 
 	if (ImGui::Checkbox("Orbit Camera", &mCameraOrbit));
 	if(!mCameraOrbit) if (ImGui::Checkbox("Invert Y", &mInvertY));
@@ -95,6 +96,34 @@ void GUI::Update(int numModels)
 	if (ImGui::SliderFloat3("Light Dir", mLightDir, -1, +1));
 
 	ImGui::Text("Average: %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+	ImGui::Text("Meshes: %d visible, %d culled", mVisibleMeshes, mCulledMeshes);
+	ImGui::Text("Draws: %d, %d state changes", mDrawCalls, mStateChanges);
+	ImGui::Text("Object transforms written: %d", mObjectsWritten);
+	ImGui::Text("Model ACMR: %.2f -> %.2f, %.1f KB saved", mModelOptimizerStats.ACMRBefore, mModelOptimizerStats.ACMRAfter,
+		((int64_t)mModelOptimizerStats.BytesBefore - mModelOptimizerStats.BytesAfter) / 1024.0);
+	ImGui::Text("Scene ACMR: %.2f -> %.2f, %.1f KB saved", mSceneOptimizerStats.ACMRBefore, mSceneOptimizerStats.ACMRAfter,
+		((int64_t)mSceneOptimizerStats.BytesBefore - mSceneOptimizerStats.BytesAfter) / 1024.0);
+
+	if (ImGui::Button("Benchmark jobs"))
+	{
+		mJobBenchmark = Jobs->Benchmark();
+		mJobBenchmarkRun = true;
+	}
+	if (mJobBenchmarkRun)
+	{
+		ImGui::Text("Jobs: %.0f ns run + wait, %.0f ns per range, %.0f ns dependent", mJobBenchmark.RunAndWaitNs, mJobBenchmark.ParallelForNs, mJobBenchmark.DependencyNs);
+	}
+
+	if (ImGui::Button("Benchmark buddy allocator"))
+	{
+		mBuddyBenchmark = BuddyAllocator::Benchmark();
+		mBuddyBenchmarkRun = true;
+	}
+	if (mBuddyBenchmarkRun)
+	{
+		ImGui::Text("Buddy: %.0f ns allocate, %.0f ns free, %.0f%% fragmented, %s", mBuddyBenchmark.AllocateNs, mBuddyBenchmark.FreeNs,
+			mBuddyBenchmark.Fragmentation * 100.0, mBuddyBenchmark.Passed ? "passed" : "FAILED");
+	}
 
 	mInPosition.x = mPos[0];
 	mInPosition.y = mPos[1];
@@ -123,6 +152,12 @@ void GUI::UpdateModelData(Model* model)
 	mRot[2] = model->mRotation.z;
 
 	mScale = model->mScale.x;
+
+	mModelOptimizerStats = MeshOptimizerStats();
+	for (auto mesh : model->mMeshes)
+	{
+		mModelOptimizerStats.Add(mesh->GetOptimizerStats());
+	}
 }
 
 void GUI::Render(ID3D12GraphicsCommandList* commandList, ID3D12Resource* currentBackBuffer, D3D12_CPU_DESCRIPTOR_HANDLE currentBackBufferView, ID3D12DescriptorHeap* dsvHeap, UINT dsvDescriptorSize)
@@ -36,6 +36,7 @@ public:
 	bool mCameraOrbit = true;
 	bool mInvertY = true;
 	bool mVSync = false;
+	bool mPipelinedFrames = true;
 	float mLightDir[3] = { -0.577f, -0.577f, 0.577f };
 
 	XMFLOAT3 mInPosition{0,0,0};
@@ -46,6 +47,23 @@ public:
 	bool mWMatrixChanged = false;
 	int mSelectedModel = 0;
 	bool mPlanetUpdated = false;
+	int mVisibleMeshes = 0;
+	int mCulledMeshes = 0;
+	int mDrawCalls = 0;
+	int mStateChanges = 0;
+	int mObjectsWritten = 0;
+
+	// Mesh optimizer results for the selected model, and for every mesh uploaded so far
+	MeshOptimizerStats mModelOptimizerStats;
+	MeshOptimizerStats mSceneOptimizerStats;
+
+	// Job system scheduling overhead, measured on request
+	JobSystem::BenchmarkResults mJobBenchmark;
+	bool mJobBenchmarkRun = false;
+
+	// Buddy allocator speed and correctness, run on request
+	BuddyAllocator::BenchmarkResults mBuddyBenchmark;
+	bool mBuddyBenchmarkRun = false;
 
 };
 
@@ -10,8 +10,9 @@ ComPtr<ID3D12Device> D3DDevice;
 
 Graphics::Graphics(HWND hWND, int width, int height)
 {
+	if (!CreateDeviceAndFence()) throw std::runtime_error("Error creating device");
+
 	// Break on D3D12 errors
-	CreateDeviceAndFence();
 
 #if defined(DEBUG) || defined(_DEBUG) 
 	ID3D12InfoQueue* infoQueue = nullptr;
@@ -31,6 +32,12 @@ Graphics::Graphics(HWND hWND, int width, int height)
 	// Create SRV heap
 	SrvDescriptorHeap = make_unique<SRVDescriptorHeap>(D3DDevice.Get(), CbvSrvUavDescriptorSize);
 
+	// Create heap that vertex and index buffers are placed in
+	BufferHeap = make_unique<GPUBufferHeap>(D3DDevice.Get());
+
+	// Create upload manager that all CPU to GPU copies go through
+	Uploader = make_unique<UploadManager>(D3DDevice.Get(), CommandQueue.Get());
+
 	// Initially resize
 	Resize(width, height);
 
@@ -181,6 +188,22 @@ void Graphics::CloseAndExecuteCommandList(int thread, int list)
 	CommandQueue->ExecuteCommandLists(1, commandLists);
 }
 
+void Graphics::CloseCommandList(int thread, int list)
+{
+	HRESULT hr = mCommandLists[thread][list]->Close();
+	if (FAILED(hr))  throw std::runtime_error("Error closing command list");
+}
+
+void Graphics::ExecuteCommandLists(const std::vector<std::pair<int, int>>& lists)
+{
+	std::vector<ID3D12CommandList*> commandLists;
+	for (auto& [thread, list] : lists)
+	{
+		commandLists.push_back(mCommandLists[thread][list].Get());
+	}
+	CommandQueue->ExecuteCommandLists((UINT)commandLists.size(), commandLists.data());
+}
+
 bool Graphics::CreateDeviceAndFence()
 {
 
@@ -230,31 +253,44 @@ bool Graphics::CreateDeviceAndFence()
 	D3DDevice->CheckFeatureSupport(D3D12_FEATURE_MULTISAMPLE_QUALITY_LEVELS, &msQualityLevels, sizeof(msQualityLevels));
 	mMSAAQuality = msQualityLevels.NumQualityLevels;
 
+	// The bindless texture table uses unbounded ranges, which tier 1 hardware can't bind
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	if (FAILED(D3DDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) ||
+		options.ResourceBindingTier < D3D12_RESOURCE_BINDING_TIER_2)
+	{
+		MessageBox(0, L"Resource binding tier 2 or higher is required for the bindless texture table", L"Error", MB_OK);
+		return false;
+	}
+
 	return true;
 }
 
 void Graphics::CreateRootSignature()
 {
-	// Mesh Textures
-	CD3DX12_DESCRIPTOR_RANGE texTable;
-	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV,7,0,0); // register t0
+	// Every texture in the heap, as 2D textures and as arrays, shaders index them from the material
+	CD3DX12_DESCRIPTOR_RANGE texTable[2];
+	texTable[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 3, 0); // register t0 space 3
+	texTable[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 4, 0); // register t0 space 4
 
 	// Cube map
 	CD3DX12_DESCRIPTOR_RANGE texTable1;
 	texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV,6,0,1); // register t0 space 1
 
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[5];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[8];
 
-	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[0].InitAsDescriptorTable(2, texTable, D3D12_SHADER_VISIBILITY_PIXEL);
 	slotRootParameter[1].InitAsConstantBufferView(0); // Frame
 	slotRootParameter[2].InitAsConstantBufferView(1); // Obj
-	slotRootParameter[3].InitAsConstantBufferView(2); // Mat
-	slotRootParameter[4].InitAsDescriptorTable(1, &texTable1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[3].InitAsDescriptorTable(1, &texTable1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[4].InitAsShaderResourceView(0, 2); // Instances
+	slotRootParameter[5].InitAsShaderResourceView(1, 2); // Materials, read as a structured buffer
+	slotRootParameter[6].InitAsConstants(2, 3); // First instance of a batch, or material of a single draw
+	slotRootParameter[7].InitAsShaderResourceView(2, 2); // Object transforms, indexed by the instances
 
 	auto staticSamplers = GetStaticSamplers();
 
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter, (UINT)staticSamplers.size(), staticSamplers.data(),
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(8, slotRootParameter, (UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 	ComPtr<ID3DBlob> serializedRootSignature = nullptr;
@@ -289,14 +325,14 @@ void Graphics::CreatePSO()
 	psoDesc.VS =
 	{
 		// Set vertex shader
-		reinterpret_cast<BYTE*>(mColourVSByteCode->GetBufferPointer()),
-		mColourVSByteCode->GetBufferSize()
+		reinterpret_cast<BYTE*>(mInstancedColourVSByteCode->GetBufferPointer()),
+		mInstancedColourVSByteCode->GetBufferSize()
 	};
 	psoDesc.PS =
 	{
 		// Set pixel shader
-		reinterpret_cast<BYTE*>(mColourPSByteCode->GetBufferPointer()),
-		mColourPSByteCode->GetBufferSize()
+		reinterpret_cast<BYTE*>(mInstancedColourPSByteCode->GetBufferPointer()),
+		mInstancedColourPSByteCode->GetBufferSize()
 	};
 
 	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
@@ -321,6 +357,24 @@ void Graphics::CreatePSO()
 	// Set fillmode to wireframe
 	psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
 
+	// Create instanced Wireframe PSO for models
+	if (FAILED(D3DDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&mInstancedWireframePSO))))
+	{
+		MessageBox(0, L"Instanced Wireframe Pipeline State Creation failed", L"Error", MB_OK);
+	}
+
+	// Set per object colour shaders
+	psoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mColourVSByteCode->GetBufferPointer()),
+		mColourVSByteCode->GetBufferSize()
+	};
+	psoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mColourPSByteCode->GetBufferPointer()),
+		mColourPSByteCode->GetBufferSize()
+	};
+
 	// Create Wireframe PSO
 	if (FAILED(D3DDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&mWireframePSO))))
 	{
@@ -456,17 +510,22 @@ void Graphics::CreateShaders()
 		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 48, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 	};
 
-	// Compile colour shaders
+	// Model shaders read their transforms and materials per instance
+	const D3D_SHADER_MACRO instanced[] = { { "INSTANCED", "1" }, { nullptr, nullptr } };
+
+	// Compile colour shaders, per object for the terrain and water and instanced for models
 	mColourVSByteCode = CompileShader(L"Shaders\\shader.hlsl", nullptr, "VS", "vs_5_1");
 	mColourPSByteCode = CompileShader(L"Shaders\\shader.hlsl", nullptr, "PS", "ps_5_1");
+	mInstancedColourVSByteCode = CompileShader(L"Shaders\\shader.hlsl", instanced, "VS", "vs_5_1");
+	mInstancedColourPSByteCode = CompileShader(L"Shaders\\shader.hlsl", instanced, "PS", "ps_5_1");
 
 	// Compile PBR shaders
-	mTexVSByteCode = CompileShader(L"Shaders\\texshader.hlsl", nullptr, "VS", "vs_5_1");
-	mTexPSByteCode = CompileShader(L"Shaders\\texshader.hlsl", nullptr, "PS", "ps_5_1");
+	mTexVSByteCode = CompileShader(L"Shaders\\texshader.hlsl", instanced, "VS", "vs_5_1");
+	mTexPSByteCode = CompileShader(L"Shaders\\texshader.hlsl", instanced, "PS", "ps_5_1");
 
 	// Compile albedo shaders
-	mSimpleTexVSByteCode = CompileShader(L"Shaders\\simpletexshader.hlsl", nullptr, "VS", "vs_5_1");
-	mSimpleTexPSByteCode = CompileShader(L"Shaders\\simpletexshader.hlsl", nullptr, "PS", "ps_5_1");
+	mSimpleTexVSByteCode = CompileShader(L"Shaders\\simpletexshader.hlsl", instanced, "VS", "vs_5_1");
+	mSimpleTexPSByteCode = CompileShader(L"Shaders\\simpletexshader.hlsl", instanced, "PS", "ps_5_1");
 
 	// Compile planet shaders
 	mPlanetVSByteCode = CompileShader(L"Shaders\\terrainshader.hlsl", nullptr, "VS", "vs_5_1");
@@ -775,6 +834,9 @@ void Graphics::Resize(int width, int height)
 
 void Graphics::ExecuteCommands()
 {
+	// Uploads must reach the queue before the commands that use them
+	Uploader->Submit();
+
 	// Execute commands
 	mCommandList->Close();
 	ID3D12CommandList* cmdLists[] = { mCommandList.Get() };
@@ -803,6 +865,14 @@ void Graphics::CycleFrameResources()
 		WaitForSingleObject(eventHandle, INFINITE);
 		CloseHandle(eventHandle);
 	}
+
+	// The GPU is done with this frame's constants
+	mCurrentFrameResource->mConstants->Reset();
+
+	// Release staging memory and buffers the GPU has finished with
+	Uploader->ReleaseCompleted();
+	BufferHeap->ReleaseCompletedFrees(mFence->GetCompletedValue());
+	if (Textures) Textures->ReleaseCompleted(mFence->GetCompletedValue());
 }
 
 void Graphics::EmptyCommandQueue()
@@ -815,6 +885,8 @@ void Graphics::EmptyCommandQueue()
 	{
 		MessageBox(0, L"Command queue signal failed", L"Error", MB_OK);
 	}
+	BufferHeap->FenceFrees(mCurrentFence);
+	if (Textures) Textures->FenceReleases(mCurrentFence);
 
 	// Wait for GPU to complete commands up to fence point
 	if (mFence->GetCompletedValue() < mCurrentFence)
@@ -832,17 +904,23 @@ void Graphics::EmptyCommandQueue()
 		CloseHandle(eventHandle);
 	}
 
+	// Everything submitted is complete so staging memory and freed buffers can be released
+	Uploader->ReleaseCompleted();
+	BufferHeap->ReleaseCompletedFrees(mCurrentFence);
+	if (Textures) Textures->ReleaseCompleted(mCurrentFence);
 }
 
-void Graphics::ResetCommandAllocator(int thread)
+void Graphics::ResetCommandAllocator(int thread, int frame)
 {
-	HRESULT hr = mCommandAllocators[CurrentFrameResourceIndex][thread]->Reset();
+	if (frame < 0) frame = CurrentFrameResourceIndex;
+	HRESULT hr = mCommandAllocators[frame][thread]->Reset();
 	if (FAILED(hr))  throw std::runtime_error("Error reseting command allocator");
 }
 
-ID3D12GraphicsCommandList* Graphics::StartCommandList(int thread, int list)
+ID3D12GraphicsCommandList* Graphics::StartCommandList(int thread, int list, int frame)
 {
-	HRESULT hr = mCommandLists[thread][list]->Reset(mCommandAllocators[CurrentFrameResourceIndex][thread].Get(), NULL);
+	if (frame < 0) frame = CurrentFrameResourceIndex;
+	HRESULT hr = mCommandLists[thread][list]->Reset(mCommandAllocators[frame][thread].Get(), NULL);
 	if (FAILED(hr))  throw std::runtime_error("Error reseting command list");
 	return mCommandLists[thread][list].Get();
 }
@@ -58,6 +58,7 @@ public:
 
 	ComPtr<ID3D12PipelineState> mSolidPSO = nullptr;
 	ComPtr<ID3D12PipelineState> mWireframePSO = nullptr;
+	ComPtr<ID3D12PipelineState> mInstancedWireframePSO = nullptr;
 	ComPtr<ID3D12PipelineState> mTexPSO = nullptr;
 	ComPtr<ID3D12PipelineState> mSimpleTexPSO = nullptr;
 	ComPtr<ID3D12PipelineState> mSkyPSO = nullptr;
@@ -66,6 +67,8 @@ public:
 
 	ComPtr<ID3DBlob> mColourVSByteCode = nullptr;
 	ComPtr<ID3DBlob> mColourPSByteCode = nullptr;
+	ComPtr<ID3DBlob> mInstancedColourVSByteCode = nullptr;
+	ComPtr<ID3DBlob> mInstancedColourPSByteCode = nullptr;
 	ComPtr<ID3DBlob> mTexVSByteCode = nullptr;
 	ComPtr<ID3DBlob> mTexPSByteCode = nullptr;
 	ComPtr<ID3DBlob> mSimpleTexVSByteCode = nullptr;
@@ -97,14 +100,14 @@ public:
 	
 	void EmptyCommandQueue();
 
-	// Reset the command allocator for this thread
-	void ResetCommandAllocator(int thread);
+	// Reset the command allocator for this thread, of the current frame resource unless a frame is given
+	void ResetCommandAllocator(int thread, int frame = -1);
 
 	// Reset base command allocator
 	void ResetCommandAllocator(ID3D12CommandAllocator* commandAllocator);
 
-	// Start a command list for this thread
-	ID3D12GraphicsCommandList* StartCommandList(int thread, int list);
+	// Start a command list for this thread, on the current frame resource's allocator unless a frame is given
+	ID3D12GraphicsCommandList* StartCommandList(int thread, int list, int frame = -1);
 
 	// Reset the base command list
 	void ResetCommandList(ID3D12CommandAllocator* commandAllocator, ID3D12PipelineState* pipeline);
@@ -136,6 +139,15 @@ public:
 	// Close and execute command list for this thread
 	void CloseAndExecuteCommandList(int thread, int list);
 
+	// Close a thread's command list without executing it, so lists from several threads can be submitted together
+	void CloseCommandList(int thread, int list);
+
+	// Execute closed thread/list pairs in order with one submission
+	void ExecuteCommandLists(const std::vector<std::pair<int, int>>& lists);
+
+	// Threads that can record command lists, including the main thread
+	unsigned int GetMaxThreads() const { return mMaxThreads; }
+
 	// Cycle through frame resources
 	void CycleFrameResources();
 
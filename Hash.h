@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// XXH64 rounds and avalanche. Every input bit affects every output bit, so similar files such as mips of one
+// image or tiles of one atlas don't cluster. Used to key cached file contents
+static uint64_t HashBytes(const void* data, size_t size)
+{
+	const uint64_t PRIME1 = 11400714785074694791ull;
+	const uint64_t PRIME2 = 14029467366897019727ull;
+	const uint64_t PRIME3 = 1609587929392839161ull;
+	const uint64_t PRIME4 = 9650029242287828579ull;
+	const uint64_t PRIME5 = 2870177450012600261ull;
+
+	auto rotate = [](uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); };
+	auto mix = [&](uint64_t accumulator, uint64_t input) { return rotate(accumulator + input * PRIME2, 31) * PRIME1; };
+	auto merge = [&](uint64_t hash, uint64_t accumulator) { return (hash ^ mix(0, accumulator)) * PRIME1 + PRIME4; };
+	auto read64 = [](const uint8_t* p) { uint64_t value; memcpy(&value, p, sizeof(value)); return value; };
+	auto read32 = [](const uint8_t* p) { uint32_t value; memcpy(&value, p, sizeof(value)); return value; };
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	const uint8_t* end = bytes + size;
+	uint64_t hash;
+
+	// Four independent lanes over 32 byte stripes
+	if (size >= 32)
+	{
+		uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+		for (; bytes + 32 <= end; bytes += 32)
+		{
+			for (int i = 0; i < 4; i++) lanes[i] = mix(lanes[i], read64(bytes + i * 8));
+		}
+
+		hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+		for (int i = 0; i < 4; i++) hash = merge(hash, lanes[i]);
+	}
+	else
+	{
+		hash = PRIME5;
+	}
+
+	hash += size;
+
+	for (; bytes + 8 <= end; bytes += 8) hash = rotate(hash ^ mix(0, read64(bytes)), 27) * PRIME1 + PRIME4;
+	if (bytes + 4 <= end)
+	{
+		hash = rotate(hash ^ (read32(bytes) * PRIME1), 23) * PRIME2 + PRIME3;
+		bytes += 4;
+	}
+	for (; bytes < end; bytes++) hash = rotate(hash ^ (*bytes * PRIME5), 11) * PRIME1;
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
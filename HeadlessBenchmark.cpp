@@ -0,0 +1,13 @@
+// Runs Benchmarks without a window, device or Windows, e.g. on a Linux build machine:
+//   g++ -std=c++17 -O2 -pthread HeadlessBenchmark.cpp Benchmarks.cpp TextureDecoder.cpp ImageDecoder.cpp JobSystem.cpp BuddyAllocator.cpp -o benchmark
+//   ./benchmark Models
+// Excluded from the Visual Studio build, which runs the same benchmarks with "DX12Engine.exe -benchmark"
+#include "Benchmarks.h"
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+	std::string directory = argc > 1 ? argv[1] : "Models";
+	std::cout << Benchmarks::Run(std::wstring(directory.begin(), directory.end()));
+	return 0;
+}
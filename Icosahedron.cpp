@@ -114,11 +114,8 @@ void Icosahedron::CreateGeometry()
 
 	CalculateUVs();
 
-	mMesh->mVertices = mVertices;
-	mMesh->mIndices = mIndices;
-	
-	//mGeometryData->CalculateBufferData(d3DDevice,commandList);
-	mMesh->CalculateDynamicBufferData();
+	// Regenerating at the same detail only copies the vertices and indices that moved
+	mMesh->UpdateDynamicGeometry(mVertices, mIndices);
 }
 
 void Icosahedron::CalculateUVs()
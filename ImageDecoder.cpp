@@ -0,0 +1,1170 @@
+#include "ImageDecoder.h"
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+static uint32_t ReadBE32(const uint8_t* bytes)
+{
+	return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static uint16_t ReadBE16(const uint8_t* bytes)
+{
+	return (uint16_t)(bytes[0] << 8 | bytes[1]);
+}
+
+static const uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+bool ImageDecoder::ReadInfo(const uint8_t* data, size_t size, ImageInfo& info)
+{
+	return ReadPNGInfo(data, size, info) || ReadJPEGInfo(data, size, info);
+}
+
+bool ImageDecoder::Decode(const uint8_t* data, size_t size, const ImageInfo& info, uint8_t* pixels)
+{
+	if (size >= sizeof(PNG_SIGNATURE) && memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0) return DecodePNG(data, size, info, pixels);
+	return DecodeJPEG(data, size, info, pixels);
+}
+
+// Deflate, as used by png's zlib stream
+
+namespace
+{
+	// Bits are packed least significant first
+	struct DeflateBits
+	{
+		const uint8_t* Data;
+		size_t Size;
+		size_t Pos = 0;
+		uint64_t Bits = 0;
+		int Count = 0;
+
+		DeflateBits(const uint8_t* data, size_t size) : Data(data), Size(size) {}
+
+		// Past the end of the data it reads zeros, Overrun reports if any of them were used
+		void Refill()
+		{
+			while (Count <= 56)
+			{
+				uint64_t byte = Pos < Size ? Data[Pos] : 0;
+				Pos++;
+				Bits |= byte << Count;
+				Count += 8;
+			}
+		}
+
+		uint32_t Peek(int count) const { return (uint32_t)(Bits & ((1ull << count) - 1)); }
+		void Consume(int count) { Bits >>= count; Count -= count; }
+
+		uint32_t Read(int count)
+		{
+			if (count == 0) return 0;
+			Refill();
+			uint32_t value = Peek(count);
+			Consume(count);
+			return value;
+		}
+
+		bool Overrun() const { return Pos * 8 - Count > Size * 8; }
+	};
+
+	const int DEFLATE_FAST_BITS = 10;
+
+	// Canonical Huffman code. Short codes are decoded with one table lookup, longer ones a bit at a time
+	struct DeflateHuffman
+	{
+		// Code length << 9 | symbol, 0 where no code of up to DEFLATE_FAST_BITS matches
+		uint16_t Fast[1 << DEFLATE_FAST_BITS];
+		uint16_t Counts[16];
+		uint16_t Symbols[288];
+
+		bool Build(const uint8_t* lengths, int count)
+		{
+			memset(Fast, 0, sizeof(Fast));
+			memset(Counts, 0, sizeof(Counts));
+			for (int i = 0; i < count; ++i) Counts[lengths[i]]++;
+			Counts[0] = 0;
+
+			// More codes of a length than fit is an error, fewer is allowed
+			int left = 1;
+			for (int length = 1; length < 16; ++length)
+			{
+				left = (left << 1) - Counts[length];
+				if (left < 0) return false;
+			}
+
+			uint16_t offsets[16] = {};
+			uint16_t nextCode[16] = {};
+			int code = 0;
+			for (int length = 1; length < 16; ++length)
+			{
+				offsets[length] = (uint16_t)(length > 1 ? offsets[length - 1] + Counts[length - 1] : 0);
+				code = (code + Counts[length - 1]) << 1;
+				nextCode[length] = (uint16_t)code;
+			}
+
+			for (int symbol = 0; symbol < count; ++symbol)
+			{
+				int length = lengths[symbol];
+				if (length == 0) continue;
+				Symbols[offsets[length]++] = (uint16_t)symbol;
+				if (length > DEFLATE_FAST_BITS) continue;
+
+				// Codes are stored most significant bit first but read least significant first
+				int reversed = 0;
+				for (int bit = 0, value = nextCode[length]++; bit < length; ++bit, value >>= 1) reversed = (reversed << 1) | (value & 1);
+				for (int fill = reversed; fill < (1 << DEFLATE_FAST_BITS); fill += 1 << length)
+				{
+					Fast[fill] = (uint16_t)(length << 9 | symbol);
+				}
+			}
+			return true;
+		}
+
+		// -1 for a code that is not in the table
+		int Decode(DeflateBits& bits) const
+		{
+			bits.Refill();
+			uint16_t entry = Fast[bits.Peek(DEFLATE_FAST_BITS)];
+			if (entry)
+			{
+				bits.Consume(entry >> 9);
+				return entry & 511;
+			}
+
+			int code = 0, first = 0, index = 0;
+			for (int length = 1; length < 16; ++length)
+			{
+				code |= (int)(bits.Bits >> (length - 1)) & 1;
+				int count = Counts[length];
+				if (code - first < count)
+				{
+					bits.Consume(length);
+					return Symbols[index + code - first];
+				}
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+			return -1;
+		}
+	};
+
+	const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+		4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	bool ReadDynamicCodes(DeflateBits& bits, DeflateHuffman& literals, DeflateHuffman& distances)
+	{
+		static const uint8_t ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		int literalCount = bits.Read(5) + 257;
+		int distanceCount = bits.Read(5) + 1;
+		int lengthCount = bits.Read(4) + 4;
+		if (literalCount > 286 || distanceCount > 30) return false;
+
+		// The code lengths are themselves Huffman coded
+		uint8_t codeLengths[19] = {};
+		for (int i = 0; i < lengthCount; ++i) codeLengths[ORDER[i]] = (uint8_t)bits.Read(3);
+		DeflateHuffman lengthCode;
+		if (!lengthCode.Build(codeLengths, 19)) return false;
+
+		uint8_t lengths[286 + 30] = {};
+		int total = literalCount + distanceCount;
+		for (int index = 0; index < total;)
+		{
+			int symbol = lengthCode.Decode(bits);
+			if (symbol < 0) return false;
+			if (symbol < 16)
+			{
+				lengths[index++] = (uint8_t)symbol;
+				continue;
+			}
+
+			uint8_t repeat = 0;
+			int count;
+			if (symbol == 16)
+			{
+				if (index == 0) return false;
+				repeat = lengths[index - 1];
+				count = 3 + bits.Read(2);
+			}
+			else if (symbol == 17) count = 3 + bits.Read(3);
+			else count = 11 + bits.Read(7);
+
+			if (index + count > total) return false;
+			while (count--) lengths[index++] = repeat;
+		}
+
+		// A block must be able to end
+		if (lengths[256] == 0) return false;
+		return literals.Build(lengths, literalCount) && distances.Build(lengths + literalCount, distanceCount);
+	}
+
+	// Decompress a zlib stream into exactly outSize bytes
+	bool Inflate(const uint8_t* data, size_t size, uint8_t* out, size_t outSize)
+	{
+		// Deflate with no preset dictionary
+		if (size < 2 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20)) return false;
+
+		DeflateBits bits(data + 2, size - 2);
+		size_t written = 0;
+		bool last = false;
+		while (!last)
+		{
+			last = bits.Read(1) != 0;
+			int type = bits.Read(2);
+
+			if (type == 0)
+			{
+				// Stored, starting on a byte boundary
+				bits.Consume(bits.Count & 7);
+				uint32_t length = bits.Read(16);
+				uint32_t inverse = bits.Read(16);
+				if ((length ^ 0xFFFF) != inverse || length > outSize - written) return false;
+				for (uint32_t i = 0; i < length; ++i) out[written++] = (uint8_t)bits.Read(8);
+				if (bits.Overrun()) return false;
+				continue;
+			}
+
+			DeflateHuffman literals, distances;
+			if (type == 1)
+			{
+				uint8_t lengths[288 + 30];
+				memset(lengths, 8, 144);
+				memset(lengths + 144, 9, 112);
+				memset(lengths + 256, 7, 24);
+				memset(lengths + 280, 8, 8);
+				memset(lengths + 288, 5, 30);
+				literals.Build(lengths, 288);
+				distances.Build(lengths + 288, 30);
+			}
+			else if (type != 2 || !ReadDynamicCodes(bits, literals, distances))
+			{
+				return false;
+			}
+
+			while (true)
+			{
+				int symbol = literals.Decode(bits);
+				if (symbol < 0) return false;
+				if (symbol < 256)
+				{
+					if (written == outSize) return false;
+					out[written++] = (uint8_t)symbol;
+					continue;
+				}
+				if (symbol == 256) break;
+
+				symbol -= 257;
+				if (symbol >= 29) return false;
+				size_t length = LENGTH_BASE[symbol] + bits.Read(LENGTH_EXTRA[symbol]);
+
+				int distanceSymbol = distances.Decode(bits);
+				if (distanceSymbol < 0 || distanceSymbol >= 30) return false;
+				size_t distance = DISTANCE_BASE[distanceSymbol] + bits.Read(DISTANCE_EXTRA[distanceSymbol]);
+				if (distance > written || length > outSize - written) return false;
+
+				// Copies can overlap what they are writing
+				uint8_t* target = out + written;
+				const uint8_t* source = target - distance;
+				for (size_t i = 0; i < length; ++i) target[i] = source[i];
+				written += length;
+			}
+			if (bits.Overrun()) return false;
+		}
+		return written == outSize;
+	}
+}
+
+// Png
+
+namespace
+{
+	struct PNGHeader
+	{
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		int BitDepth = 0;
+		int ColorType = 0;
+		int Channels = 0;
+		bool Interlaced = false;
+	};
+
+	bool ReadPNGHeader(const uint8_t* data, size_t size, PNGHeader& header)
+	{
+		// Signature then an IHDR chunk
+		if (size < 33 || memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) != 0) return false;
+		if (ReadBE32(data + 8) != 13 || memcmp(data + 12, "IHDR", 4) != 0) return false;
+
+		const uint8_t* ihdr = data + 16;
+		header.Width = ReadBE32(ihdr);
+		header.Height = ReadBE32(ihdr + 4);
+		header.BitDepth = ihdr[8];
+		header.ColorType = ihdr[9];
+		header.Interlaced = ihdr[12] == 1;
+		if (header.Width == 0 || header.Height == 0 || ihdr[10] != 0 || ihdr[11] != 0 || ihdr[12] > 1) return false;
+
+		// Bit depths each colour type allows
+		int depth = header.BitDepth;
+		switch (header.ColorType)
+		{
+		case 0: header.Channels = 1; return depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+		case 2: header.Channels = 3; return depth == 8 || depth == 16;
+		case 3: header.Channels = 1; return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+		case 4: header.Channels = 2; return depth == 8 || depth == 16;
+		case 6: header.Channels = 4; return depth == 8 || depth == 16;
+		default: return false;
+		}
+	}
+
+	// Palette and transparency chunks
+	struct PNGColours
+	{
+		uint8_t Palette[256][4];
+		bool HasKey = false;
+		uint16_t Key[3] = {};
+	};
+
+	int Paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) return a;
+		return pb <= pc ? b : c;
+	}
+
+	// Undo the filter on each row of one pass, in place. Rows are a filter type byte then rowBytes of data
+	bool Unfilter(uint8_t* rows, uint32_t height, size_t rowBytes, int pixelBytes)
+	{
+		std::vector<uint8_t> zeros(rowBytes, 0);
+		const uint8_t* prior = zeros.data();
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			uint8_t filter = rows[0];
+			uint8_t* row = rows + 1;
+			switch (filter)
+			{
+			case 0:
+				break;
+			case 1:
+				for (size_t i = pixelBytes; i < rowBytes; ++i) row[i] += row[i - pixelBytes];
+				break;
+			case 2:
+				for (size_t i = 0; i < rowBytes; ++i) row[i] += prior[i];
+				break;
+			case 3:
+				for (size_t i = 0; i < (size_t)pixelBytes && i < rowBytes; ++i) row[i] += prior[i] >> 1;
+				for (size_t i = pixelBytes; i < rowBytes; ++i) row[i] += (uint8_t)((row[i - pixelBytes] + prior[i]) >> 1);
+				break;
+			case 4:
+				for (size_t i = 0; i < (size_t)pixelBytes && i < rowBytes; ++i) row[i] += prior[i];
+				for (size_t i = pixelBytes; i < rowBytes; ++i) row[i] += (uint8_t)Paeth(row[i - pixelBytes], prior[i], prior[i - pixelBytes]);
+				break;
+			default:
+				return false;
+			}
+			prior = row;
+			rows += rowBytes + 1;
+		}
+		return true;
+	}
+
+	// Expand count pixels of an unfiltered row to RGBA8, step bytes apart in the output
+	void ConvertPNGRow(const PNGHeader& header, const PNGColours& colours, const uint8_t* row, uint32_t count, uint8_t* out, size_t step)
+	{
+		const int depth = header.BitDepth;
+		for (uint32_t i = 0; i < count; ++i, out += step)
+		{
+			// Packed samples, one channel
+			if (depth < 8)
+			{
+				uint32_t bit = i * depth;
+				int value = (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+				if (header.ColorType == 3)
+				{
+					memcpy(out, colours.Palette[value], 4);
+				}
+				else
+				{
+					out[0] = out[1] = out[2] = (uint8_t)(value * 255 / ((1 << depth) - 1));
+					out[3] = colours.HasKey && value == colours.Key[0] ? 0 : 255;
+				}
+				continue;
+			}
+
+			// 16 bit samples keep their high byte, the transparent colour is matched on the full value
+			const int bytes = depth / 8;
+			const uint8_t* pixel = row + (size_t)i * header.Channels * bytes;
+			auto sample = [pixel, bytes](int channel) { return pixel[channel * bytes]; };
+			auto full = [pixel, bytes](int channel) { return bytes == 2 ? ReadBE16(pixel + channel * 2) : (uint16_t)pixel[channel]; };
+
+			switch (header.ColorType)
+			{
+			case 0:
+				out[0] = out[1] = out[2] = sample(0);
+				out[3] = colours.HasKey && full(0) == colours.Key[0] ? 0 : 255;
+				break;
+			case 2:
+				out[0] = sample(0);
+				out[1] = sample(1);
+				out[2] = sample(2);
+				out[3] = colours.HasKey && full(0) == colours.Key[0] && full(1) == colours.Key[1] && full(2) == colours.Key[2] ? 0 : 255;
+				break;
+			case 3:
+				memcpy(out, colours.Palette[pixel[0]], 4);
+				break;
+			case 4:
+				out[0] = out[1] = out[2] = sample(0);
+				out[3] = sample(1);
+				break;
+			case 6:
+				out[0] = sample(0);
+				out[1] = sample(1);
+				out[2] = sample(2);
+				out[3] = sample(3);
+				break;
+			}
+		}
+	}
+}
+
+bool ImageDecoder::ReadPNGInfo(const uint8_t* data, size_t size, ImageInfo& info)
+{
+	PNGHeader header;
+	if (!ReadPNGHeader(data, size, header)) return false;
+
+	info.Width = header.Width;
+	info.Height = header.Height;
+	info.SRGB = false;
+
+	// Colour space chunks come before the image data
+	for (size_t pos = sizeof(PNG_SIGNATURE); pos + 12 <= size;)
+	{
+		uint32_t length = ReadBE32(data + pos);
+		const uint8_t* type = data + pos + 4;
+		if (length > size - pos - 12 || memcmp(type, "IDAT", 4) == 0) break;
+
+		if (memcmp(type, "sRGB", 4) == 0)
+		{
+			info.SRGB = true;
+			break;
+		}
+		if (memcmp(type, "gAMA", 4) == 0 && length == 4)
+		{
+			// 1 / 2.2 scaled by 100000
+			info.SRGB = ReadBE32(data + pos + 8) == 45455;
+		}
+		pos += length + 12;
+	}
+	return true;
+}
+
+bool ImageDecoder::DecodePNG(const uint8_t* data, size_t size, const ImageInfo& info, uint8_t* pixels)
+{
+	PNGHeader header;
+	if (!ReadPNGHeader(data, size, header) || header.Width != info.Width || header.Height != info.Height) return false;
+
+	PNGColours colours;
+	for (auto& entry : colours.Palette)
+	{
+		entry[0] = entry[1] = entry[2] = 0;
+		entry[3] = 255;
+	}
+
+	// Image data can be split over any number of chunks
+	std::vector<uint8_t> compressed;
+	for (size_t pos = sizeof(PNG_SIGNATURE); pos + 12 <= size;)
+	{
+		uint32_t length = ReadBE32(data + pos);
+		const uint8_t* type = data + pos + 4;
+		const uint8_t* chunk = data + pos + 8;
+		if (length > size - pos - 12) return false;
+
+		if (memcmp(type, "PLTE", 4) == 0)
+		{
+			if (length % 3 != 0 || length > 256 * 3) return false;
+			for (uint32_t i = 0; i < length / 3; ++i) memcpy(colours.Palette[i], chunk + i * 3, 3);
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (header.ColorType == 3)
+			{
+				for (uint32_t i = 0; i < length && i < 256; ++i) colours.Palette[i][3] = chunk[i];
+			}
+			else if (length >= (uint32_t)header.Channels * 2 && (header.ColorType == 0 || header.ColorType == 2))
+			{
+				colours.HasKey = true;
+				for (int c = 0; c < header.Channels; ++c) colours.Key[c] = ReadBE16(chunk + c * 2);
+			}
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+		{
+			compressed.insert(compressed.end(), chunk, chunk + length);
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+		{
+			break;
+		}
+		pos += length + 12;
+	}
+	if (compressed.empty()) return false;
+
+	// Interlaced images are stored as seven smaller passes, otherwise as one
+	struct Pass { uint32_t X, Y, StepX, StepY; };
+	static const Pass ADAM7[7] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+	static const Pass WHOLE = { 0, 0, 1, 1 };
+	const Pass* passes = header.Interlaced ? ADAM7 : &WHOLE;
+	const int passCount = header.Interlaced ? 7 : 1;
+
+	const int bitsPerPixel = header.Channels * header.BitDepth;
+	const int pixelBytes = std::max(1, bitsPerPixel / 8);
+	auto passWidth = [&header](const Pass& pass) { return header.Width > pass.X ? (header.Width - pass.X + pass.StepX - 1) / pass.StepX : 0; };
+	auto passHeight = [&header](const Pass& pass) { return header.Height > pass.Y ? (header.Height - pass.Y + pass.StepY - 1) / pass.StepY : 0; };
+	auto rowBytes = [bitsPerPixel](uint32_t width) { return ((size_t)width * bitsPerPixel + 7) / 8; };
+
+	size_t filteredSize = 0;
+	for (int p = 0; p < passCount; ++p)
+	{
+		uint32_t width = passWidth(passes[p]), height = passHeight(passes[p]);
+		if (width && height) filteredSize += (size_t)height * (rowBytes(width) + 1);
+	}
+
+	std::vector<uint8_t> filtered(filteredSize);
+	if (!Inflate(compressed.data(), compressed.size(), filtered.data(), filtered.size())) return false;
+
+	uint8_t* rows = filtered.data();
+	for (int p = 0; p < passCount; ++p)
+	{
+		const Pass& pass = passes[p];
+		uint32_t width = passWidth(pass), height = passHeight(pass);
+		if (width == 0 || height == 0) continue;
+
+		size_t bytes = rowBytes(width);
+		if (!Unfilter(rows, height, bytes, pixelBytes)) return false;
+
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			uint8_t* out = pixels + (((size_t)(pass.Y + y * pass.StepY) * header.Width) + pass.X) * 4;
+			ConvertPNGRow(header, colours, rows + y * (bytes + 1) + 1, width, out, pass.StepX * 4);
+		}
+		rows += (size_t)height * (bytes + 1);
+	}
+	return true;
+}
+
+// Baseline jpg
+
+namespace
+{
+	// Bits are packed most significant first, with a zero byte stuffed after every 0xFF in the data
+	struct JPEGBits
+	{
+		const uint8_t* Data;
+		size_t Size;
+		size_t Pos;
+		uint32_t Bits = 0;
+		int Count = 0;
+
+		// Stopped at a marker, zeros are read from here on
+		bool AtMarker = false;
+
+		JPEGBits(const uint8_t* data, size_t size, size_t pos) : Data(data), Size(size), Pos(pos) {}
+
+		void Fill()
+		{
+			while (Count <= 24)
+			{
+				uint32_t byte = 0;
+				if (!AtMarker && Pos < Size)
+				{
+					byte = Data[Pos];
+					if (byte != 0xFF) Pos++;
+					else if (Pos + 1 < Size && Data[Pos + 1] == 0x00) Pos += 2;
+					else
+					{
+						AtMarker = true;
+						byte = 0;
+					}
+				}
+				Bits |= byte << (24 - Count);
+				Count += 8;
+			}
+		}
+
+		void Consume(int count) { Bits <<= count; Count -= count; }
+
+		uint32_t Read(int count)
+		{
+			if (count == 0) return 0;
+			Fill();
+			uint32_t value = Bits >> (32 - count);
+			Consume(count);
+			return value;
+		}
+
+		// Skip to just after the next restart marker and start reading afresh
+		bool Restart()
+		{
+			Bits = 0;
+			Count = 0;
+			AtMarker = false;
+			for (; Pos + 1 < Size; ++Pos)
+			{
+				if (Data[Pos] == 0xFF && Data[Pos + 1] >= 0xD0 && Data[Pos + 1] <= 0xD7)
+				{
+					Pos += 2;
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	const int JPEG_FAST_BITS = 9;
+
+	struct JPEGHuffman
+	{
+		// Codes up to JPEG_FAST_BITS long are found with one lookup, a length of 0 means a longer code
+		uint8_t FastLength[1 << JPEG_FAST_BITS];
+		uint8_t FastSymbol[1 << JPEG_FAST_BITS];
+
+		// Largest code of each length, -1 if there are none, and where that length's symbols start
+		int32_t MaxCode[17];
+		int32_t SymbolOffset[17];
+		uint8_t Symbols[256];
+		int SymbolCount = 0;
+
+		bool Build(const uint8_t counts[16], const uint8_t* symbols, int symbolCount)
+		{
+			memset(FastLength, 0, sizeof(FastLength));
+			memcpy(Symbols, symbols, symbolCount);
+			SymbolCount = symbolCount;
+
+			int code = 0, index = 0;
+			for (int length = 1; length <= 16; ++length)
+			{
+				SymbolOffset[length] = index - code;
+				int count = counts[length - 1];
+				for (int i = 0; i < count; ++i, ++code, ++index)
+				{
+					if (length > JPEG_FAST_BITS) continue;
+					int shift = JPEG_FAST_BITS - length;
+					for (int fill = code << shift; fill < (code + 1) << shift; ++fill)
+					{
+						FastLength[fill] = (uint8_t)length;
+						FastSymbol[fill] = Symbols[index];
+					}
+				}
+				MaxCode[length] = count ? code - 1 : -1;
+				if (code > (1 << length)) return false;
+				code <<= 1;
+			}
+			return true;
+		}
+
+		// -1 for a code that is not in the table
+		int Decode(JPEGBits& bits) const
+		{
+			bits.Fill();
+			uint32_t peek = bits.Bits >> (32 - JPEG_FAST_BITS);
+			if (FastLength[peek])
+			{
+				bits.Consume(FastLength[peek]);
+				return FastSymbol[peek];
+			}
+
+			for (int length = JPEG_FAST_BITS + 1; length <= 16; ++length)
+			{
+				int code = (int)(bits.Bits >> (32 - length));
+				if (code <= MaxCode[length])
+				{
+					int index = code + SymbolOffset[length];
+					if (index < 0 || index >= SymbolCount) return -1;
+					bits.Consume(length);
+					return Symbols[index];
+				}
+			}
+			return -1;
+		}
+	};
+
+	// Position in the 8x8 block of each coefficient, in the order they are stored
+	const uint8_t ZIGZAG[64] = {
+		0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+	int Extend(int value, int bits)
+	{
+		return value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+	}
+
+	// Huffman decode and dequantize one block into natural order
+	bool DecodeBlock(JPEGBits& bits, const JPEGHuffman& dc, const JPEGHuffman& ac, const uint16_t* quant, int& dcPrediction, int* block)
+	{
+		memset(block, 0, 64 * sizeof(int));
+
+		int size = dc.Decode(bits);
+		if (size < 0 || size > 11) return false;
+		if (size) dcPrediction += Extend(bits.Read(size), size);
+		block[0] = dcPrediction * quant[0];
+
+		for (int k = 1; k < 64;)
+		{
+			int symbol = ac.Decode(bits);
+			if (symbol < 0) return false;
+
+			int run = symbol >> 4, size = symbol & 15;
+			if (size == 0)
+			{
+				// 16 zeros, or the rest of the block is zero
+				if (run != 15) break;
+				k += 16;
+				continue;
+			}
+
+			k += run;
+			if (k > 63) return false;
+			block[ZIGZAG[k]] = Extend(bits.Read(size), size) * quant[k];
+			k++;
+		}
+		return true;
+	}
+
+	// Separable inverse DCT, columns then rows, writing level shifted samples
+	void InverseDCT(const int* block, uint8_t* out, size_t stride)
+	{
+		struct Basis
+		{
+			// Weight of frequency u at sample x
+			float Weights[8][8];
+			Basis()
+			{
+				const float pi = 3.14159265358979f;
+				for (int x = 0; x < 8; ++x)
+				{
+					for (int u = 0; u < 8; ++u)
+					{
+						float scale = u == 0 ? 0.353553391f : 0.5f;
+						Weights[x][u] = scale * cosf((2 * x + 1) * u * pi / 16);
+					}
+				}
+			}
+		};
+		static const Basis basis;
+
+		float columns[64];
+		for (int u = 0; u < 8; ++u)
+		{
+			// Most columns only have a DC term
+			bool flat = true;
+			for (int v = 1; v < 8 && flat; ++v) flat = block[v * 8 + u] == 0;
+			if (flat)
+			{
+				float value = basis.Weights[0][0] * block[u];
+				for (int y = 0; y < 8; ++y) columns[y * 8 + u] = value;
+				continue;
+			}
+
+			for (int y = 0; y < 8; ++y)
+			{
+				float sum = 0;
+				for (int v = 0; v < 8; ++v) sum += basis.Weights[y][v] * block[v * 8 + u];
+				columns[y * 8 + u] = sum;
+			}
+		}
+
+		for (int y = 0; y < 8; ++y, out += stride)
+		{
+			const float* row = columns + y * 8;
+			for (int x = 0; x < 8; ++x)
+			{
+				float sum = 128.5f;
+				for (int u = 0; u < 8; ++u) sum += basis.Weights[x][u] * row[u];
+				out[x] = (uint8_t)std::min(255.0f, std::max(0.0f, sum));
+			}
+		}
+	}
+
+	struct JPEGComponent
+	{
+		int ID = 0;
+		int H = 1;
+		int V = 1;
+		int Quant = 0;
+		int DCTable = 0;
+		int ACTable = 0;
+		int Prediction = 0;
+
+		// Samples this component covers, before upsampling
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+
+		// Decoded samples, padded to whole MCUs
+		std::vector<uint8_t> Plane;
+		size_t Stride = 0;
+	};
+
+	struct JPEGFrame
+	{
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		std::vector<JPEGComponent> Components;
+		int MaxH = 1;
+		int MaxV = 1;
+		uint32_t MCUsX = 0;
+		uint32_t MCUsY = 0;
+	};
+
+	// Frame header of a baseline or extended sequential Huffman jpg with 8 bit samples
+	bool ReadFrame(const uint8_t* segment, size_t length, JPEGFrame& frame)
+	{
+		if (length < 6 || segment[0] != 8) return false;
+		frame.Height = ReadBE16(segment + 1);
+		frame.Width = ReadBE16(segment + 3);
+		int count = segment[5];
+		if (frame.Width == 0 || frame.Height == 0 || (count != 1 && count != 3) || length < 6 + (size_t)count * 3) return false;
+
+		frame.Components.resize(count);
+		for (int i = 0; i < count; ++i)
+		{
+			auto& component = frame.Components[i];
+			component.ID = segment[6 + i * 3];
+			component.H = segment[7 + i * 3] >> 4;
+			component.V = segment[7 + i * 3] & 15;
+			component.Quant = segment[8 + i * 3];
+			if (component.H < 1 || component.H > 4 || component.V < 1 || component.V > 4 || component.Quant > 3) return false;
+		}
+
+		// A single component is never subsampled
+		if (count == 1) frame.Components[0].H = frame.Components[0].V = 1;
+		return true;
+	}
+
+	// True if an Exif segment gives the colour space as sRGB
+	bool ReadExifSRGB(const uint8_t* segment, size_t length)
+	{
+		if (length < 14 || memcmp(segment, "Exif\0\0", 6) != 0) return false;
+
+		// A TIFF header and directories follow, in either byte order
+		const uint8_t* tiff = segment + 6;
+		const size_t size = length - 6;
+		const bool little = tiff[0] == 'I' && tiff[1] == 'I';
+		if (!little && !(tiff[0] == 'M' && tiff[1] == 'M')) return false;
+
+		auto read16 = [tiff, little](size_t at) -> uint32_t { return little ? tiff[at] | tiff[at + 1] << 8 : tiff[at] << 8 | tiff[at + 1]; };
+		auto read32 = [read16, little](size_t at) -> uint32_t { return little ? read16(at) | read16(at + 2) << 16 : read16(at) << 16 | read16(at + 2); };
+		auto find = [&](size_t directory, uint32_t tag, uint32_t& value)
+		{
+			if (directory + 2 > size) return false;
+			uint32_t count = read16(directory);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				size_t entry = directory + 2 + (size_t)i * 12;
+				if (entry + 12 > size) return false;
+				if (read16(entry) != tag) continue;
+
+				// Short values sit at the start of the value field
+				value = read16(entry + 2) == 3 ? read16(entry + 8) : read32(entry + 8);
+				return true;
+			}
+			return false;
+		};
+
+		// Colour space is in the Exif directory that the first directory points to
+		uint32_t exifDirectory = 0, colourSpace = 0;
+		return find(read32(4), 0x8769, exifDirectory) && find(exifDirectory, 0xA001, colourSpace) && colourSpace == 1;
+	}
+
+	// Walks the markers before the frame header, false if there is none this decoder handles
+	bool FindFrame(const uint8_t* data, size_t size, JPEGFrame& frame, bool& srgb)
+	{
+		srgb = false;
+		if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+		for (size_t pos = 2; pos + 4 <= size;)
+		{
+			if (data[pos] != 0xFF) return false;
+			uint8_t marker = data[pos + 1];
+			if (marker == 0xFF) { pos++; continue; }
+			size_t length = ReadBE16(data + pos + 2);
+			if (length < 2 || pos + 2 + length > size) return false;
+
+			if (marker == 0xC0 || marker == 0xC1) return ReadFrame(data + pos + 4, length - 2, frame);
+			if (marker == 0xE1 && ReadExifSRGB(data + pos + 4, length - 2)) srgb = true;
+
+			// Progressive, lossless and arithmetic coded frames
+			if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) return false;
+			if (marker == 0xDA || marker == 0xD9) return false;
+			pos += 2 + length;
+		}
+		return false;
+	}
+
+	// Bilinear sample positions for upsampling by ratio, centred like libjpeg's fancy upsampling
+	void UpsampleWeights(uint32_t outSize, uint32_t inSize, int ratio, std::vector<uint32_t>& first, std::vector<uint8_t>& weight)
+	{
+		first.resize(outSize);
+		weight.resize(outSize);
+		for (uint32_t i = 0; i < outSize; ++i)
+		{
+			float position = std::max(0.0f, (i + 0.5f) / ratio - 0.5f);
+			uint32_t index = std::min((uint32_t)position, inSize - 1);
+			first[i] = index;
+			weight[i] = index + 1 < inSize ? (uint8_t)((position - index) * 256 + 0.5f) : 0;
+		}
+	}
+}
+
+bool ImageDecoder::ReadJPEGInfo(const uint8_t* data, size_t size, ImageInfo& info)
+{
+	JPEGFrame frame;
+	if (!FindFrame(data, size, frame, info.SRGB)) return false;
+
+	info.Width = frame.Width;
+	info.Height = frame.Height;
+	return true;
+}
+
+bool ImageDecoder::DecodeJPEG(const uint8_t* data, size_t size, const ImageInfo& info, uint8_t* pixels)
+{
+	if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+
+	JPEGFrame frame;
+	uint16_t quant[4][64] = {};
+	JPEGHuffman dcTables[4], acTables[4];
+	uint32_t restartInterval = 0;
+	int adobeTransform = -1;
+	bool haveFrame = false, haveScan = false;
+
+	for (size_t pos = 2; pos + 2 <= size;)
+	{
+		if (data[pos] != 0xFF) return false;
+		uint8_t marker = data[pos + 1];
+		if (marker == 0xFF) { pos++; continue; }
+		if (marker == 0xD9) break;
+		if (pos + 4 > size) return false;
+
+		size_t length = ReadBE16(data + pos + 2);
+		const uint8_t* segment = data + pos + 4;
+		if (length < 2 || pos + 2 + length > size) return false;
+		length -= 2;
+
+		switch (marker)
+		{
+		case 0xDB:
+			// Quantization tables, stored in zigzag order
+			for (size_t at = 0; at < length;)
+			{
+				int precision = segment[at] >> 4, table = segment[at] & 15;
+				size_t bytes = precision ? 128 : 64;
+				if (table > 3 || at + 1 + bytes > length) return false;
+				for (int k = 0; k < 64; ++k) quant[table][k] = precision ? ReadBE16(segment + at + 1 + k * 2) : segment[at + 1 + k];
+				at += 1 + bytes;
+			}
+			break;
+
+		case 0xC4:
+			for (size_t at = 0; at < length;)
+			{
+				int type = segment[at] >> 4, table = segment[at] & 15;
+				if (type > 1 || table > 3 || at + 17 > length) return false;
+				const uint8_t* counts = segment + at + 1;
+				int total = 0;
+				for (int i = 0; i < 16; ++i) total += counts[i];
+				if (total > 256 || at + 17 + total > length) return false;
+				if (!(type ? acTables : dcTables)[table].Build(counts, segment + at + 17, total)) return false;
+				at += 17 + total;
+			}
+			break;
+
+		case 0xC0:
+		case 0xC1:
+		{
+			if (!ReadFrame(segment, length, frame) || frame.Width != info.Width || frame.Height != info.Height) return false;
+
+			for (auto& component : frame.Components)
+			{
+				frame.MaxH = std::max(frame.MaxH, component.H);
+				frame.MaxV = std::max(frame.MaxV, component.V);
+			}
+			frame.MCUsX = (frame.Width + frame.MaxH * 8 - 1) / (frame.MaxH * 8);
+			frame.MCUsY = (frame.Height + frame.MaxV * 8 - 1) / (frame.MaxV * 8);
+
+			for (auto& component : frame.Components)
+			{
+				// Only whole number subsampling ratios
+				if (frame.MaxH % component.H != 0 || frame.MaxV % component.V != 0) return false;
+				component.Width = (frame.Width * component.H + frame.MaxH - 1) / frame.MaxH;
+				component.Height = (frame.Height * component.V + frame.MaxV - 1) / frame.MaxV;
+				component.Stride = (size_t)frame.MCUsX * component.H * 8;
+				component.Plane.resize(component.Stride * frame.MCUsY * component.V * 8);
+			}
+			haveFrame = true;
+			break;
+		}
+
+		case 0xDD:
+			if (length < 2) return false;
+			restartInterval = ReadBE16(segment);
+			break;
+
+		case 0xEE:
+			// Adobe marker, says whether 3 components are RGB or YCbCr
+			if (length >= 12 && memcmp(segment, "Adobe", 5) == 0) adobeTransform = segment[11];
+			break;
+
+		case 0xDA:
+		{
+			if (!haveFrame || length < 1) return false;
+			int count = segment[0];
+			if (count < 1 || count > (int)frame.Components.size() || length < 4 + (size_t)count * 2) return false;
+
+			std::vector<JPEGComponent*> scan;
+			for (int i = 0; i < count; ++i)
+			{
+				int id = segment[1 + i * 2];
+				auto found = std::find_if(frame.Components.begin(), frame.Components.end(), [id](const JPEGComponent& c) { return c.ID == id; });
+				if (found == frame.Components.end()) return false;
+				found->DCTable = segment[2 + i * 2] >> 4;
+				found->ACTable = segment[2 + i * 2] & 15;
+				if (found->DCTable > 3 || found->ACTable > 3) return false;
+				found->Prediction = 0;
+				scan.push_back(&*found);
+			}
+
+			JPEGBits bits(data, size, pos + 4 + length);
+			int block[64];
+			uint32_t unit = 0;
+			auto restart = [&]()
+			{
+				if (restartInterval == 0 || unit == 0 || unit % restartInterval != 0) return true;
+				for (auto component : scan) component->Prediction = 0;
+				return bits.Restart();
+			};
+
+			if (count == 1)
+			{
+				// One component on its own is stored block by block, not in MCUs
+				JPEGComponent& component = *scan[0];
+				uint32_t blocksX = (component.Width + 7) / 8, blocksY = (component.Height + 7) / 8;
+				for (uint32_t by = 0; by < blocksY; ++by)
+				{
+					for (uint32_t bx = 0; bx < blocksX; ++bx, ++unit)
+					{
+						if (!restart()) return false;
+						if (!DecodeBlock(bits, dcTables[component.DCTable], acTables[component.ACTable], quant[component.Quant], component.Prediction, block)) return false;
+						InverseDCT(block, component.Plane.data() + by * 8 * component.Stride + bx * 8, component.Stride);
+					}
+				}
+			}
+			else
+			{
+				for (uint32_t my = 0; my < frame.MCUsY; ++my)
+				{
+					for (uint32_t mx = 0; mx < frame.MCUsX; ++mx, ++unit)
+					{
+						if (!restart()) return false;
+						for (auto component : scan)
+						{
+							for (int v = 0; v < component->V; ++v)
+							{
+								for (int h = 0; h < component->H; ++h)
+								{
+									if (!DecodeBlock(bits, dcTables[component->DCTable], acTables[component->ACTable], quant[component->Quant], component->Prediction, block)) return false;
+									size_t x = ((size_t)mx * component->H + h) * 8, y = ((size_t)my * component->V + v) * 8;
+									InverseDCT(block, component->Plane.data() + y * component->Stride + x, component->Stride);
+								}
+							}
+						}
+					}
+				}
+			}
+
+			// Carry on from the marker after the entropy coded data
+			size_t next = bits.Pos;
+			while (next + 1 < size && !(data[next] == 0xFF && data[next + 1] != 0x00 && (data[next + 1] < 0xD0 || data[next + 1] > 0xD7))) next++;
+			pos = next;
+			haveScan = true;
+			continue;
+		}
+
+		default:
+			// Progressive, lossless and arithmetic coded frames
+			if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC8 && marker != 0xCC) return false;
+			break;
+		}
+		pos += 4 + length;
+	}
+	if (!haveScan) return false;
+
+	// Upsample subsampled components, then convert to RGB a row at a time
+	const uint32_t width = frame.Width, height = frame.Height;
+	const size_t count = frame.Components.size();
+	std::vector<uint8_t> rows[3];
+	std::vector<uint32_t> firstX[3], firstY[3];
+	std::vector<uint8_t> weightX[3], weightY[3];
+	for (size_t c = 0; c < count; ++c)
+	{
+		auto& component = frame.Components[c];
+		rows[c].resize(width);
+		UpsampleWeights(width, component.Width, frame.MaxH / component.H, firstX[c], weightX[c]);
+		UpsampleWeights(height, component.Height, frame.MaxV / component.V, firstY[c], weightY[c]);
+	}
+
+	const bool rgb = count == 3 && adobeTransform == 0;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (size_t c = 0; c < count; ++c)
+		{
+			auto& component = frame.Components[c];
+			const uint8_t* top = component.Plane.data() + firstY[c][y] * component.Stride;
+			const int wy = weightY[c][y];
+			const uint8_t* bottom = wy ? top + component.Stride : top;
+
+			if (component.H == frame.MaxH && component.V == frame.MaxV)
+			{
+				memcpy(rows[c].data(), top, width);
+				continue;
+			}
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				uint32_t x0 = firstX[c][x];
+				const int wx = weightX[c][x];
+				uint32_t x1 = wx ? x0 + 1 : x0;
+				int upper = top[x0] * (256 - wx) + top[x1] * wx;
+				int lower = bottom[x0] * (256 - wx) + bottom[x1] * wx;
+				rows[c][x] = (uint8_t)((upper * (256 - wy) + lower * wy + 32768) >> 16);
+			}
+		}
+
+		uint8_t* out = pixels + (size_t)y * width * 4;
+		for (uint32_t x = 0; x < width; ++x, out += 4)
+		{
+			if (count == 1)
+			{
+				out[0] = out[1] = out[2] = rows[0][x];
+			}
+			else if (rgb)
+			{
+				out[0] = rows[0][x];
+				out[1] = rows[1][x];
+				out[2] = rows[2][x];
+			}
+			else
+			{
+				// JFIF YCbCr to RGB in 16.16 fixed point
+				int luma = rows[0][x] << 16;
+				int cb = rows[1][x] - 128, cr = rows[2][x] - 128;
+				out[0] = (uint8_t)std::clamp((luma + 91881 * cr + 32768) >> 16, 0, 255);
+				out[1] = (uint8_t)std::clamp((luma - 22554 * cb - 46802 * cr + 32768) >> 16, 0, 255);
+				out[2] = (uint8_t)std::clamp((luma + 116130 * cb + 32768) >> 16, 0, 255);
+			}
+			out[3] = 255;
+		}
+	}
+	return true;
+}
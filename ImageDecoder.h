@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Size and colour space of an image file, read from its headers without decoding it
+struct ImageInfo
+{
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+
+	// Colour values are sRGB encoded, from the same metadata the WIC loader reads: a png sRGB chunk or
+	// sRGB gamma, or a jpg's Exif colour space. Files without it are treated as linear, as WIC did
+	bool SRGB = false;
+};
+
+// Decodes png and baseline jpg files to RGBA8. Has no graphics API, OS or third party dependency so it runs on
+// any thread and on any platform. Progressive jpgs and other formats are not handled, Decode returns false for
+// them and the caller falls back to the WIC loader
+class ImageDecoder
+{
+public:
+	// False if the data is not a png or jpg this decoder can handle
+	static bool ReadInfo(const uint8_t* data, size_t size, ImageInfo& info);
+
+	// Writes Width * Height tightly packed RGBA8 pixels, info must come from ReadInfo on the same data
+	static bool Decode(const uint8_t* data, size_t size, const ImageInfo& info, uint8_t* pixels);
+
+private:
+	static bool ReadPNGInfo(const uint8_t* data, size_t size, ImageInfo& info);
+	static bool ReadJPEGInfo(const uint8_t* data, size_t size, ImageInfo& info);
+	static bool DecodePNG(const uint8_t* data, size_t size, const ImageInfo& info, uint8_t* pixels);
+	static bool DecodeJPEG(const uint8_t* data, size_t size, const ImageInfo& info, uint8_t* pixels);
+};
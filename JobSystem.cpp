@@ -0,0 +1,226 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+
+// Index of the calling thread's queue, threads outside the pool use the shared first queue
+static thread_local int sQueueIndex = 0;
+
+JobSystem::JobSystem(unsigned int threadCount)
+{
+	// hardware_concurrency can report 0 when the core count is unknown
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	// Queue 0 is shared by the main thread and any others outside the pool
+	for (unsigned int i = 0; i <= threadCount; ++i)
+	{
+		mQueues.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		mThreads.emplace_back(&JobSystem::WorkerThread, this, i + 1);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepLock);
+		mQuit = true;
+	}
+	mWorkReady.notify_all();
+
+	for (auto& thread : mThreads)
+	{
+		thread.join();
+	}
+}
+
+void JobSystem::Run(std::function<void()> job, JobCounter* counter, JobCounter* dependency)
+{
+	if (counter) counter->mCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (dependency)
+	{
+		// Checked under the lock Finish takes to start dependents, so the job can't be missed
+		std::lock_guard<std::mutex> lock(dependency->mLock);
+		if (!dependency->IsDone())
+		{
+			dependency->mDependents.push_back({ std::move(job), counter });
+			return;
+		}
+	}
+
+	Push({ std::move(job), counter });
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		if (!TryRunJob()) std::this_thread::yield();
+	}
+
+	// The last job to finish holds the lock until it is done with the counter, after that it can be destroyed
+	std::lock_guard<std::mutex> lock(counter.mLock);
+}
+
+void JobSystem::ParallelFor(size_t count, size_t minRange, const std::function<void(size_t begin, size_t end)>& job)
+{
+	if (count == 0) return;
+
+	// A few ranges per thread so stealing can even out uneven work
+	size_t rangeCount = std::min<size_t>(GetThreadCount() * 4, (count + minRange - 1) / std::max<size_t>(minRange, 1));
+	rangeCount = std::max<size_t>(rangeCount, 1);
+	size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+
+	if (rangeCount == 1)
+	{
+		job(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (size_t begin = rangeSize; begin < count; begin += rangeSize)
+	{
+		size_t end = std::min(count, begin + rangeSize);
+		Run([&job, begin, end]() { job(begin, end); }, &counter);
+	}
+
+	// The first range runs here rather than waiting
+	job(0, std::min(count, rangeSize));
+	Wait(counter);
+}
+
+JobSystem::BenchmarkResults JobSystem::Benchmark(int jobCount)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	BenchmarkResults results;
+
+	auto perJob = [jobCount](Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / jobCount;
+	};
+
+	{
+		JobCounter counter;
+		auto start = Clock::now();
+		for (int i = 0; i < jobCount; ++i) Run([]() {}, &counter);
+		Wait(counter);
+		results.RunAndWaitNs = perJob(start);
+	}
+
+	{
+		auto start = Clock::now();
+		ParallelFor(jobCount, 1, [](size_t, size_t) {});
+		results.ParallelForNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / std::min<size_t>(jobCount, GetThreadCount() * 4);
+	}
+
+	{
+		// Each job can only start when the one before it finishes
+		std::vector<JobCounter> chain(jobCount);
+		auto start = Clock::now();
+		for (int i = 0; i < jobCount; ++i) Run([]() {}, &chain[i], i > 0 ? &chain[i - 1] : nullptr);
+		Wait(chain.back());
+		results.DependencyNs = perJob(start);
+	}
+
+	return results;
+}
+
+void JobSystem::WorkerThread(unsigned int index)
+{
+	sQueueIndex = index;
+
+	while (true)
+	{
+		if (TryRunJob()) continue;
+
+		std::unique_lock<std::mutex> lock(mSleepLock);
+		mWorkReady.wait(lock, [this]() { return mQuit || mQueuedJobs.load() > 0; });
+		if (mQuit) return;
+	}
+}
+
+JobSystem::WorkerQueue& JobSystem::GetLocalQueue()
+{
+	return *mQueues[sQueueIndex];
+}
+
+void JobSystem::Push(Job job)
+{
+	{
+		auto& queue = GetLocalQueue();
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		queue.Jobs.push_back(std::move(job));
+	}
+
+	// Taken under the sleep lock so a thread about to sleep sees the new job
+	{
+		std::lock_guard<std::mutex> lock(mSleepLock);
+		mQueuedJobs.fetch_add(1);
+	}
+	mWorkReady.notify_one();
+}
+
+bool JobSystem::TryRunJob()
+{
+	if (mQueuedJobs.load() == 0) return false;
+
+	Job job;
+	bool found = false;
+
+	// Newest local job first, its data is most likely still in cache
+	{
+		auto& queue = GetLocalQueue();
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		if (!queue.Jobs.empty())
+		{
+			job = std::move(queue.Jobs.back());
+			queue.Jobs.pop_back();
+			found = true;
+		}
+	}
+
+	// Otherwise the oldest job of another queue, starting after our own so thieves spread out
+	for (size_t i = 1; !found && i < mQueues.size(); ++i)
+	{
+		auto& queue = *mQueues[(sQueueIndex + i) % mQueues.size()];
+		std::lock_guard<std::mutex> lock(queue.Lock);
+		if (!queue.Jobs.empty())
+		{
+			job = std::move(queue.Jobs.front());
+			queue.Jobs.pop_front();
+			found = true;
+		}
+	}
+
+	if (!found) return false;
+
+	mQueuedJobs.fetch_sub(1);
+	job.Work();
+	Finish(job.Counter);
+	return true;
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+	if (!counter) return;
+
+	// Dependents are taken under the lock Run checks the count under, so none are left behind
+	std::vector<std::pair<std::function<void()>, JobCounter*>> dependents;
+	{
+		std::lock_guard<std::mutex> lock(counter->mLock);
+		if (counter->mCount.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		dependents.swap(counter->mDependents);
+	}
+
+	for (auto& [job, dependentCounter] : dependents)
+	{
+		Push({ std::move(job), dependentCounter });
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+
+class JobSystem;
+
+// Counts unfinished jobs. Wait on it, or start jobs after it reaches zero
+class JobCounter
+{
+public:
+	bool IsDone() const { return mCount.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int> mCount = 0;
+
+	// Jobs started once the count reaches zero
+	std::mutex mLock;
+	std::vector<std::pair<std::function<void()>, JobCounter*>> mDependents;
+};
+
+// Engine wide pool of worker threads, one per core less the main thread. Each thread owns a queue it takes its
+// newest jobs from, and idle threads steal the oldest jobs from other queues. Threads waiting on a counter run
+// jobs while they wait, so jobs can start and wait on other jobs without tying up the pool
+class JobSystem
+{
+public:
+	// 0 uses a thread per core, less the main thread
+	JobSystem(unsigned int threadCount = 0);
+	~JobSystem();
+
+	// Queue a job, counted by counter if given. With a dependency, the job only starts once that counter is done
+	void Run(std::function<void()> job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Run jobs until the counter is done, after which it can be destroyed
+	void Wait(JobCounter& counter);
+
+	// Split [0, count) into ranges of at least minRange and run them across the pool, returns once all are done
+	void ParallelFor(size_t count, size_t minRange, const std::function<void(size_t begin, size_t end)>& job);
+
+	// Run a job that returns a value, for callers that poll for the result
+	template<typename F>
+	auto Async(F&& job) -> std::future<decltype(job())>
+	{
+		auto task = std::make_shared<std::packaged_task<decltype(job())()>>(std::forward<F>(job));
+		auto future = task->get_future();
+		Run([task]() { (*task)(); });
+		return future;
+	}
+
+	// Threads jobs run on, including the calling thread while it waits
+	unsigned int GetThreadCount() const { return (unsigned int)mThreads.size() + 1; }
+
+	// Scheduling overhead, measured by running empty jobs
+	struct BenchmarkResults
+	{
+		double RunAndWaitNs = 0;	// Per job queued from one thread and waited on
+		double ParallelForNs = 0;	// Per range of a parallel for over empty ranges
+		double DependencyNs = 0;	// Per job in a chain where each depends on the last
+	};
+	BenchmarkResults Benchmark(int jobCount = 100000);
+
+private:
+	struct Job
+	{
+		std::function<void()> Work;
+		JobCounter* Counter = nullptr;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex Lock;
+		std::deque<Job> Jobs;
+	};
+
+	void WorkerThread(unsigned int index);
+
+	// Queue of the calling thread, threads outside the pool share the first one
+	WorkerQueue& GetLocalQueue();
+	void Push(Job job);
+
+	// Take the newest local job or steal the oldest from another queue
+	bool TryRunJob();
+	void Finish(JobCounter* counter);
+
+	std::vector<std::thread> mThreads;
+	std::vector<std::unique_ptr<WorkerQueue>> mQueues;
+
+	// Sleeping threads are woken when jobs are queued
+	std::mutex mSleepLock;
+	std::condition_variable mWorkReady;
+	std::atomic<int> mQueuedJobs = 0;
+	bool mQuit = false;
+};
@@ -1,4 +1,7 @@
 #include "Mesh.h"
+#include "Common.h"
+#include "Graphics.h"
+#include <cstring>
 
 Mesh::Mesh()
 {
@@ -6,6 +9,13 @@ Mesh::Mesh()
 
 Mesh::~Mesh()
 {
+	// Return buffer ranges to the heap once the GPU is done with them
+	if (BufferHeap)
+	{
+		BufferHeap->Free(mVertexAllocation);
+		BufferHeap->Free(mIndexAllocation);
+	}
+
 	if(mMaterial) delete mMaterial;
 	for (auto& tex : mTextures)
 	{
@@ -15,24 +25,35 @@ Mesh::~Mesh()
 
 D3D12_VERTEX_BUFFER_VIEW Mesh::GetVertexBufferView()
 {
+	if (mSharedGeometry) return mSharedGeometry->GetVertexBufferView();
+
 	D3D12_VERTEX_BUFFER_VIEW vbv;
-	vbv.BufferLocation = mGPUVertexBuffer->GetGPUVirtualAddress();
+	vbv.BufferLocation = mDynamicVertexBuffer ? mDynamicVertexBuffer->GetGPUAddress(CurrentFrameResourceIndex) : mVertexAllocation.GetGPUAddress();
 	vbv.StrideInBytes = mVertexByteStride;
 	vbv.SizeInBytes = mVertexBufferByteSize;
 	return vbv;
 }
 D3D12_INDEX_BUFFER_VIEW Mesh::GetIndexBufferView()
 {
+	if (mSharedGeometry) return mSharedGeometry->GetIndexBufferView();
+
 	D3D12_INDEX_BUFFER_VIEW ibv;
-	ibv.BufferLocation = mGPUIndexBuffer->GetGPUVirtualAddress();
+	ibv.BufferLocation = mDynamicIndexBuffer ? mDynamicIndexBuffer->GetGPUAddress(CurrentFrameResourceIndex) : mIndexAllocation.GetGPUAddress();
 	ibv.Format = mIndexFormat;
 	ibv.SizeInBytes = mIndexBufferByteSize;
 	return ibv;
 }
-void Mesh::EmptyUploaders()
+void Mesh::SetGeometry(std::vector<Vertex>&& vertices, std::vector<uint32_t>&& indices)
+{
+	mVertices = std::move(vertices);
+	mIndices = std::move(indices);
+}
+
+void Mesh::ReleaseCPUData()
 {
-	mVertexBufferUploader = nullptr;
-	mIndexBufferUploader = nullptr;
+	// Swap with empty vectors so the memory is actually returned
+	std::vector<Vertex>().swap(mVertices);
+	std::vector<uint32_t>().swap(mIndices);
 }
 
 void Mesh::CalculateDynamicBufferData()
@@ -40,42 +61,163 @@ void Mesh::CalculateDynamicBufferData()
 	UINT vbByteSize = mVertices.size() * sizeof(Vertex);
 	UINT ibByteSize = (UINT)mIndices.size() * sizeof(std::uint32_t);
 
-	mCPUVertexBuffer = nullptr;
-	mGPUVertexBuffer = nullptr;
-
+	mIndicesCount = mIndices.size();
 	mVertexByteStride = sizeof(Vertex);
 	mVertexBufferByteSize = vbByteSize;
+	mIndexFormat = DXGI_FORMAT_R32_UINT;
 	mIndexBufferByteSize = ibByteSize;
+	if (!mVertices.empty()) CalculateBounds(mVertices.data(), (UINT)mVertices.size());
+
+	// Geometry was replaced as a whole, so every frame copy needs all of it
+	if (!mDynamicVertexBuffer)
+	{
+		mDynamicVertexBuffer = std::make_unique<DynamicBuffer>(D3DDevice.Get(), vbByteSize, Graphics::mNumFrameResources);
+		mDynamicIndexBuffer = std::make_unique<DynamicBuffer>(D3DDevice.Get(), ibByteSize, Graphics::mNumFrameResources);
+	}
+	else
+	{
+		mDynamicVertexBuffer->MarkAllDirty();
+		mDynamicIndexBuffer->MarkAllDirty();
+	}
+}
+
+// Calls mark(first, count) for each run of elements that differ, runs this close together are marked as one
+const size_t DIRTY_RUN_GAP = 16;
+
+template<typename T, typename F>
+static void ForEachChangedRun(const std::vector<T>& current, const std::vector<T>& updated, F mark)
+{
+	size_t i = 0;
+	while (i < updated.size())
+	{
+		if (memcmp(&current[i], &updated[i], sizeof(T)) == 0) { i++; continue; }
+
+		size_t first = i;
+		size_t last = i + 1;
+		for (size_t j = last; j < updated.size() && j < last + DIRTY_RUN_GAP; j++)
+		{
+			if (memcmp(&current[j], &updated[j], sizeof(T)) != 0) last = j + 1;
+		}
+
+		mark((UINT)first, (UINT)(last - first));
+		i = last;
+	}
+}
+
+void Mesh::UpdateDynamicGeometry(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	if (!mDynamicVertexBuffer || vertices.size() != mVertices.size() || indices.size() != mIndices.size())
+	{
+		mVertices = vertices;
+		mIndices = indices;
+		CalculateDynamicBufferData();
+		return;
+	}
+
+	ForEachChangedRun(mVertices, vertices, [this](UINT first, UINT count) { MarkVerticesDirty(first, count); });
+	ForEachChangedRun(mIndices, indices, [this](UINT first, UINT count) { MarkIndicesDirty(first, count); });
+	mVertices = vertices;
+	mIndices = indices;
 
+	if (!mVertices.empty()) CalculateBounds(mVertices.data(), (UINT)mVertices.size());
 }
 
-void Mesh::Draw(ID3D12GraphicsCommandList* commandList)
+void Mesh::MarkVerticesDirty(UINT first, UINT count)
 {
+	if (mDynamicVertexBuffer) mDynamicVertexBuffer->MarkDirty((UINT64)first * sizeof(Vertex), (UINT64)count * sizeof(Vertex));
+}
+
+void Mesh::MarkIndicesDirty(UINT first, UINT count)
+{
+	if (mDynamicIndexBuffer) mDynamicIndexBuffer->MarkDirty((UINT64)first * sizeof(uint32_t), (UINT64)count * sizeof(uint32_t));
+}
+
+void Mesh::UpdateDynamicBuffers()
+{
+	// Sizes can change between edits, e.g. when a LOD adds vertices
+	mIndicesCount = mIndices.size();
+	mVertexBufferByteSize = (UINT)(mVertices.size() * sizeof(Vertex));
+	mIndexBufferByteSize = (UINT)(mIndices.size() * sizeof(uint32_t));
+
+	mDynamicVertexBuffer->Update(CurrentFrameResourceIndex, mVertices.data(), mVertexBufferByteSize);
+	mDynamicIndexBuffer->Update(CurrentFrameResourceIndex, mIndices.data(), mIndexBufferByteSize);
+}
+
+void Mesh::Draw(ID3D12GraphicsCommandList* commandList, UINT instanceCount)
+{
+	if (mDynamicVertexBuffer) UpdateDynamicBuffers();
+
 	// Set vertex and index buffers, and draw
 	commandList->IASetVertexBuffers(0, 1, &GetVertexBufferView());
 	commandList->IASetIndexBuffer(&GetIndexBufferView());
 	commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	commandList->DrawIndexedInstanced(mIndices.size(), 1, 0, 0, 0);
+	int indicesCount = mSharedGeometry ? mSharedGeometry->mIndicesCount : mIndicesCount;
+	commandList->DrawIndexedInstanced(indicesCount, instanceCount, 0, 0, 0);
 }
 
 void Mesh::CalculateBufferData(ID3D12Device* d3DDevice, ID3D12GraphicsCommandList* commandList)
 {
-	mIndicesCount = mIndices.size();
-	const UINT vBSize = (UINT)mVertices.size() * sizeof(Vertex);
-	const UINT iBSize = (UINT)mIndices.size() * sizeof(std::uint32_t);
+	if (mOptimize) Optimize();
+
+	UploadGeometry(mVertices.data(), (UINT)mVertices.size(), mIndices.data(), (UINT)mIndices.size());
 
-	// Create CPU buffers
-	D3DCreateBlob(vBSize, &mCPUVertexBuffer);
-	CopyMemory(mCPUVertexBuffer->GetBufferPointer(), mVertices.data(), vBSize);
+	if (!mKeepCPUData) ReleaseCPUData();
+}
+
+void Mesh::Optimize()
+{
+	// Reorder geometry for the GPU caches, the difference is kept for inspection
+	mOptimizerStats = MeshOptimizer::Optimize(mVertices, mIndices);
+}
+
+void Mesh::CalculateBounds(const Vertex* vertices, UINT vertexCount)
+{
+	BoundingBox::CreateFromPoints(mBounds, vertexCount, &vertices[0].Pos, sizeof(Vertex));
+	BoundingSphere::CreateFromPoints(mBoundingSphere, vertexCount, &vertices[0].Pos, sizeof(Vertex));
+}
+
+void Mesh::UploadGeometry(const Vertex* vertices, UINT vertexCount, const uint32_t* indices, UINT indexCount)
+{
+	if (vertexCount > 0) CalculateBounds(vertices, vertexCount);
+
+	// Nothing to draw, drop any previous buffers and leave the views empty rather than allocate zero bytes
+	if (vertexCount == 0 || indexCount == 0)
+	{
+		BufferHeap->Free(mVertexAllocation);
+		BufferHeap->Free(mIndexAllocation);
+		mIndicesCount = 0;
+		mVertexBufferByteSize = 0;
+		mIndexBufferByteSize = 0;
+		return;
+	}
+
+	// Use 16 bit indices when every vertex can be addressed with them
+	std::vector<uint16_t> shortIndices;
+	const void* indexData = indices;
+	UINT indexSize = sizeof(std::uint32_t);
+	mIndexFormat = DXGI_FORMAT_R32_UINT;
+	if (MeshOptimizer::CanUseShortIndices(vertexCount))
+	{
+		shortIndices.assign(indices, indices + indexCount);
+		indexData = shortIndices.data();
+		indexSize = sizeof(std::uint16_t);
+		mIndexFormat = DXGI_FORMAT_R16_UINT;
+	}
 
-	D3DCreateBlob(iBSize, &mCPUIndexBuffer);
-	CopyMemory(mCPUIndexBuffer->GetBufferPointer(), mIndices.data(), iBSize);
+	mIndicesCount = indexCount;
+	const UINT vBSize = vertexCount * sizeof(Vertex);
+	const UINT iBSize = indexCount * indexSize;
 
-	// Create GPU buffers
-	mGPUVertexBuffer = CreateDefaultBuffer(mVertices.data(), vBSize, mVertexBufferUploader, d3DDevice, commandList);
+	// Create GPU buffers, replacing any from a previous upload
+	BufferHeap->Free(mVertexAllocation);
+	BufferHeap->Free(mIndexAllocation);
+	mVertexAllocation = BufferHeap->Allocate(vBSize);
+	mIndexAllocation = BufferHeap->Allocate(iBSize);
 
-	mGPUIndexBuffer = CreateDefaultBuffer(mIndices.data(), iBSize, mIndexBufferUploader, d3DDevice, commandList);
+	// Data is copied into the staging ring here, so the source is no longer needed
+	Uploader->UploadBuffer(BufferHeap.get(), mVertexAllocation, vertices, vBSize);
+	Uploader->UploadBuffer(BufferHeap.get(), mIndexAllocation, indexData, iBSize);
 
 	mVertexByteStride = sizeof(Vertex);
 	mVertexBufferByteSize = vBSize;
@@ -5,9 +5,15 @@
 #include <d3d12.h>
 #include <dxgi1_4.h>
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include "Utility.h"
+#include "MeshOptimizer.h"
+#include "GPUBufferHeap.h"
+#include "DynamicBuffer.h"
+#include <memory>
 #include <vector>
 #include <array>
+#include <algorithm>
 #include <D3DCompiler.h>
 
 using namespace std;
@@ -19,17 +25,10 @@ class Mesh
 public:
 	Mesh();
 	~Mesh();
-	// Vertex and index buffers on CPU side
-	ComPtr<ID3DBlob> mCPUVertexBuffer = nullptr;
-	ComPtr<ID3DBlob> mCPUIndexBuffer = nullptr;
 
-	// Vertex and index buffers on GPU side
-	ComPtr<ID3D12Resource> mGPUVertexBuffer = nullptr;
-	ComPtr<ID3D12Resource> mGPUIndexBuffer = nullptr;
-
-	// Vertex and index buffer uploaders
-	ComPtr<ID3D12Resource> mVertexBufferUploader = nullptr;
-	ComPtr<ID3D12Resource> mIndexBufferUploader = nullptr;
+	// Vertex and index buffers on GPU side, sub-allocated from the buffer heap
+	GPUBufferAllocation mVertexAllocation;
+	GPUBufferAllocation mIndexAllocation;
 
 	// Data about buffers.
 	UINT mVertexByteStride = 0;
@@ -38,23 +37,72 @@ public:
 	UINT mIndexBufferByteSize = 0;
 	int  mIndicesCount = 0;
 
-	// Geometry
+	// Draw another mesh's buffers instead of owning any, used by model instances
+	Mesh* mSharedGeometry = nullptr;
+
+	// Per frame buffers for geometry that is edited after creation, only changed ranges are copied
+	std::unique_ptr<DynamicBuffer> mDynamicVertexBuffer;
+	std::unique_ptr<DynamicBuffer> mDynamicIndexBuffer;
+
+	// Geometry, only kept after it has been copied for upload if requested
 	std::vector<Vertex> mVertices;
 	std::vector<uint32_t> mIndices;
+	bool mKeepCPUData = false;
+
+	// Optimize geometry before upload and keep the results
+	bool mOptimize = true;
+	MeshOptimizerStats mOptimizerStats;
+
+	// Results for the geometry this mesh draws, which may belong to another mesh
+	const MeshOptimizerStats& GetOptimizerStats() const { return mSharedGeometry ? mSharedGeometry->mOptimizerStats : mOptimizerStats; }
+
+	// Local space bounds, set when geometry is uploaded
+	BoundingBox mBounds;
+	BoundingSphere mBoundingSphere;
 
 	// Material and texture array
 	std::vector<Texture*> mTextures;
-	Material* mMaterial;
+	Material* mMaterial = nullptr;
 	
+	const BoundingBox& GetBounds() const { return mSharedGeometry ? mSharedGeometry->mBounds : mBounds; }
+	const BoundingSphere& GetBoundingSphere() const { return mSharedGeometry ? mSharedGeometry->mBoundingSphere : mBoundingSphere; }
+
 	D3D12_VERTEX_BUFFER_VIEW GetVertexBufferView();
 	D3D12_INDEX_BUFFER_VIEW GetIndexBufferView();
-	void EmptyUploaders();
+
+	// Take ownership of geometry without copying it
+	void SetGeometry(std::vector<Vertex>&& vertices, std::vector<uint32_t>&& indices);
+
+	// Free CPU geometry, the staging copy is owned by the upload manager
+	void ReleaseCPUData();
 
 	// Calculate buffer data for geometry
 	void CalculateBufferData(ID3D12Device* d3DDevice, ID3D12GraphicsCommandList* commandList);
 
+	// Optimize CPU geometry in place, touches no GPU state so it can run on a loading thread
+	void Optimize();
+
+	// Upload geometry that is already optimized, e.g. straight from a mapped baked file
+	void UploadGeometry(const Vertex* vertices, UINT vertexCount, const uint32_t* indices, UINT indexCount);
+
+	// Local space box and sphere around the vertices
+	void CalculateBounds(const Vertex* vertices, UINT vertexCount);
+
 	// Calculates buffer data for if being used in dynamic vertex + index buffers
+	// CPU geometry is kept, edit it in place and mark what changed
 	void CalculateDynamicBufferData();
 
-	void Draw(ID3D12GraphicsCommandList* commandList);
+	// Replace dynamic geometry, marking only the runs of elements that differ from the current geometry
+	// Everything is rewritten when the vertex or index count changes
+	void UpdateDynamicGeometry(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+	// Mark changed elements of dynamic geometry, they are copied when the mesh is next drawn
+	void MarkVerticesDirty(UINT first, UINT count);
+	void MarkIndicesDirty(UINT first, UINT count);
+
+	// Copy dirty ranges into the current frame's dynamic buffers
+	void UpdateDynamicBuffers();
+
+	// Draw instanceCount copies, batched draws read each one's transform from the instance buffer
+	void Draw(ID3D12GraphicsCommandList* commandList, UINT instanceCount = 1);
 };
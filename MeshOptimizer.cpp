@@ -0,0 +1,311 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+// Forsyth vertex cache tuning values
+const int FORSYTH_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// Smallest run of triangles that can be moved as one cluster by the overdraw pass
+const size_t MIN_OVERDRAW_CLUSTER = 64;
+
+// Score a vertex by its position in the cache and how many triangles still use it
+static float VertexScore(int cachePosition, uint32_t remainingValence)
+{
+	// Vertex is not used by any remaining triangles
+	if (remainingValence == 0) return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// Vertices used by the last triangle get a fixed score so it is not reused straight away
+		if (cachePosition < 3)
+		{
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// Boost vertices with few triangles left so they are finished off and leave the cache
+	score += VALENCE_BOOST_SCALE * powf(float(remainingValence), -VALENCE_BOOST_POWER);
+	return score;
+}
+
+MeshOptimizerStats MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	MeshOptimizerStats stats;
+	stats.VerticesBefore = (UINT)vertices.size();
+	stats.BytesBefore = (UINT)(vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t));
+	stats.ACMRBefore = CalculateACMR(indices, vertices.size());
+	stats.Triangles = (UINT)(indices.size() / 3);
+
+	if (indices.size() >= 3)
+	{
+		OptimizeVertexCache(indices, vertices.size());
+		OptimizeOverdraw(indices, vertices);
+		OptimizeVertexFetch(vertices, indices);
+	}
+
+	stats.ShortIndices = CanUseShortIndices(vertices.size());
+	stats.VerticesAfter = (UINT)vertices.size();
+	stats.BytesAfter = (UINT)(vertices.size() * sizeof(Vertex) + indices.size() * (stats.ShortIndices ? sizeof(uint16_t) : sizeof(uint32_t)));
+	stats.ACMRAfter = CalculateACMR(indices, vertices.size());
+
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	// Count triangles using each vertex
+	std::vector<uint32_t> valence(vertexCount, 0);
+	for (auto index : indices)
+	{
+		valence[index]++;
+	}
+
+	// Build vertex to triangle adjacency, each vertex owns a range of the array
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		offsets[i + 1] = offsets[i] + valence[i];
+	}
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+	}
+
+	// Initial scores
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		vertexScore[i] = VertexScore(-1, valence[i]);
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	// Simulated cache, with room for the three vertices pushed in by each triangle
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+
+	size_t nextUnemitted = 0;
+	int64_t bestTriangle = -1;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// Nothing in the cache is useful, start again from the next triangle in the original order
+		if (bestTriangle < 0)
+		{
+			while (emitted[nextUnemitted]) nextUnemitted++;
+			bestTriangle = nextUnemitted;
+		}
+
+		const uint32_t* triangle = &indices[bestTriangle * 3];
+		output.push_back(triangle[0]);
+		output.push_back(triangle[1]);
+		output.push_back(triangle[2]);
+		emitted[bestTriangle] = true;
+
+		// Remove the triangle from each vertex's live adjacency range
+		for (int i = 0; i < 3; i++)
+		{
+			uint32_t vertex = triangle[i];
+			uint32_t* start = &adjacency[offsets[vertex]];
+			uint32_t* end = start + valence[vertex];
+			auto found = std::find(start, end, uint32_t(bestTriangle));
+			if (found != end)
+			{
+				*found = *(end - 1);
+				valence[vertex]--;
+			}
+		}
+
+		// Push the triangle's vertices to the front of the cache
+		int newCount = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			newCache[newCount++] = triangle[i];
+		}
+		for (int i = 0; i < cacheCount; i++)
+		{
+			uint32_t vertex = cache[i];
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+			{
+				newCache[newCount++] = vertex;
+			}
+		}
+
+		// Update positions and scores, including vertices that fell out of the cache
+		for (int i = 0; i < newCount; i++)
+		{
+			uint32_t vertex = newCache[i];
+			cachePosition[vertex] = i < FORSYTH_CACHE_SIZE ? i : -1;
+			vertexScore[vertex] = VertexScore(cachePosition[vertex], valence[vertex]);
+		}
+
+		cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+		std::copy(newCache, newCache + cacheCount, cache);
+
+		// Rescore triangles touching the cache and pick the best for next time
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; i++)
+		{
+			uint32_t vertex = cache[i];
+			for (uint32_t a = offsets[vertex]; a < offsets[vertex] + valence[vertex]; a++)
+			{
+				uint32_t t = adjacency[a];
+				float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount < MIN_OVERDRAW_CLUSTER * 2) return;
+
+	// Split into clusters where the simulated cache goes cold, moving these keeps the cache order intact
+	std::vector<size_t> clusterStarts;
+	clusterStarts.push_back(0);
+
+	std::vector<uint32_t> timestamps(vertices.size(), 0);
+	uint32_t time = POST_TRANSFORM_CACHE_SIZE + 1;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		int misses = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			uint32_t vertex = indices[t * 3 + i];
+			if (time - timestamps[vertex] > POST_TRANSFORM_CACHE_SIZE)
+			{
+				timestamps[vertex] = time++;
+				misses++;
+			}
+		}
+
+		if (misses == 3 && t - clusterStarts.back() >= MIN_OVERDRAW_CLUSTER)
+		{
+			clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+
+	const size_t clusterCount = clusterStarts.size() - 1;
+	if (clusterCount < 2) return;
+
+	// Centre of the whole mesh
+	XMVECTOR meshCentre = XMVectorZero();
+	for (auto& vertex : vertices)
+	{
+		meshCentre = XMVectorAdd(meshCentre, XMLoadFloat3(&vertex.Pos));
+	}
+	meshCentre = XMVectorScale(meshCentre, 1.0f / float(vertices.size()));
+
+	// Clusters facing away from the centre are most likely to occlude the rest, so draw them first
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3]].Pos);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].Pos);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].Pos);
+
+			// Area weighted normal and centre
+			XMVECTOR cross = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+			float triangleArea = XMVectorGetX(XMVector3Length(cross));
+
+			centroid = XMVectorAdd(centroid, XMVectorScale(XMVectorAdd(XMVectorAdd(p0, p1), p2), triangleArea / 3.0f));
+			normal = XMVectorAdd(normal, cross);
+			area += triangleArea;
+		}
+
+		if (area > 0.0f) centroid = XMVectorScale(centroid, 1.0f / area);
+		sortKeys[c] = XMVectorGetX(XMVector3Dot(XMVectorSubtract(centroid, meshCentre), XMVector3Normalize(normal)));
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	// Rebuild the index buffer in cluster order
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (auto cluster : order)
+	{
+		output.insert(output.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<Vertex> newVertices;
+	newVertices.reserve(vertices.size());
+
+	// Vertices are laid out in the order the index buffer first touches them
+	for (auto& index : indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = (uint32_t)newVertices.size();
+			newVertices.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(newVertices);
+}
+
+float MeshOptimizer::CalculateACMR(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return 0.0f;
+
+	// Simulate a FIFO cache using timestamps
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	size_t misses = 0;
+
+	for (auto index : indices)
+	{
+		if (time - timestamps[index] > uint32_t(cacheSize))
+		{
+			timestamps[index] = time++;
+			misses++;
+		}
+	}
+
+	return float(misses) / float(triangleCount);
+}
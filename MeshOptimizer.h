@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Utility.h"
+#include <vector>
+#include <cstdint>
+
+// Post-transform cache size used when measuring meshes
+const int POST_TRANSFORM_CACHE_SIZE = 16;
+
+// Results of optimizing a single mesh
+struct MeshOptimizerStats
+{
+	float ACMRBefore = 0.0f;
+	float ACMRAfter = 0.0f;
+	UINT VerticesBefore = 0;
+	UINT VerticesAfter = 0;
+	UINT BytesBefore = 0;
+	UINT BytesAfter = 0;
+	UINT Triangles = 0;
+	bool ShortIndices = false;
+
+	// Combine with another mesh's results, ACMR is weighted by triangle count
+	void Add(const MeshOptimizerStats& other)
+	{
+		UINT triangles = Triangles + other.Triangles;
+		if (triangles > 0)
+		{
+			ACMRBefore = (ACMRBefore * Triangles + other.ACMRBefore * other.Triangles) / triangles;
+			ACMRAfter = (ACMRAfter * Triangles + other.ACMRAfter * other.Triangles) / triangles;
+		}
+		Triangles = triangles;
+		VerticesBefore += other.VerticesBefore;
+		VerticesAfter += other.VerticesAfter;
+		BytesBefore += other.BytesBefore;
+		BytesAfter += other.BytesAfter;
+	}
+};
+
+// Reorders geometry before it is uploaded so the GPU does less work per triangle
+class MeshOptimizer
+{
+public:
+	// Run every stage on the mesh geometry and return the stats
+	static MeshOptimizerStats Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	// Reorder triangles to reuse post-transform cache entries (Forsyth's linear-speed algorithm)
+	static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+	// Reorder clusters of triangles so outward facing ones are drawn first, without breaking cache order
+	static void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices);
+
+	// Reorder vertices by first use and drop any that are not referenced
+	static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	// Average cache miss ratio - vertex shader invocations per triangle
+	static float CalculateACMR(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = POST_TRANSFORM_CACHE_SIZE);
+
+	// Can the index buffer be stored in 16 bits
+	static bool CanUseShortIndices(size_t vertexCount) { return vertexCount <= 0xFFFF; }
+};
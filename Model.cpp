@@ -1,75 +1,89 @@
 #include "Model.h"
+#include "Graphics.h"
+#include "TexturePacker.h"
+#include "TextureArrayBuilder.h"
+#include <map>
 #include <regex>
-#include <DDSTextureLoader.h>
-#include <WICTextureLoader.h>
-#include <ResourceUploadBatch.h>
 #include <iostream>
 
-Model::Model(std::string fileName, ID3D12GraphicsCommandList* commandList, Mesh* mesh, string texOverride)
+Model::Model(std::string fileName, ID3D12GraphicsCommandList* commandList, Mesh* mesh, string texOverride, bool async)
 {
 	mTexOverride = texOverride;
+	mObjectID = Objects->Add();
 
 	if (mesh == nullptr)
 	{
-		Assimp::Importer importer;
-
-		const aiScene* scene = importer.ReadFile(fileName,
-			aiProcess_Triangulate |
-			aiProcess_JoinIdenticalVertices |
-			aiProcess_ImproveCacheLocality |
-			aiProcess_RemoveRedundantMaterials |
-			aiProcess_SortByPType |
-			aiProcess_FindInvalidData |
-			aiProcess_PreTransformVertices |
-			aiProcess_MakeLeftHanded |
-			//aiProcess_OptimizeMeshes |
-			//aiProcess_OptimizeGraph |
-			//aiProcess_FlipUVs |
-			//aiProcess_GenUVCoords|
-			//aiProcess_TransformUVCoords|
-			aiProcess_CalcTangentSpace |
-			aiProcess_ConvertToLeftHanded);
-
-		if (!scene)
-		{
-			// Output assimp error
-			string str = "Error importing models : " + string(importer.GetErrorString());
-			wstring wstr(str.begin(), str.end());
-			LPCWSTR lstr(wstr.c_str());
-			MessageBox(0, lstr, L"Error", MB_OK);
-		}
-
 		// Save dir and file name
 		mDirectory = fileName.substr(0, fileName.find_last_of('/'));
 		mFileName = fileName.substr(fileName.find_last_of('/') + 1, fileName.find_last_of('.') - fileName.find_last_of('/') - 1);
-		
-		// Process scene nodes
-		ProcessNode(scene->mRootNode, scene);
 
-		// Set textured to true if textures found
-		for (auto mesh : mMeshes)
+		// Geometry is imported once per file and shared with every other model using it
+		if (async)
 		{
-			if (mesh->mTextures.size() > 0)
-			{
-				mTextured = true;
-			}
+			mAssetFuture = ModelAssets->LoadAsync(fileName);
 		}
-		
-		// Calculate buffer data for meshes
-		for (auto& mesh : mMeshes)
+		else
 		{
-			mesh->CalculateBufferData(D3DDevice.Get(), commandList);
+			const ModelAsset* asset = ModelAssets->Load(fileName);
+			if (asset) BuildMeshes(asset);
 		}
 	}
 	else
 	{
 		// Use mesh from constructor
 		mConstructorMesh = mesh;
+		mReady = true;
+	}
+}
+
+bool Model::Update()
+{
+	if (mReady || !mAssetFuture.valid()) return false;
+	if (mAssetFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+
+	const ModelAsset* asset = mAssetFuture.get();
+	mAssetFuture = ModelAssetFuture();
+	if (!asset) return false;
+
+	BuildMeshes(asset);
+	return true;
+}
+
+void Model::BuildMeshes(const ModelAsset* asset)
+{
+	// Decode every map on worker threads while the meshes are built
+	PrefetchTextures(asset);
+
+	// Build this model's materials over the shared geometry
+	for (auto& assetMesh : asset->Meshes)
+	{
+		mMeshes.push_back(ProcessMesh(assetMesh, asset));
+		if (mMeshes.size() == 1) mLocalBounds = mMeshes.back()->GetBounds();
+		else BoundingBox::CreateMerged(mLocalBounds, mLocalBounds, mMeshes.back()->GetBounds());
+	}
+	BuildTextureArrays();
+	Textures->CancelPrefetches();
+
+	// Set textured to true if textures found
+	for (auto mesh : mMeshes)
+	{
+		if (mesh->mTextures.size() > 0)
+		{
+			mTextured = true;
+		}
 	}
+
+	// Materials without height maps turn parallax off
+	Objects->Set(mObjectID, mWorldMatrix, mParallax);
+
+	mReady = true;
 }
 
 Model::~Model()
 {
+	if (mSpatialProxy >= 0 && SceneIndex) SceneIndex->Remove(mSpatialProxy);
+	if (Objects) Objects->Remove(mObjectID);
+
 	for (auto& mesh : mMeshes)
 	{
 		delete mesh;
@@ -78,41 +92,23 @@ Model::~Model()
 
 void Model::Draw(ID3D12GraphicsCommandList* commandList)
 {
-	// Get reference to current per object constant buffer
-	auto objectCB = FrameResources[CurrentFrameResourceIndex]->mPerObjectConstantBuffer->GetBuffer();
-
-	// Get size of the per object constant buffer 
-	UINT objCBByteSize = CalculateConstantBufferSize(sizeof(PerObjectConstants));
-
-	auto matCB = FrameResources[CurrentFrameResourceIndex]->mPerMaterialConstantBuffer->GetBuffer();
-
-	UINT matCBByteSize = CalculateConstantBufferSize(sizeof(PerMaterialConstants));
-
-	// Offset to the CBV for this object
-	auto objCBAddress = objectCB->GetGPUVirtualAddress() + mObjConstantBufferIndex * objCBByteSize;
-	commandList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-
-	// If not using mesh from constructor
+	// Still streaming in
+	if (!mReady) return;
+
+	// This object's constants for this draw
+	PerObjectConstants objectConstants;
+	XMStoreFloat4x4(&objectConstants.WorldMatrix, XMMatrixTranspose(XMLoadFloat4x4(&mWorldMatrix)));
+	objectConstants.parallax = mParallax;
+	D3D12_GPU_VIRTUAL_ADDRESS objectAddress = FrameResources[CurrentFrameResourceIndex]->mConstants->Allocate(objectConstants);
+	if (!objectAddress) return;
+	commandList->SetGraphicsRootConstantBufferView(1, objectAddress);
+
+	// Materials and their textures are found in the frame's tables by index, so each mesh only passes its material index
 	if (!mConstructorMesh)
 	{
 		for (auto& mesh : mMeshes)
 		{
-			if (mTextured)
-			{
-				if (mesh->mMaterial->DiffuseSRVIndex > -1)
-				{
-					// Offset to texture diffuse SRV from model
-					CD3DX12_GPU_DESCRIPTOR_HANDLE tex(SrvDescriptorHeap->mHeap->GetGPUDescriptorHandleForHeapStart());
-					tex.Offset(mesh->mMaterial->DiffuseSRVIndex, CbvSrvUavDescriptorSize);
-					commandList->SetGraphicsRootDescriptorTable(0, tex);
-				}		
-			}
-
-			// Offset to Mat CBV for this mesh
-			D3D12_GPU_VIRTUAL_ADDRESS matCBAddress;
-			matCBAddress = matCB->GetGPUVirtualAddress() + mesh->mMaterial->CBIndex * matCBByteSize;
-			commandList->SetGraphicsRootConstantBufferView(3, matCBAddress);
-
+			commandList->SetGraphicsRoot32BitConstant(6, mesh->mMaterial->CBIndex, 1);
 			mesh->Draw(commandList);
 		}
 	}
@@ -120,9 +116,7 @@ void Model::Draw(ID3D12GraphicsCommandList* commandList)
 	{
 		if (mConstructorMesh->mMaterial)
 		{
-			// Use constructor mesh's matCB index
-			D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + mConstructorMesh->mMaterial->CBIndex * matCBByteSize;
-			commandList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+			commandList->SetGraphicsRoot32BitConstant(6, mConstructorMesh->mMaterial->CBIndex, 1);
 		}
 
 		mConstructorMesh->Draw(commandList);
@@ -147,90 +141,37 @@ void Model::SetScale(XMFLOAT3 scale, bool Update)
 	if (Update) UpdateWorldMatrix();
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene)
+void Model::PrefetchTextures(const ModelAsset* asset)
 {
-	// Process each mesh
-	for (int i = 0; i < node->mNumMeshes; i++)
-	{
-		// Node only indexes objects in the scene
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		mMeshes.push_back(ProcessMesh(mesh, scene));
-	}
+	// The same material paths ProcessMesh uses, only materials that load a full table
+	std::vector<std::wstring> materialPaths;
+	string name = mDirectory + "/" + (mTexOverride == "" ? mFileName : mTexOverride);
+	materialPaths.push_back(std::wstring(name.begin(), name.end()));
 
-	// Process each child node
-	for (int i = 0; i < node->mNumChildren; i++)
+	for (auto& assetMaterial : asset->Materials)
 	{
-		ProcessNode(node->mChildren[i], scene);
+		string str = mDirectory + "/" + assetMaterial.Name.C_Str();
+		std::wstring wstr(str.begin(), str.end());
+		if (TextureFiles->HasMap(wstr, TextureMap::Roughness)) materialPaths.push_back(wstr);
 	}
-}
-
-Mesh* Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
-{
-	// Make a new mesh
-	auto newMesh = new Mesh();
 
-	// For each vertex, extract information
-	for (int i = 0; i < mesh->mNumVertices; i++)
+	for (auto& materialPath : materialPaths)
 	{
-		Vertex vertex;
-
-		if (mesh->HasPositions())
-		{
-			vertex.Pos.x = mesh->mVertices[i].x;
-			vertex.Pos.y = mesh->mVertices[i].y;
-			vertex.Pos.z = mesh->mVertices[i].z;
-		}
-
-		if (mesh->HasNormals())
-		{
-			vertex.Normal.x = mesh->mNormals[i].x;
-			vertex.Normal.y = mesh->mNormals[i].y;
-			vertex.Normal.z = mesh->mNormals[i].z;
-		}
-
-		if (mesh->HasVertexColors(i))
-		{
-			vertex.Colour.x = mesh->mColors[i]->r;
-			vertex.Colour.y = mesh->mColors[i]->g;
-			vertex.Colour.z = mesh->mColors[i]->b;
-			vertex.Colour.w = mesh->mColors[i]->a;
-		}
-		else
-		{
-			vertex.Colour = { 0.1,0.1,0,0 };
-		}
-
-		if (mesh->mTextureCoords[0])
-		{
-			XMFLOAT2 vec;
-			vec.x = mesh->mTextureCoords[0][i].x;
-			vec.y = mesh->mTextureCoords[0][i].y;
-			vertex.UV = vec;
-		}
-		else
-		{
-			vertex.UV = XMFLOAT2(0.0f, 0.0f);
-		}
+		if (!TextureFiles->HasMap(materialPath, TextureMap::Albedo)) continue;
 
-		if (mesh->HasTangentsAndBitangents())
+		for (int map = 0; map < MATERIAL_TEXTURE_COUNT; ++map)
 		{
-			vertex.Tangent.x = mesh->mTangents[i].x;
-			vertex.Tangent.y = mesh->mTangents[i].y;
-			vertex.Tangent.z = mesh->mTangents[i].z;
+			auto path = TextureFiles->Find(materialPath, (TextureMap)map);
+			if (!path.empty()) Textures->Prefetch(path);
 		}
-
-		newMesh->mVertices.push_back(vertex);
 	}
+}
 
-	// For each face extract indices
-	for (int i = 0; i < mesh->mNumFaces; i++)
-	{
-		aiFace face = mesh->mFaces[i];
-		for (int j = 0; j < face.mNumIndices; j++)
-		{
-			newMesh->mIndices.push_back(face.mIndices[j]);
-		}
-	}
+Mesh* Model::ProcessMesh(const ModelAssetMesh& assetMesh, const ModelAsset* asset)
+{
+	// Make a new mesh that draws the cached geometry
+	auto newMesh = new Mesh();
+	newMesh->mSharedGeometry = assetMesh.Geometry;
 
 	// Create new material
 	newMesh->mMaterial = new Material();
@@ -253,905 +194,289 @@ Mesh* Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
 
 	auto matName = newMesh->mMaterial->Name;
 
-	// Create resource upload batch
-	auto device = D3DDevice.Get();
-	ResourceUploadBatch upload(device);
-	upload.Begin();
-
-	// Make a new texture
-	newMesh->mTextures.push_back(new Texture());
-	auto texIndex = 0;
-
-	// Test for albedo map using model name
-	newMesh->mTextures[texIndex]->Path = matName + L"-albedo.dds";
-	DDS_ALPHA_MODE mode = DDS_ALPHA_MODE_OPAQUE;
-	CreateDDSTextureFromFileEx(D3DDevice.Get(), upload, newMesh->mTextures[texIndex]->Path.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
-		(DirectX::DX12::DDS_LOADER_FLAGS)(DirectX::DX12::DDS_LOADER_DEFAULT) | DirectX::DX12::DDS_LOADER_MIP_AUTOGEN,
-		newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), &mode, false);
-	
-	// If texture found, set DDS to true and set model as textured per model.
-	if (newMesh->mTextures[texIndex]->Resource != nullptr)
+	// Textured per model if an albedo map exists for the model name
+	if (TextureFiles->HasMap(matName, TextureMap::Albedo))
 	{
 		mModelTextured = true;
-		mDDS = true;
-	}
 
-	// Test other file extensions if DDS not found
-	if (!mDDS)
-	{
-		// Test jpg
-		newMesh->mTextures[texIndex]->Path = matName + L"_albedo.jpg";
-		CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		if (!newMesh->mTextures[texIndex]->Resource)
+		// Every map gets a descriptor, missing ones use a default texture
+		LoadTextureMaps(newMesh, matName);
+
+		// Extract PBR info
+		if (assetMesh.MaterialIndex >= 0)
 		{
-			// Test png
-			newMesh->mTextures[texIndex]->Path = matName + L"_albedo.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-			if (!newMesh->mTextures[texIndex]->Resource)
-			{
-				// No textures found
-				newMesh->mMaterial = nullptr;
-				newMesh->mTextures.clear();
-				mModelTextured = false;
-			}
-			else { mModelTextured = true; mPNG = true; };
+			auto& assetMaterial = asset->Materials[assetMesh.MaterialIndex];
+			newMesh->mMaterial->DiffuseAlbedo = assetMaterial.DiffuseAlbedo;
+			newMesh->mMaterial->Roughness = assetMaterial.Roughness;
+			newMesh->mMaterial->Metalness = assetMaterial.Metalness;
 		}
-		else { mModelTextured = true; mJPG = true; };
 	}
-
-	// If textures found, load the rest
-	if(mModelTextured)
+	else
 	{
-		// Load albedo
-		auto modelTex = newMesh->mTextures[texIndex]->Resource;
-
-		// Fill out the heap with descriptors
-		CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(SrvDescriptorHeap->mHeap->GetCPUDescriptorHandleForHeapStart());
-		
-		// Offset to next descriptor
-		hDescriptor.Offset(CurrentSRVOffset, CbvSrvUavDescriptorSize);
-
-		// Set material SRVIndex
-		newMesh->mMaterial->DiffuseSRVIndex = CurrentSRVOffset;
-
-		// Create descriptor
-		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = modelTex->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = modelTex->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-		// Create SRV
-		device->CreateShaderResourceView(modelTex.Get(), &srvDesc, hDescriptor);
-
-		// Create new texture and increment index
-		newMesh->mTextures.push_back(new Texture());
-		texIndex++;
-
-		// Load correct file type
-		if (mDDS)
-		{			
-			newMesh->mTextures[texIndex]->Path = matName + L"-roughness.dds";
-			DDS_ALPHA_MODE mode = DDS_ALPHA_MODE_OPAQUE;
-			CreateDDSTextureFromFileEx(D3DDevice.Get(), upload, newMesh->mTextures[texIndex]->Path.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
-				(DirectX::DX12::DDS_LOADER_FLAGS)(DirectX::DX12::DDS_LOADER_DEFAULT) | DirectX::DX12::DDS_LOADER_MIP_AUTOGEN,
-				newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), &mode, false);
-		}
-		else if (mJPG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_roughness.jpg";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), true);
-		}
-		else if(mPNG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_roughness.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), true);
-		}
-
-		// Offset to next descriptor
-		hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
+		mModelTextured = false;
 
-		// If no textures found, load missing texture
-		auto modelRough = newMesh->mTextures[texIndex]->Resource;
-		if (!modelRough) 
+		// Process base materials
+		if (!asset->Materials.empty())
 		{
-			newMesh->mTextures[texIndex]->Path = L"Models/missing.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), true);
-			modelRough = newMesh->mTextures[texIndex]->Resource;
-		}
-
-		// Create descriptor
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = modelRough->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = modelRough->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-		// Create SRV
-		device->CreateShaderResourceView(modelRough.Get(), &srvDesc, hDescriptor);
+			if (assetMesh.MaterialIndex >= 0)
+			{
+				auto& assetMaterial = asset->Materials[assetMesh.MaterialIndex];
 
-		// Load normal texture
-		newMesh->mTextures.push_back(new Texture());
-		texIndex++;
+				// Get material name
+				aiString materialName = assetMaterial.Name;
+				newMesh->mMaterial->AiName = materialName;
 
-		// Load correct file type
-		if (mDDS)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"-normal.dds";
-			DDS_ALPHA_MODE mode = DDS_ALPHA_MODE_OPAQUE;
-			CreateDDSTextureFromFileEx(D3DDevice.Get(), upload, newMesh->mTextures[texIndex]->Path.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
-				(DirectX::DX12::DDS_LOADER_FLAGS)(DirectX::DX12::DDS_LOADER_DEFAULT) | DirectX::DX12::DDS_LOADER_MIP_AUTOGEN,
-				newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), &mode, false);
-		}
-		else if (mJPG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_normal.jpg";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
-		else if (mPNG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_normal.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
+				// Load textures from aiMat name if exist
+				string str = mDirectory + "/" + materialName.C_Str();
+				wstring wstr(str.begin(), str.end());
 
-		// Offset to next descriptor
-		hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
+				if (TextureFiles->HasMap(wstr, TextureMap::Albedo))
+				{
+					mPerMeshTextured = true;
 
-		auto modelNorm = newMesh->mTextures[texIndex]->Resource;
+					// Full PBR set if there is a roughness map, otherwise albedo only
+					if (TextureFiles->HasMap(wstr, TextureMap::Roughness)) mPerMeshPBR = true;
 
-		// Load missing texture if normal map not found
-		if (!modelNorm)
-		{
-			newMesh->mTextures[texIndex]->Path = L"Models/missing.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-			modelNorm = newMesh->mTextures[texIndex]->Resource;
+					if (mPerMeshPBR)
+					{
+						LoadTextureMaps(newMesh, wstr);
+					}
+					else
+					{
+						// Grouped into texture arrays once every mesh is known
+						mArrayMaterials.push_back({ newMesh, wstr });
+					}
+				}
 
+				newMesh->mMaterial->DiffuseAlbedo = assetMaterial.DiffuseAlbedo;
+				newMesh->mMaterial->Roughness = assetMaterial.Roughness;
+				newMesh->mMaterial->Metalness = assetMaterial.Metalness;
+			}
 		}
+	}
 
-		// Create descriptor
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = modelNorm->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = modelNorm->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-		// Create SRV
-		device->CreateShaderResourceView(modelNorm.Get(), &srvDesc, hDescriptor);
+	return newMesh;
+}
 
-		// Load metalness texture
-		newMesh->mTextures.push_back(new Texture());
-		texIndex++;
+void Model::BuildTextureArrays()
+{
+	if (mArrayMaterials.empty()) return;
 
-		// Load correct file type
-		if (mDDS)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"-metalness.dds";
-			DDS_ALPHA_MODE mode = DDS_ALPHA_MODE_OPAQUE;
-			CreateDDSTextureFromFileEx(D3DDevice.Get(), upload, newMesh->mTextures[texIndex]->Path.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
-				(DirectX::DX12::DDS_LOADER_FLAGS)(DirectX::DX12::DDS_LOADER_DEFAULT) | DirectX::DX12::DDS_LOADER_MIP_AUTOGEN,
-				newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), &mode, false);
-		}
-		else if (mJPG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_metalness.jpg";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
-		else if (mPNG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_metalness.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
-		
-		// Load white texture if no metalness map
-		auto modelMetal = newMesh->mTextures[texIndex]->Resource;
-		if (!modelMetal)
+	// Drawn with the PBR shader, which does not read arrays, so these keep a plain albedo table
+	if (mPerMeshPBR)
+	{
+		for (auto& [mesh, materialPath] : mArrayMaterials)
 		{
-			newMesh->mTextures[texIndex]->Path = L"Models/default.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-			modelMetal = newMesh->mTextures[texIndex]->Resource;
+			LoadTextureMaps(mesh, materialPath, 1);
 		}
+		mArrayMaterials.clear();
+		return;
+	}
 
-		hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-
-		// Create descriptor
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = modelMetal->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = modelMetal->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+	// Group albedo maps by size class, each distinct file gets one slice
+	struct Group
+	{
+		std::vector<std::wstring> Sources;
+		int SRVIndex = -1;
+		TextureHandle Array;
 
-		// Create SRV
-		device->CreateShaderResourceView(modelMetal.Get(), &srvDesc, hDescriptor);
+		// The array could not be built, so every material in it samples the one slice of the default white array
+		bool Fallback = false;
+	};
+	std::map<size_t, Group> groups;
+	std::vector<std::pair<size_t, int>> slices;
 
-		// Load height texture
-		newMesh->mTextures.push_back(new Texture());
-		texIndex++;
+	for (auto& [mesh, materialPath] : mArrayMaterials)
+	{
+		auto path = TextureFiles->Find(materialPath, TextureMap::Albedo);
+		size_t size = TextureArrayBuilder::GetSizeClass(path);
 
-		// Load correct file type
-		if (mDDS)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"-height.dds";
-			DDS_ALPHA_MODE mode = DDS_ALPHA_MODE_OPAQUE;
-			CreateDDSTextureFromFileEx(D3DDevice.Get(), upload, newMesh->mTextures[texIndex]->Path.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
-				(DirectX::DX12::DDS_LOADER_FLAGS)(DirectX::DX12::DDS_LOADER_DEFAULT) | DirectX::DX12::DDS_LOADER_MIP_AUTOGEN,
-				newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), &mode, false);
-		}
-		else if (mJPG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_height.jpg";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
-		else if (mPNG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_height.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
+		auto& sources = groups[size].Sources;
+		auto slice = std::find(sources.begin(), sources.end(), path);
+		if (slice == sources.end()) slice = sources.insert(sources.end(), path);
+		slices.push_back({ size, (int)(slice - sources.begin()) });
+	}
 
-		// Load white texture if no height map
-		auto modelHeight = newMesh->mTextures[texIndex]->Resource;
-		if (!modelHeight)
-		{
-			newMesh->mTextures[texIndex]->Path = L"Models/default.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-			modelHeight = newMesh->mTextures[texIndex]->Resource;
-			mParallax = false;
-		}
-		
-		// Offset to next descriptor
-		hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-
-		// Create SRV descriptor
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = modelHeight->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = modelHeight->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-		// Create SRV
-		device->CreateShaderResourceView(modelHeight.Get(), &srvDesc, hDescriptor);
-
-		// Load ao map
-		newMesh->mTextures.push_back(new Texture());
-		texIndex++;
-
-		// Load correct file type
-		if (mDDS)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"-ao.dds";
-			DDS_ALPHA_MODE mode = DDS_ALPHA_MODE_OPAQUE;
-			CreateDDSTextureFromFileEx(D3DDevice.Get(), upload, newMesh->mTextures[texIndex]->Path.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
-				(DirectX::DX12::DDS_LOADER_FLAGS)(DirectX::DX12::DDS_LOADER_DEFAULT) | DirectX::DX12::DDS_LOADER_MIP_AUTOGEN,
-				newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), &mode, false);
-		}
-		else if (mJPG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_ao.jpg";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
-		else if (mPNG)
+	// One descriptor per array, shared by every material in it
+	for (auto& [size, group] : groups)
+	{
+		if (size > 0) group.Array = Textures->LoadArray(group.Sources, size);
+		if (!group.Array || group.Array->DescriptorIndex < 0)
 		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_ao.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
+			// The shader always reads these materials as an array, so they need one even without their maps
+			group.Array = Textures->LoadDefaultArray();
+			group.Fallback = true;
+			if (!group.Array || group.Array->DescriptorIndex < 0) continue;
 		}
 
-		// Load white texture if no AO
-		auto modelAO = newMesh->mTextures[texIndex]->Resource;
-		if (!modelAO)
-		{
-			newMesh->mTextures[texIndex]->Path = L"Models/default.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-			modelAO = newMesh->mTextures[texIndex]->Resource;
-		}
+		group.SRVIndex = AllocateTableDescriptors(1);
+		if (group.SRVIndex < 0) continue;
 
-		// Offset to next descriptor
-		hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-		
-		// Create SRV descriptor
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = modelAO->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = modelAO->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-		// Create SRV
-		device->CreateShaderResourceView(modelAO.Get(), &srvDesc, hDescriptor);
-
-		// Load emissive map
-		newMesh->mTextures.push_back(new Texture());
-		texIndex++;
-
-		// Load correct file type
-		if (mDDS)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"-emissive.dds";
-			DDS_ALPHA_MODE mode = DDS_ALPHA_MODE_OPAQUE;
-			CreateDDSTextureFromFileEx(D3DDevice.Get(), upload, newMesh->mTextures[texIndex]->Path.c_str(), 0, D3D12_RESOURCE_FLAG_NONE,
-				(DirectX::DX12::DDS_LOADER_FLAGS)(DirectX::DX12::DDS_LOADER_DEFAULT) | DirectX::DX12::DDS_LOADER_MIP_AUTOGEN,
-				newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), &mode, false);
-		}
-		else if (mJPG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_emissive.jpg";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
-		else if (mPNG)
-		{
-			newMesh->mTextures[texIndex]->Path = matName + L"_emissive.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-		}
+		CD3DX12_CPU_DESCRIPTOR_HANDLE source(SrvDescriptorHeap->mHeap->GetCPUDescriptorHandleForHeapStart());
+		source.Offset(group.Array->DescriptorIndex, CbvSrvUavDescriptorSize);
+		CD3DX12_CPU_DESCRIPTOR_HANDLE destination(SrvDescriptorHeap->mHeap->GetCPUDescriptorHandleForHeapStart());
+		destination.Offset(group.SRVIndex, CbvSrvUavDescriptorSize);
+		D3DDevice->CopyDescriptorsSimple(1, destination, source, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	}
 
-		// Load black texture if no emissive
-		auto modelEmissive = newMesh->mTextures[texIndex]->Resource;
-		if (!modelEmissive)
-		{
-			newMesh->mTextures[texIndex]->Path = L"Models/defaultBlack.png";
-			CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-			modelEmissive = newMesh->mTextures[texIndex]->Resource;
-		}
+	for (size_t i = 0; i < mArrayMaterials.size(); ++i)
+	{
+		auto mesh = mArrayMaterials[i].first;
+		auto& group = groups[slices[i].first];
 
-		// Offset to next descriptor
-		hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
+		auto texture = new Texture();
+		texture->Path = group.Sources[slices[i].second];
+		texture->Cached = group.Array;
+		if (texture->Cached) texture->Resource = texture->Cached->Resource;
+		mesh->mTextures.push_back(texture);
 
-		// Create SRV descriptor
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = modelEmissive->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = modelEmissive->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+		mesh->mMaterial->DiffuseSRVIndex = group.SRVIndex;
+		mesh->mMaterial->TextureSlice = group.Fallback ? 0 : slices[i].second;
+	}
 
-		// Create SRV
-		device->CreateShaderResourceView(modelEmissive.Get(), &srvDesc, hDescriptor);
+	// Meshes sharing an array draw back to back without a table change
+	std::stable_sort(mMeshes.begin(), mMeshes.end(), [](Mesh* a, Mesh* b)
+	{
+		return a->mMaterial->DiffuseSRVIndex < b->mMaterial->DiffuseSRVIndex;
+	});
 
-		// Load assimp material
-		aiMaterial* assimpMaterial = scene->mMaterials[mesh->mMaterialIndex];
-		
-		// Extract PBR info
-		aiColor4D diffuseColour;
-		assimpMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, diffuseColour);
-		newMesh->mMaterial->DiffuseAlbedo = XMFLOAT4{ diffuseColour.r,diffuseColour.g,diffuseColour.b,diffuseColour.a };
+	mArrayMaterials.clear();
+}
 
-		float roughness = 0.0f;
-		assimpMaterial->Get(AI_MATKEY_ROUGHNESS_FACTOR, roughness);
-		newMesh->mMaterial->Roughness = roughness;
+void Model::LoadTextureMaps(Mesh* mesh, const std::wstring& materialPath, int count)
+{
+	// Default for each map when the material does not have one, the packed map fills its own gaps
+	static const wchar_t* fallbacks[] =
+	{
+		nullptr,
+		L"Models/missing.png",
+		nullptr,
+		L"Models/defaultBlack.png",
+	};
 
-		float metalness = 0.0f;
-		assimpMaterial->Get(AI_MATKEY_METALLIC_FACTOR, metalness);
-		newMesh->mMaterial->Metalness = metalness;
+	// No parallax without a height map
+	if (count > (int)TextureMap::Packed && !TextureFiles->HasMap(materialPath, TextureMap::Height)) mParallax = false;
 
-		// Offset SRV index
-		CurrentSRVOffset += 7;
+	// Streamed textures change resource, so each frame resource gets its own copy of the table
+	// Without room for the tables the textures are still loaded, but nothing is written for them
+	mesh->mMaterial->DiffuseSRVIndex = AllocateTableDescriptors(count * Graphics::mNumFrameResources);
+	mesh->mMaterial->SRVFrameStride = count;
 
-		// Finish upload
-		auto finish = upload.End(CommandQueue.Get());
-		finish.wait();
-	}
-	else
+	for (int map = 0; map < count; map++)
 	{
-		// Process base materials
-		if (scene->HasMaterials())
+		auto texture = new Texture();
+		texture->Path = TextureFiles->Find(materialPath, (TextureMap)map);
+
+		// Textures are shared engine-wide, new ones are queued on the upload manager and sent with the next submit
+		if ((TextureMap)map == TextureMap::Packed && texture->Path.empty())
 		{
-			if (mesh->mMaterialIndex >= 0)
+			// Not packed offline, so pack the single channel maps now
+			std::wstring sources[TexturePacker::CHANNEL_COUNT];
+			for (int i = 0; i < TexturePacker::CHANNEL_COUNT; ++i)
 			{
-				auto numMaterials = scene->mNumMaterials;
-				aiMaterial* assimpMaterial = scene->mMaterials[mesh->mMaterialIndex];
-			
-				// Diffuse maps
-				//vector<Texture*> diffuseMaps = LoadMaterialTextures(assimpMaterial, aiTextureType_DIFFUSE, "texture_diffuse", scene);
-				//newMesh->mTextures.insert(newMesh->mTextures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-				// Base Colour maps
-				//vector<Texture*> baseColourMaps = LoadMaterialTextures(assimpMaterial, aiTextureType_BASE_COLOR, "texture_base_colour", scene);
-				//newMesh->mTextures.insert(newMesh->mTextures.end(), baseColourMaps.begin(), baseColourMaps.end());
-
-				// Create new material
-				newMesh->mMaterial = new Material;
-
-				// Get material name
-				aiString materialName;
-				assimpMaterial->Get(AI_MATKEY_NAME, materialName);
-				newMesh->mMaterial->AiName = materialName;
-
-				bool thisMeshTextured = false;
-				// Load textures from aiMat name if exist
-
-				// Test for albedo map using mesh material name
-				newMesh->mTextures.push_back(new Texture());
-				auto texIndex = 0;
-				
-				string str = mDirectory + "/" + materialName.C_Str();
-				wstring wstr(str.begin(), str.end());
-				newMesh->mTextures[texIndex]->Path = wstr + L"_albedo.dds";				
-				
-
-				if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-				{
-					CreateDDSTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-				}
-				
-				// If albedo dds found
-				if (newMesh->mTextures[texIndex]->Resource != nullptr)
-				{
-					mPerMeshTextured = true;
-					thisMeshTextured = true;
-					mDDS = true;
-				}
-
-				// Test other file extensions if DDS not found
-				if (!mDDS)
-				{
-					// Test jpg
-					newMesh->mTextures[texIndex]->Path = wstr + L"_albedo.jpg";
-					if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-					{
-						CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-					}
-					if (!newMesh->mTextures[texIndex]->Resource)
-					{
-						// Test png
-						newMesh->mTextures[texIndex]->Path = wstr + L"_albedo.png";
-						if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-						{
-							CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-						}
-						if (!newMesh->mTextures[texIndex]->Resource)
-						{
-							// No textures found
-							//newMesh->mMaterial = nullptr;
-							newMesh->mTextures.clear();
-							thisMeshTextured = false;
-						}
-						else { mPerMeshTextured = true; thisMeshTextured = true; mPNG = true; };
-					}
-					else { mPerMeshTextured = true; thisMeshTextured = true; mJPG = true; };
-				}
-
-				if (thisMeshTextured)
-				{
-					// Fill out the heap with actual descriptors.
-					CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(SrvDescriptorHeap->mHeap->GetCPUDescriptorHandleForHeapStart());
-					// next descriptor
-					hDescriptor.Offset(CurrentSRVOffset, CbvSrvUavDescriptorSize);
-
-					newMesh->mMaterial->DiffuseSRVIndex = CurrentSRVOffset;
-
-					D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-					srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-					srvDesc.Format = newMesh->mTextures[texIndex]->Resource->GetDesc().Format;
-					srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-					srvDesc.Texture2D.MostDetailedMip = 0;
-					srvDesc.Texture2D.MipLevels = newMesh->mTextures[texIndex]->Resource->GetDesc().MipLevels;
-					srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-					device->CreateShaderResourceView(newMesh->mTextures[texIndex]->Resource.Get(), &srvDesc, hDescriptor);
-					mLoadedTextures.push_back(newMesh->mTextures[texIndex]);
-					
-					CurrentSRVOffset++;
-
-					// Test for roughness PBR texture
-					// Create new texture and increment index
-					newMesh->mTextures.push_back(new Texture());
-					texIndex++;
-
-					// Load correct file type
-					if (mDDS)
-					{
-						newMesh->mTextures[texIndex]->Path = wstr + L"_roughness.dds";
-						if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-						{
-							CreateDDSTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-						}
-					}
-					else if (mJPG)
-					{
-						newMesh->mTextures[texIndex]->Path = wstr + L"_roughness.jpg";
-						if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-						{
-							CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), true);
-						}
-					}
-					else if (mPNG)
-					{
-						newMesh->mTextures[texIndex]->Path = wstr + L"_roughness.png";
-						if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-						{
-							CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), true);
-						}
-					}
-
-					// Offset to next descriptor
-					hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-
-					auto modelRough = newMesh->mTextures[texIndex]->Resource;
-					if (modelRough)
-					{
-						mPerMeshPBR = true;
-					}
-					else { delete newMesh->mTextures[1]; }
-
-					if (mPerMeshPBR && thisMeshTextured)
-					{
-						// Create descriptor
-						srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-						srvDesc.Format = modelRough->GetDesc().Format;
-						srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-						srvDesc.Texture2D.MostDetailedMip = 0;
-						srvDesc.Texture2D.MipLevels = modelRough->GetDesc().MipLevels;
-						srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-						// Create SRV
-						device->CreateShaderResourceView(modelRough.Get(), &srvDesc, hDescriptor);
-						mLoadedTextures.push_back(newMesh->mTextures[texIndex]);
-
-						// Load normal texture
-						newMesh->mTextures.push_back(new Texture());
-						texIndex++;
-
-						// Load correct file type
-						if (mDDS)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_normal.dds";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateDDSTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mJPG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_normal.jpg";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mPNG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_normal.png";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-
-						// Offset to next descriptor
-						hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-
-						auto modelNorm = newMesh->mTextures[texIndex]->Resource;
-
-						// Load missing texture if normal map not found
-						if (!modelNorm)
-						{
-							newMesh->mTextures[texIndex]->Path = L"Models/missing.png";
-							CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							modelNorm = newMesh->mTextures[texIndex]->Resource;
-						}
-
-						// Create descriptor
-						srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-						srvDesc.Format = modelNorm->GetDesc().Format;
-						srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-						srvDesc.Texture2D.MostDetailedMip = 0;
-						srvDesc.Texture2D.MipLevels = modelNorm->GetDesc().MipLevels;
-						srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-						// Create SRV
-						device->CreateShaderResourceView(modelNorm.Get(), &srvDesc, hDescriptor);
-						mLoadedTextures.push_back(newMesh->mTextures[texIndex]);
-
-						// Load metalness texture
-						newMesh->mTextures.push_back(new Texture());
-						texIndex++;
-
-						// Load correct file type
-						if (mDDS)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_metalness.dds";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateDDSTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mJPG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_metalness.jpg";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mPNG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_metalness.png";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-
-						// Load white texture if no metalness map
-						auto modelMetal = newMesh->mTextures[texIndex]->Resource;
-						if (!modelMetal)
-						{
-							newMesh->mTextures[texIndex]->Path = L"Models/default.png";
-							CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							modelMetal = newMesh->mTextures[texIndex]->Resource;
-						}
-
-						hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-
-						// Create descriptor
-						srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-						srvDesc.Format = modelMetal->GetDesc().Format;
-						srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-						srvDesc.Texture2D.MostDetailedMip = 0;
-						srvDesc.Texture2D.MipLevels = modelMetal->GetDesc().MipLevels;
-						srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-						// Create SRV
-						device->CreateShaderResourceView(modelMetal.Get(), &srvDesc, hDescriptor);
-						mLoadedTextures.push_back(newMesh->mTextures[texIndex]);
-
-						// Load height texture
-						newMesh->mTextures.push_back(new Texture());
-						texIndex++;
-
-						// Load correct file type
-						if (mDDS)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_height.dds";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateDDSTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mJPG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_height.jpg";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mPNG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_height.png";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-
-						// Load white texture if no height map
-						auto modelHeight = newMesh->mTextures[texIndex]->Resource;
-						if (!modelHeight)
-						{
-							newMesh->mTextures[texIndex]->Path = L"Models/default.png";
-							CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							modelHeight = newMesh->mTextures[texIndex]->Resource;
-							mParallax = false;
-						}
-
-						// Offset to next descriptor
-						hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-
-						// Create SRV descriptor
-						srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-						srvDesc.Format = modelHeight->GetDesc().Format;
-						srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-						srvDesc.Texture2D.MostDetailedMip = 0;
-						srvDesc.Texture2D.MipLevels = modelHeight->GetDesc().MipLevels;
-						srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-						// Create SRV
-						device->CreateShaderResourceView(modelHeight.Get(), &srvDesc, hDescriptor);
-						mLoadedTextures.push_back(newMesh->mTextures[texIndex]);
-						
-						// Load ao map
-						newMesh->mTextures.push_back(new Texture());
-						texIndex++;
-
-						// Load correct file type
-						if (mDDS)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_ao.dds";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateDDSTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mJPG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_ao.jpg";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mPNG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_ao.png";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex])) 
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-
-						// Load white texture if no AO
-						auto modelAO = newMesh->mTextures[texIndex]->Resource;
-						if (!modelAO)
-						{
-							newMesh->mTextures[texIndex]->Path = L"Models/default.png";
-							CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							modelAO = newMesh->mTextures[texIndex]->Resource;
-						}
-
-						// Offset to next descriptor
-						hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-
-						// Create SRV descriptor
-						srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-						srvDesc.Format = modelAO->GetDesc().Format;
-						srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-						srvDesc.Texture2D.MostDetailedMip = 0;
-						srvDesc.Texture2D.MipLevels = modelAO->GetDesc().MipLevels;
-						srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-						// Create SRV
-						device->CreateShaderResourceView(modelAO.Get(), &srvDesc, hDescriptor);
-						mLoadedTextures.push_back(newMesh->mTextures[texIndex]);
-
-						// Load emissive map
-						newMesh->mTextures.push_back(new Texture());
-						texIndex++;
-
-						// Load correct file type
-						if (mDDS)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_emissive.dds";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateDDSTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mJPG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_emissive.jpg";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-						else if (mPNG)
-						{
-							newMesh->mTextures[texIndex]->Path = wstr + L"_emissive.png";
-							if (!CheckTextureLoaded(newMesh->mTextures[texIndex]))
-							{
-								CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							}
-						}
-
-						// Load black texture if no Emissive
-						auto modelEmissive = newMesh->mTextures[texIndex]->Resource;
-						if (!modelEmissive)
-						{
-							newMesh->mTextures[texIndex]->Path = L"Models/defaultBlack.png";
-							CreateWICTextureFromFile(device, upload, newMesh->mTextures[texIndex]->Path.c_str(), newMesh->mTextures[texIndex]->Resource.ReleaseAndGetAddressOf(), false);
-							modelEmissive = newMesh->mTextures[texIndex]->Resource;
-						}
-
-						// Offset to next descriptor
-						hDescriptor.Offset(1, CbvSrvUavDescriptorSize);
-
-						// Create SRV descriptor
-						srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-						srvDesc.Format = modelEmissive->GetDesc().Format;
-						srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-						srvDesc.Texture2D.MostDetailedMip = 0;
-						srvDesc.Texture2D.MipLevels = modelEmissive->GetDesc().MipLevels;
-						srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-						// Create SRV
-						device->CreateShaderResourceView(modelEmissive.Get(), &srvDesc, hDescriptor);
-						
-						mLoadedTextures.push_back(newMesh->mTextures[texIndex]);
-
-						CurrentSRVOffset += 6; // Albedo already incremented once
-					}
-					
-				}
-
-				aiColor4D diffuseColour;
-				assimpMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, diffuseColour);
-				newMesh->mMaterial->DiffuseAlbedo = XMFLOAT4{ diffuseColour.r,diffuseColour.g,diffuseColour.b,diffuseColour.a };
+				sources[i] = TextureFiles->Find(materialPath, TexturePacker::CHANNELS[i]);
+			}
+			texture->Cached = Textures->LoadPacked(sources);
+		}
+		else
+		{
+			if (!texture->Path.empty()) texture->Cached = Textures->Load(texture->Path);
+			if (!texture->Cached && fallbacks[map])
+			{
+				texture->Path = fallbacks[map];
+				texture->Cached = Textures->Load(texture->Path);
+			}
+		}
 
-				float roughness = 0.0f;
-				assimpMaterial->Get(AI_MATKEY_ROUGHNESS_FACTOR, roughness);
-				newMesh->mMaterial->Roughness = roughness;
+		if (texture->Cached) texture->Resource = texture->Cached->Resource;
 
-				float metalness = 0.0f;
-				assimpMaterial->Get(AI_MATKEY_METALLIC_FACTOR, metalness);
-				newMesh->mMaterial->Metalness = metalness;
+		if (texture->Cached) texture->Version = texture->Cached->Version;
 
-				auto finish = upload.End(CommandQueue.Get());
-				finish.wait();
-			}
+		mesh->mTextures.push_back(texture);
+		for (int frame = 0; frame < (int)Graphics::mNumFrameResources; ++frame)
+		{
+			CopyTableDescriptor(mesh, map, frame);
 		}
+	}
+}
 
+int Model::AllocateTableDescriptors(int count)
+{
+	if (CurrentSRVOffset + count > SrvDescriptorHeap->mTextureCacheStart)
+	{
+		MessageBox(0, L"Out of material descriptors", L"Error", MB_OK);
+		return -1;
 	}
 
-	return newMesh;
+	int first = CurrentSRVOffset;
+	CurrentSRVOffset += count;
+	return first;
 }
 
-vector<Texture*> Model::LoadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, const aiScene* scene)
+void Model::CopyTableDescriptor(Mesh* mesh, int map, int frame)
 {
-	vector<Texture*> textures;
+	auto cached = mesh->mTextures[map]->Cached;
+	if (!cached || cached->DescriptorIndex < 0 || mesh->mMaterial->DiffuseSRVIndex < 0) return;
+
+	// Copy the cache's descriptor into the material's table
+	CD3DX12_CPU_DESCRIPTOR_HANDLE source(SrvDescriptorHeap->mHeap->GetCPUDescriptorHandleForHeapStart());
+	source.Offset(cached->DescriptorIndex, CbvSrvUavDescriptorSize);
+	CD3DX12_CPU_DESCRIPTOR_HANDLE destination(SrvDescriptorHeap->mHeap->GetCPUDescriptorHandleForHeapStart());
+	destination.Offset(mesh->mMaterial->DiffuseSRVIndex + frame * mesh->mMaterial->SRVFrameStride + map, CbvSrvUavDescriptorSize);
+	D3DDevice->CopyDescriptorsSimple(1, destination, source, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
 
-	if (mat->GetTextureCount(type) > 0)
+void Model::UpdateTextureTables()
+{
+	if (!mReady) return;
+
+	for (auto& mesh : mMeshes)
 	{
-		for (int i = 0; i < mat->GetTextureCount(type); i++)
+		auto material = mesh->mMaterial;
+		if (!material || material->SRVFrameStride == 0) continue;
+
+		for (auto& texture : mesh->mTextures)
 		{
-			aiString str;
-			mat->GetTexture(type, i, &str);
-			bool skip = false;
-			for (int j = 0; j < mLoadedTextures.size(); j++)
+			if (texture->Cached && texture->Cached->Version != texture->Version)
 			{
-				if (mLoadedTextures[j]->AIPath == str)
-				{
-					textures.push_back(mLoadedTextures[j]);
-					skip = true; // Texture has already been laoded
-					break;
-				}
+				texture->Version = texture->Cached->Version;
+				texture->Resource = texture->Cached->Resource;
+				material->NumTableFramesDirty = Graphics::mNumFrameResources;
 			}
-			if (!skip)
+		}
+
+		// The GPU has finished with this frame resource's table, older frames are refreshed as they come round
+		if (material->NumTableFramesDirty > 0)
+		{
+			for (int map = 0; map < material->SRVFrameStride; ++map)
 			{
-				Texture* texture = new Texture();
-				const aiTexture* embeddedTexture = scene->GetEmbeddedTexture(str.C_Str());
-				if (embeddedTexture != nullptr)
-				{
-					LoadEmbeddedTexture(embeddedTexture);
-				}
-				else
-				{
-					texture->ID = LoadTextureFromFile(str.C_Str(), mDirectory);
-				}
-				texture->Type = typeName;
-				texture->AIPath = str;
-				textures.push_back(texture);
-				mLoadedTextures.push_back(texture);
+				CopyTableDescriptor(mesh, map, CurrentFrameResourceIndex);
 			}
+			material->NumTableFramesDirty--;
 		}
 	}
-	return textures;
 }
 
-int Model::LoadTextureFromFile(const char* path, string directory)
+BoundingSphere Model::GetWorldBounds() const
 {
-	// Generate texture ID and load texture data 
-	string filename = string(path);
-	filename = directory + '/' + filename;
+	// Generated meshes can change shape after the model is made
+	BoundingSphere sphere;
+	BoundingSphere::CreateFromBoundingBox(sphere, mConstructorMesh ? mConstructorMesh->GetBounds() : mLocalBounds);
+	sphere.Transform(sphere, XMLoadFloat4x4(&mWorldMatrix));
+	return sphere;
+}
 
-	// Make texture
-	//DirectX::CreateDDSTextureFromFile();
-	return 0;
+BoundingBox Model::GetWorldBox() const
+{
+	BoundingBox box;
+	(mConstructorMesh ? mConstructorMesh->GetBounds() : mLocalBounds).Transform(box, XMLoadFloat4x4(&mWorldMatrix));
+	return box;
 }
 
-void Model::LoadEmbeddedTexture(const aiTexture* embeddedTexture)
+void Model::AddToSceneIndex()
 {
-	// Unsupported as assimp sample does not work
-
-	//if (embeddedTexture->mHeight != 0)
-	//{
-	//	// Make texture
-	//	auto width = embeddedTexture->mWidth;
-	//	auto height = embeddedTexture->mHeight;
-	//}
+	if (mSpatialProxy >= 0 || !SceneIndex) return;
+	mSpatialProxy = SceneIndex->Insert(GetWorldBox(), this);
 }
 
 void Model::UpdateWorldMatrix()
@@ -1162,17 +487,10 @@ void Model::UpdateWorldMatrix()
 		* XMMatrixRotationY(mRotation.y)
 		* XMMatrixRotationZ(mRotation.z)
 		* XMMatrixTranslation(mPosition.x,mPosition.y,mPosition.z));
-}
 
-bool Model::CheckTextureLoaded(Texture* texture)
-{
-	for (auto loadedTex : mLoadedTextures)
-	{
-		if (texture->Path == loadedTex->Path)
-		{
-			texture->Resource = loadedTex->Resource;
-			return true;
-		}
-	}
-	return false;
+	// Only written to the frame resources once per change
+	Objects->Set(mObjectID, mWorldMatrix, mParallax);
+
+	// Usually still inside its fattened bounds, which leaves the tree untouched
+	if (mSpatialProxy >= 0) SceneIndex->Move(mSpatialProxy, GetWorldBox());
 }
@@ -5,17 +5,18 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "Mesh.h"
+#include "ModelCache.h"
 #include <d3d12.h>
 #include "Common.h"
 class Model
 {
 public:
-	Model(std::string fileName, ID3D12GraphicsCommandList* commandList, Mesh* mesh = nullptr, string texOverride = "");
+	// Async models load on worker threads and have no meshes until Update reports them ready
+	Model(std::string fileName, ID3D12GraphicsCommandList* commandList, Mesh* mesh = nullptr, string texOverride = "", bool async = false);
 	~Model();
 
+	// Per instance meshes, geometry is shared through the model cache
 	std::vector<Mesh*> mMeshes;
-	int mObjConstantBufferIndex = 2;
-	int mNumDirtyFrames = 3;
 
 	// Transform
 	XMFLOAT3 mPosition = XMFLOAT3{ 0,0,0 };
@@ -23,16 +24,34 @@ public:
 	XMFLOAT3 mScale = XMFLOAT3{ 0,0,0 };
 	XMFLOAT4X4 mWorldMatrix = MakeIdentity4x4();
 
+	// Build meshes once a streamed asset has loaded, returns true on the call the model becomes ready
+	bool Update();
+	bool IsReady() const { return mReady; }
+
 	// Draw each mesh in the model
 	void Draw(ID3D12GraphicsCommandList* commandList);
 
+	// Refresh this frame's material tables for textures whose resource was replaced by streaming
+	void UpdateTextureTables();
+
+	// Bounds of every mesh, in world space
+	BoundingSphere GetWorldBounds() const;
+	BoundingBox GetWorldBox() const;
+
+	// Add to the scene index for culling and picking, the index follows the model as it moves
+	void AddToSceneIndex();
+	bool IsInSceneIndex() const { return mSpatialProxy >= 0; }
+
+	// Entry in the object table holding this model's transform
+	UINT GetObjectID() const { return mObjectID; }
+
 	// Set transform components
 	void SetPosition(XMFLOAT3 position, bool Update = true);
 	void SetRotation(XMFLOAT3 rotation, bool Update = true);
 	void SetScale(XMFLOAT3 scale, bool Update = true);
 
 	// Mesh passed in the constructor
-	Mesh* mConstructorMesh;
+	Mesh* mConstructorMesh = nullptr;
 
 	// Flags for sorting into lists per PSO
 	bool mTextured = false;
@@ -40,20 +59,44 @@ public:
 	bool mModelTextured = false;
 	bool mPerMeshTextured = false;
 	bool mParallax = true;
+
+	// DrawPipeline the model is drawn with, -1 if it is drawn on its own
+	int mDrawList = -1;
 private:
-	void ProcessNode(aiNode* node, const aiScene* scene);
-	Mesh* ProcessMesh(aiMesh* mesh, const aiScene* scene);
-	vector<Texture*> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, const aiScene* scene);
-	int LoadTextureFromFile(const char* path, string directory);
-	void LoadEmbeddedTexture(const aiTexture* embeddedTexture);
+	void BuildMeshes(const ModelAsset* asset);
+	Mesh* ProcessMesh(const ModelAssetMesh& assetMesh, const ModelAsset* asset);
+
+	// Queue the texture files the materials will load, so they decode in parallel
+	void PrefetchTextures(const ModelAsset* asset);
+
+	// Put the albedo only materials found by ProcessMesh into texture arrays by size class
+	void BuildTextureArrays();
+
+	// Load the first count maps of a material's table and create its SRVs from CurrentSRVOffset, one table per frame resource
+	void LoadTextureMaps(Mesh* mesh, const std::wstring& materialPath, int count = MATERIAL_TEXTURE_COUNT);
+	// Take count descriptors for material tables from CurrentSRVOffset, -1 if they would run into the texture cache's range
+	static int AllocateTableDescriptors(int count);
+	// Copy a map's descriptor from the texture cache into one frame resource's table
+	void CopyTableDescriptor(Mesh* mesh, int map, int frame);
 	void UpdateWorldMatrix();
-	bool CheckTextureLoaded(Texture* texture);
 	
+	// Asset being streamed in, until the model is ready
+	ModelAssetFuture mAssetFuture;
+	bool mReady = false;
+
 	// Texture override string
 	std::string mTexOverride;
 	
-	// Array of already loaded textures
-	std::vector<Texture*> mLoadedTextures;
+	// Bounds of every mesh, in model space
+	BoundingBox mLocalBounds;
+
+	// Proxy in the scene index, -1 if not added
+	int mSpatialProxy = -1;
+
+	UINT mObjectID = UINT_MAX;
+
+	// Albedo only meshes and their material path, until BuildTextureArrays
+	std::vector<std::pair<Mesh*, std::wstring>> mArrayMaterials;
 
 	// Name of file
 	std::string mDirectory;
@@ -61,10 +104,5 @@ private:
 
 	int mMaterialIndex = 0;
 
-	// Types of file to load
-	bool mDDS = false;
-	bool mJPG = false;
-	bool mPNG = false;
-
 };
 
@@ -0,0 +1,318 @@
+#include "ModelCache.h"
+#include "Common.h"
+#include "BakedModel.h"
+
+// Post processing applied on import, part of the baked file key
+const unsigned int MODEL_IMPORT_FLAGS =
+	aiProcess_Triangulate |
+	aiProcess_JoinIdenticalVertices |
+	aiProcess_RemoveRedundantMaterials |
+	aiProcess_SortByPType |
+	aiProcess_FindInvalidData |
+	aiProcess_PreTransformVertices |
+	aiProcess_MakeLeftHanded |
+	//aiProcess_OptimizeMeshes |
+	//aiProcess_OptimizeGraph |
+	//aiProcess_FlipUVs |
+	//aiProcess_GenUVCoords|
+	//aiProcess_TransformUVCoords|
+	aiProcess_CalcTangentSpace |
+	aiProcess_ConvertToLeftHanded;
+
+ModelAsset::~ModelAsset()
+{
+	for (auto& mesh : Meshes)
+	{
+		delete mesh.Geometry;
+	}
+}
+
+ModelCache::~ModelCache()
+{
+	// Let loading jobs finish before their results are thrown away
+	for (auto& pending : mPending)
+	{
+		pending->Loading.wait();
+	}
+}
+
+ModelAssetFuture ModelCache::LoadAsync(const std::string& fileName)
+{
+	auto requested = mFutures.find(fileName);
+	if (requested != mFutures.end()) return requested->second;
+
+	auto pending = std::make_unique<PendingAsset>();
+	pending->FileName = fileName;
+	pending->Loading = Jobs->Async([fileName]() { return LoadCPUData(fileName); });
+
+	ModelAssetFuture future = pending->Ready.get_future().share();
+	mFutures[fileName] = future;
+	mPending.push_back(std::move(pending));
+	return future;
+}
+
+const ModelAsset* ModelCache::Load(const std::string& fileName)
+{
+	ModelAssetFuture future = LoadAsync(fileName);
+
+	// Finish this asset straight away rather than waiting for the next update
+	for (size_t i = 0; i < mPending.size(); i++)
+	{
+		if (mPending[i]->FileName == fileName)
+		{
+			mPending[i]->Loading.wait();
+			FinishAsset(*mPending[i]);
+			mPending.erase(mPending.begin() + i);
+			break;
+		}
+	}
+
+	return future.get();
+}
+
+void ModelCache::Update()
+{
+	for (size_t i = 0; i < mPending.size();)
+	{
+		if (mPending[i]->Loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			FinishAsset(*mPending[i]);
+			mPending.erase(mPending.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+void ModelCache::FinishAsset(PendingAsset& pending)
+{
+	std::unique_ptr<ModelAsset> asset = pending.Loading.get();
+	if (!asset)
+	{
+		// Report the failed import
+		string str = "Error importing models : " + pending.FileName;
+		wstring wstr(str.begin(), str.end());
+		MessageBox(0, wstr.c_str(), L"Error", MB_OK);
+		pending.Ready.set_value(nullptr);
+		return;
+	}
+
+	// All uploads made here go out together with the next submit
+	for (auto& mesh : asset->Meshes)
+	{
+		if (mesh.Baked)
+		{
+			auto& baked = *mesh.Baked;
+			mesh.Geometry->UploadGeometry(asset->BakedFile->GetVertices(baked), baked.VertexCount, asset->BakedFile->GetIndices(baked), baked.IndexCount);
+			mesh.Baked = nullptr;
+		}
+		else
+		{
+			auto geometry = mesh.Geometry;
+			geometry->UploadGeometry(geometry->mVertices.data(), (UINT)geometry->mVertices.size(), geometry->mIndices.data(), (UINT)geometry->mIndices.size());
+			geometry->ReleaseCPUData();
+		}
+	}
+	asset->BakedFile.reset();
+
+	auto result = asset.get();
+	mAssets[pending.FileName] = std::move(asset);
+	pending.Ready.set_value(result);
+}
+
+std::unique_ptr<ModelAsset> ModelCache::LoadCPUData(const std::string& fileName)
+{
+	// Use the baked file when it was made from this exact source, otherwise import and bake it again
+	uint64_t sourceHash = 0;
+	bool hashed = BakedModelFile::HashFile(fileName, sourceHash);
+	std::string bakedFileName = BakedModelFile::GetBakedFileName(fileName);
+
+	if (hashed)
+	{
+		auto baked = LoadBaked(fileName, bakedFileName, sourceHash);
+		if (baked) return baked;
+	}
+
+	auto asset = Import(fileName);
+	if (asset && hashed)
+	{
+		BakedModelFile::Write(bakedFileName, sourceHash, MODEL_IMPORT_FLAGS, *asset);
+	}
+	return asset;
+}
+
+std::unique_ptr<ModelAsset> ModelCache::LoadBaked(const std::string& fileName, const std::string& bakedFileName, uint64_t sourceHash)
+{
+	auto bakedFile = std::make_unique<BakedModelFile>();
+	if (!bakedFile->Open(bakedFileName, sourceHash, MODEL_IMPORT_FLAGS)) return nullptr;
+
+	auto asset = std::make_unique<ModelAsset>();
+	asset->FileName = fileName;
+
+	auto header = bakedFile->GetHeader();
+	for (uint32_t i = 0; i < header->MaterialCount; i++)
+	{
+		auto& bakedMaterial = bakedFile->GetMaterials()[i];
+		ModelAssetMaterial material;
+		material.Name = aiString(bakedMaterial.Name);
+		material.DiffuseAlbedo = XMFLOAT4{ bakedMaterial.DiffuseAlbedo[0], bakedMaterial.DiffuseAlbedo[1], bakedMaterial.DiffuseAlbedo[2], bakedMaterial.DiffuseAlbedo[3] };
+		material.Roughness = bakedMaterial.Roughness;
+		material.Metalness = bakedMaterial.Metalness;
+		asset->Materials.push_back(material);
+	}
+
+	// Baked geometry is already optimized, it is uploaded straight from the mapped file
+	for (uint32_t i = 0; i < header->MeshCount; i++)
+	{
+		auto& bakedMesh = bakedFile->GetMeshes()[i];
+
+		ModelAssetMesh assetMesh;
+		assetMesh.Geometry = new Mesh();
+		assetMesh.MaterialIndex = bakedMesh.MaterialIndex;
+		assetMesh.Baked = &bakedMesh;
+		asset->Meshes.push_back(assetMesh);
+	}
+
+	asset->BakedFile = std::move(bakedFile);
+	return asset;
+}
+
+std::unique_ptr<ModelAsset> ModelCache::Import(const std::string& fileName)
+{
+	Assimp::Importer importer;
+
+	const aiScene* scene = importer.ReadFile(fileName, MODEL_IMPORT_FLAGS);
+	if (!scene)
+	{
+		// Only the main thread shows message boxes, so log the assimp error here
+		string str = "Error importing models : " + string(importer.GetErrorString()) + "\n";
+		OutputDebugStringA(str.c_str());
+		return nullptr;
+	}
+
+	auto asset = std::make_unique<ModelAsset>();
+	asset->FileName = fileName;
+
+	// Keep the material values so instances can build their own materials without the scene
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+	{
+		aiMaterial* assimpMaterial = scene->mMaterials[i];
+		ModelAssetMaterial material;
+
+		assimpMaterial->Get(AI_MATKEY_NAME, material.Name);
+
+		aiColor4D diffuseColour;
+		assimpMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, diffuseColour);
+		material.DiffuseAlbedo = XMFLOAT4{ diffuseColour.r,diffuseColour.g,diffuseColour.b,diffuseColour.a };
+
+		assimpMaterial->Get(AI_MATKEY_ROUGHNESS_FACTOR, material.Roughness);
+		assimpMaterial->Get(AI_MATKEY_METALLIC_FACTOR, material.Metalness);
+
+		asset->Materials.push_back(material);
+	}
+
+	// Process scene nodes
+	ProcessNode(scene->mRootNode, scene, asset.get());
+
+	// Optimize here so the main thread only has to upload, the CPU copy is kept for baking
+	for (auto& mesh : asset->Meshes)
+	{
+		if (mesh.Geometry->mOptimize) mesh.Geometry->Optimize();
+	}
+
+	return asset;
+}
+
+void ModelCache::ProcessNode(aiNode* node, const aiScene* scene, ModelAsset* asset)
+{
+	// Process each mesh
+	for (int i = 0; i < node->mNumMeshes; i++)
+	{
+		// Node only indexes objects in the scene
+		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+
+		ModelAssetMesh assetMesh;
+		assetMesh.Geometry = ProcessMesh(mesh);
+		assetMesh.MaterialIndex = scene->HasMaterials() ? (int)mesh->mMaterialIndex : -1;
+		asset->Meshes.push_back(assetMesh);
+	}
+
+	// Process each child node
+	for (int i = 0; i < node->mNumChildren; i++)
+	{
+		ProcessNode(node->mChildren[i], scene, asset);
+	}
+}
+
+Mesh* ModelCache::ProcessMesh(aiMesh* mesh)
+{
+	// Make a new mesh
+	auto newMesh = new Mesh();
+
+	// For each vertex, extract information
+	for (int i = 0; i < mesh->mNumVertices; i++)
+	{
+		Vertex vertex;
+
+		if (mesh->HasPositions())
+		{
+			vertex.Pos.x = mesh->mVertices[i].x;
+			vertex.Pos.y = mesh->mVertices[i].y;
+			vertex.Pos.z = mesh->mVertices[i].z;
+		}
+
+		if (mesh->HasNormals())
+		{
+			vertex.Normal.x = mesh->mNormals[i].x;
+			vertex.Normal.y = mesh->mNormals[i].y;
+			vertex.Normal.z = mesh->mNormals[i].z;
+		}
+
+		if (mesh->HasVertexColors(i))
+		{
+			vertex.Colour.x = mesh->mColors[i]->r;
+			vertex.Colour.y = mesh->mColors[i]->g;
+			vertex.Colour.z = mesh->mColors[i]->b;
+			vertex.Colour.w = mesh->mColors[i]->a;
+		}
+		else
+		{
+			vertex.Colour = { 0.1,0.1,0,0 };
+		}
+
+		if (mesh->mTextureCoords[0])
+		{
+			XMFLOAT2 vec;
+			vec.x = mesh->mTextureCoords[0][i].x;
+			vec.y = mesh->mTextureCoords[0][i].y;
+			vertex.UV = vec;
+		}
+		else
+		{
+			vertex.UV = XMFLOAT2(0.0f, 0.0f);
+		}
+
+		if (mesh->HasTangentsAndBitangents())
+		{
+			vertex.Tangent.x = mesh->mTangents[i].x;
+			vertex.Tangent.y = mesh->mTangents[i].y;
+			vertex.Tangent.z = mesh->mTangents[i].z;
+		}
+
+		newMesh->mVertices.push_back(vertex);
+	}
+
+	// For each face extract indices
+	for (int i = 0; i < mesh->mNumFaces; i++)
+	{
+		aiFace face = mesh->mFaces[i];
+		for (int j = 0; j < face.mNumIndices; j++)
+		{
+			newMesh->mIndices.push_back(face.mIndices[j]);
+		}
+	}
+
+	return newMesh;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <unordered_map>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include "Mesh.h"
+#include "BakedModel.h"
+
+// Material values read from the source file
+struct ModelAssetMaterial
+{
+	aiString Name;
+	XMFLOAT4 DiffuseAlbedo = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float Roughness = 0.0f;
+	float Metalness = 0.0f;
+};
+
+// One mesh of a source file, uploaded once and drawn by every instance
+struct ModelAssetMesh
+{
+	Mesh* Geometry = nullptr;
+	int MaterialIndex = -1;
+
+	// Position of this mesh's data in the baked file, when loaded from one
+	const BakedMesh* Baked = nullptr;
+};
+
+// Everything imported from a model file that does not depend on the instance
+struct ModelAsset
+{
+	~ModelAsset();
+
+	std::string FileName;
+	std::vector<ModelAssetMesh> Meshes;
+	std::vector<ModelAssetMaterial> Materials;
+
+	// Mapped baked file, kept open until the geometry has been uploaded from it
+	std::unique_ptr<BakedModelFile> BakedFile;
+};
+
+// Becomes ready once the asset's geometry has been queued for upload, holds nullptr if loading failed
+using ModelAssetFuture = std::shared_future<const ModelAsset*>;
+
+// Imports each model file once and shares its geometry between every model that uses it
+// Files are read and imported as jobs on the job system; uploads happen on the main thread in Update
+class ModelCache
+{
+public:
+	~ModelCache();
+
+	// Start loading the file if it has not been requested before and return at once
+	ModelAssetFuture LoadAsync(const std::string& fileName);
+
+	// Load the file and wait for it, returns nullptr if it could not be imported
+	const ModelAsset* Load(const std::string& fileName);
+
+	// Upload assets whose loading jobs have finished, call once per frame
+	void Update();
+
+	size_t GetAssetCount() const { return mAssets.size(); }
+	size_t GetPendingCount() const { return mPending.size(); }
+
+private:
+	struct PendingAsset
+	{
+		std::string FileName;
+		std::future<std::unique_ptr<ModelAsset>> Loading;
+		std::promise<const ModelAsset*> Ready;
+	};
+
+	// Everything that can run away from the main thread: hashing, reading the baked file or importing and baking
+	static std::unique_ptr<ModelAsset> LoadCPUData(const std::string& fileName);
+	static std::unique_ptr<ModelAsset> LoadBaked(const std::string& fileName, const std::string& bakedFileName, uint64_t sourceHash);
+	static std::unique_ptr<ModelAsset> Import(const std::string& fileName);
+
+	static void ProcessNode(aiNode* node, const aiScene* scene, ModelAsset* asset);
+	static Mesh* ProcessMesh(aiMesh* mesh);
+
+	// Upload a loaded asset's geometry and make it available
+	void FinishAsset(PendingAsset& pending);
+
+	std::unordered_map<std::string, std::unique_ptr<ModelAsset>> mAssets;
+	std::unordered_map<std::string, ModelAssetFuture> mFutures;
+	std::vector<std::unique_ptr<PendingAsset>> mPending;
+};
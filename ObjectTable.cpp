@@ -0,0 +1,75 @@
+#include "ObjectTable.h"
+#include "Common.h"
+
+// Changes smaller than this are written faster on one thread than they take to share out
+const size_t PARALLEL_UPDATE_MIN = 8192;
+const size_t UPDATE_JOB_SIZE = 2048;
+
+ObjectTable::ObjectTable(int frameCount) : mChanges(frameCount)
+{
+}
+
+UINT ObjectTable::Add()
+{
+	UINT id;
+	if (!mFreeIDs.empty())
+	{
+		id = mFreeIDs.back();
+		mFreeIDs.pop_back();
+	}
+	else
+	{
+		// Frame resources hold a fixed number of objects
+		if (mWorldMatrices.size() >= MAX_OBJECTS)
+		{
+			MessageBox(0, L"Too many objects", L"Error", MB_OK);
+			return UINT_MAX;
+		}
+
+		id = (UINT)mWorldMatrices.size();
+		mWorldMatrices.emplace_back();
+		mParallax.emplace_back();
+	}
+
+	Set(id, MakeIdentity4x4(), false);
+	return id;
+}
+
+void ObjectTable::Remove(UINT id)
+{
+	if (id < mWorldMatrices.size()) mFreeIDs.push_back(id);
+}
+
+void ObjectTable::Set(UINT id, const XMFLOAT4X4& worldMatrix, bool parallax)
+{
+	if (id >= mWorldMatrices.size()) return;
+
+	mWorldMatrices[id] = worldMatrix;
+	mParallax[id] = parallax ? 1 : 0;
+	mChanges.Mark(id);
+}
+
+size_t ObjectTable::Update(int frame, UploadBuffer<ObjectConstants>* buffer)
+{
+	auto& ids = mChanges.Take(frame);
+	ObjectConstants* objects = buffer->GetElements();
+
+	// Whole structures are stored in id order, upload memory is write combined and never read back
+	auto write = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			UINT id = ids[i];
+			ObjectConstants constants;
+			XMStoreFloat4x4(&constants.WorldMatrix, XMMatrixTranspose(XMLoadFloat4x4(&mWorldMatrices[id])));
+			constants.Parallax = mParallax[id];
+			objects[id] = constants;
+		}
+	};
+
+	// Everything is new on the first frames, or when a lot moves at once
+	if (ids.size() >= PARALLEL_UPDATE_MIN) Jobs->ParallelFor(ids.size(), UPDATE_JOB_SIZE, write);
+	else write(0, ids.size());
+
+	return ids.size();
+}
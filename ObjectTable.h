@@ -0,0 +1,35 @@
+#pragma once
+
+#include "DirtyList.h"
+#include "UploadBuffer.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <climits>
+
+using namespace DirectX;
+
+// Transforms of every object by id, copied into each frame resource's object buffer. Only objects set since a
+// frame resource was last updated are written to it, so a world that isn't moving costs nothing to update.
+// Used from the main thread
+class ObjectTable
+{
+public:
+	ObjectTable(int frameCount);
+
+	// A new object with an identity transform, UINT_MAX once MAX_OBJECTS are in use
+	UINT Add();
+	void Remove(UINT id);
+
+	void Set(UINT id, const XMFLOAT4X4& worldMatrix, bool parallax);
+
+	// Write the objects changed since this frame resource was last updated, returns how many were written
+	size_t Update(int frame, UploadBuffer<ObjectConstants>* buffer);
+
+	size_t GetObjectCount() const { return mWorldMatrices.size() - mFreeIDs.size(); }
+
+private:
+	std::vector<XMFLOAT4X4> mWorldMatrices;
+	std::vector<UINT> mParallax;
+	std::vector<UINT> mFreeIDs;
+	DirtyList mChanges;
+};
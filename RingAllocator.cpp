@@ -0,0 +1,76 @@
+#include "RingAllocator.h"
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+RingAllocator::RingAllocator(uint64_t size) : mSize(size)
+{
+}
+
+uint64_t RingAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+	if (size == 0 || size > mSize) return INVALID_OFFSET;
+	if (alignment == 0) alignment = 1;
+
+	// Empty ring, start again from the beginning
+	if (mUsedSize == 0)
+	{
+		mHead = 0;
+		mTail = 0;
+	}
+
+	uint64_t offset = AlignUp(mHead, alignment);
+	uint64_t consumed = 0;
+
+	if (mHead >= mTail)
+	{
+		// Free space runs from the head to the end, then from the start to the tail
+		if (offset + size <= mSize)
+		{
+			consumed = offset + size - mHead;
+		}
+		else if (size <= mTail)
+		{
+			// Skip the end of the ring and wrap to the start
+			offset = 0;
+			consumed = (mSize - mHead) + size;
+		}
+		else
+		{
+			return INVALID_OFFSET;
+		}
+	}
+	else
+	{
+		// Free space is between the head and the tail
+		if (offset + size > mTail) return INVALID_OFFSET;
+		consumed = offset + size - mHead;
+	}
+
+	if (mUsedSize + consumed > mSize) return INVALID_OFFSET;
+
+	mHead = (offset + size) % mSize;
+	mUsedSize += consumed;
+	mPendingSize += consumed;
+	return offset;
+}
+
+void RingAllocator::FinishAllocations(uint64_t fenceValue)
+{
+	if (mPendingSize == 0) return;
+
+	mRegions.push_back({ mHead, mPendingSize, fenceValue });
+	mPendingSize = 0;
+}
+
+void RingAllocator::Release(uint64_t completedFenceValue)
+{
+	while (!mRegions.empty() && mRegions.front().FenceValue <= completedFenceValue)
+	{
+		mTail = mRegions.front().End;
+		mUsedSize -= mRegions.front().Size;
+		mRegions.pop_front();
+	}
+}
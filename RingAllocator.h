@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+
+// Ring of offsets into a fixed range, reclaimed in the order they were used
+// Allocations are grouped by fence value and freed together once that fence completes
+class RingAllocator
+{
+public:
+	static const uint64_t INVALID_OFFSET = UINT64_MAX;
+
+	RingAllocator(uint64_t size);
+
+	// Returns INVALID_OFFSET if the ring is full, never waits
+	uint64_t Allocate(uint64_t size, uint64_t alignment = 1);
+
+	// Mark everything allocated since the last call as complete at this fence value
+	void FinishAllocations(uint64_t fenceValue);
+
+	// Reclaim space for fences that have completed
+	void Release(uint64_t completedFenceValue);
+
+	uint64_t GetSize() const { return mSize; }
+	uint64_t GetUsedSize() const { return mUsedSize; }
+
+private:
+	struct Region
+	{
+		uint64_t End;
+		uint64_t Size;
+		uint64_t FenceValue;
+	};
+
+	uint64_t mSize = 0;
+	uint64_t mHead = 0;
+	uint64_t mTail = 0;
+	uint64_t mUsedSize = 0;
+
+	// Bytes allocated since the last fence, including padding
+	uint64_t mPendingSize = 0;
+
+	std::deque<Region> mRegions;
+};
@@ -18,7 +18,10 @@ public:
 	ComPtr<ID3D12DescriptorHeap> mHeap;
 	UINT mGuiSrvOffset = 0;
 	UINT mDescriptorSize = 0;
-	int mMaxTextures = 2048;
+	int mMaxTextures = 8192;
+
+	// Material tables are allocated below this, the texture cache owns the rest
+	int mTextureCacheStart = 4096;
 	int mCurrentIndex = 0;
 };
 
@@ -19,13 +19,6 @@ static const float GAMMA = 2.2f;
 
 TextureCube IBLCubeMap : register(t0,space1);
 
-cbuffer cbPerObjectConstants : register(b0)
-{
-	float4x4 World;
-	bool parallax;
-	float3 padding;
-};
-
 cbuffer cbPerPassConstants : register(b1)
 {
 	float4x4 View;
@@ -44,16 +37,104 @@ cbuffer cbPerPassConstants : register(b1)
 	Light Lights[MaxLights];
 };
 
-cbuffer cbMaterial : register(b2)
+// Every material by index, see PerMaterialConstants
+struct MaterialData
 {
 	float4 DiffuseAlbedo;
 	float3 FresnelR0;
 	float Roughness;
 	float Metallic;
-	float3 padding4;
+	float TextureSlice;
+	uint TextureIndex;
+	float padding4;
 	float4x4 MatTransform;
 };
 
+StructuredBuffer<MaterialData> Materials : register(t1, space2);
+
+// Every texture in the SRV heap, a material's maps start at its TextureIndex
+Texture2D HeapTextures[] : register(t0, space3);
+Texture2DArray HeapTextureArrays[] : register(t0, space4);
+
+// Instances of a batch can have different materials, so the index may differ across a wave
+#define MATERIAL_TEXTURE(map) HeapTextures[NonUniformResourceIndex(TextureIndex + (map))]
+#define MATERIAL_TEXTURE_ARRAY HeapTextureArrays[NonUniformResourceIndex(TextureIndex)]
+
+// Root constants of a draw
+cbuffer cbDraw : register(b3)
+{
+	uint FirstInstance;	// Batched draws
+	uint DrawMaterial;	// Single draws
+};
+
+// Filled by LoadInstance, shaders read them as they would the constant buffers
+static float4 DiffuseAlbedo;
+static float3 FresnelR0;
+static float Roughness;
+static float Metallic;
+static float TextureSlice;
+static uint TextureIndex;
+static float4x4 MatTransform;
+
+void LoadMaterial(uint index)
+{
+	MaterialData material = Materials[index];
+	DiffuseAlbedo = material.DiffuseAlbedo;
+	FresnelR0 = material.FresnelR0;
+	Roughness = material.Roughness;
+	Metallic = material.Metallic;
+	TextureSlice = material.TextureSlice;
+	TextureIndex = material.TextureIndex;
+	MatTransform = material.MatTransform;
+}
+
+#ifdef INSTANCED
+// Batched draws read each instance's transform and material from buffers, see DrawList
+struct InstanceData
+{
+	uint ObjectIndex;
+	uint MaterialIndex;
+};
+
+// Transform of every object by id, only rewritten when an object moves
+struct ObjectData
+{
+	float4x4 World;
+	uint Parallax;
+	float3 padding;
+};
+
+StructuredBuffer<InstanceData> Instances : register(t0, space2);
+StructuredBuffer<ObjectData> Objects : register(t2, space2);
+
+static float4x4 World;
+static bool parallax;
+
+void LoadInstance(uint instance)
+{
+	InstanceData data = Instances[FirstInstance + instance];
+
+	ObjectData object = Objects[data.ObjectIndex];
+	World = object.World;
+	parallax = object.Parallax != 0;
+
+	LoadMaterial(data.MaterialIndex);
+}
+#else
+cbuffer cbPerObjectConstants : register(b0)
+{
+	float4x4 World;
+	bool parallax;
+	float3 padding;
+};
+
+// One draw per object, its material is a root constant
+void LoadInstance(uint instance)
+{
+	LoadMaterial(DrawMaterial);
+}
+#endif
+
 SamplerState Sampler : register(s4);
 
 float4 CalculateLighting(float3 albedo, float roughness, float metalness, float ao, float3 n, float3 v, 
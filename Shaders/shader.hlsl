@@ -14,11 +14,14 @@ struct VOut
 	float3 PosW : POSITION;
 	float4 Colour : COLOUR;
 	float3 NormalW : NORMAL;
+	nointerpolation uint Instance : INSTANCE;
 };
 
-VOut VS(VIn vin)
+VOut VS(VIn vin, uint instance : SV_InstanceID)
 {
 	VOut vout;
+	LoadInstance(instance);
+	vout.Instance = instance;
 	
 	// Transform to homogeneous clip space.
 	float4 posW = mul(float4(vin.PosL, 1.0f), World);
@@ -36,6 +39,8 @@ VOut VS(VIn vin)
 
 float4 PS(VOut pIn) : SV_Target
 {
+	LoadInstance(pIn.Instance);
+
 	VOut vOut;
 
 	// Renormalise pixel normal and tangent because interpolation from the vertex shader can introduce scaling (refer to Graphics module lecture notes)
@@ -17,11 +17,14 @@ struct VOut
 	float3 NormalW : NORMAL;
 	float2 UV : UV;
     float3 Tangent : TANGENT;
+	nointerpolation uint Instance : INSTANCE;
 };
 
-VOut VS(VIn vin)
+VOut VS(VIn vin, uint instance : SV_InstanceID)
 {
 	VOut vout;
+	LoadInstance(instance);
+	vout.Instance = instance;
 	
 	// Transform to homogeneous clip space.
 	float4 posW = mul(float4(vin.PosL, 1.0f), World);
@@ -38,18 +41,18 @@ VOut VS(VIn vin)
 	return vout;
 }
 
-Texture2D Textures[1] : register(t0);
-
 float4 PS(VOut pIn) : SV_Target
 {
+	LoadInstance(pIn.Instance);
+
 	// Renormalise pixel normal and tangent because interpolation from the vertex shader can introduce scaling (refer to Graphics module lecture notes)
 	float3 worldNormal = normalize(pIn.NormalW);
 	float3 worldTangent = normalize(pIn.Tangent);
 	
 	float2 uv = pIn.UV;
 		
-	// Sample textures
-	float3 albedo = Textures[0].Sample(Sampler, uv).rgb;
+	// Albedo only materials share texture arrays, the slice comes from the material
+	float3 albedo = MATERIAL_TEXTURE_ARRAY.Sample(Sampler, float3(uv, TextureSlice)).rgb;
 	float roughness = Roughness;
 	float metalness = Metallic;
 	float ao = 1.0f;
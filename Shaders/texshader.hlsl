@@ -17,11 +17,14 @@ struct VOut
 	float3 NormalW : NORMAL;
 	float2 UV : UV;
     float3 Tangent : TANGENT;
+	nointerpolation uint Instance : INSTANCE;
 };
 
-VOut VS(VIn vin)
+VOut VS(VIn vin, uint instance : SV_InstanceID)
 {
 	VOut vout;
+	LoadInstance(instance);
+	vout.Instance = instance;
 	
 	// Transform to homogeneous clip space.
 	float4 posW = mul(float4(vin.PosL, 1.0f), World);
@@ -38,19 +41,18 @@ VOut VS(VIn vin)
 	return vout;
 }
 
-Texture2D Textures[7] : register(t0);
-
+// Maps of the material's table, read with MATERIAL_TEXTURE
 //Texture2D AlbedoMap	
-//Texture2D RoughnessMap
 //Texture2D NormalMap
-//Texture2D MetalnessMap
-//Texture2D DisplacementMap	
-//Texture2D AOMap
+//Texture2D PackedMap - R roughness, G metalness, B ambient occlusion, A height
+//Texture2D EmissiveMap
 
 //SamplerState Sampler : register(s4);
 
 float4 PS(VOut pIn) : SV_Target
 {
+	LoadInstance(pIn.Instance);
+
 	// Parallax mapping
 
 	// Renormalise pixel normal and tangent because interpolation from the vertex shader can introduce scaling (refer to Graphics module lecture notes)
@@ -80,16 +82,19 @@ float4 PS(VOut pIn) : SV_Target
 		//float2 textureOffsetDir = mul(cameraModelDir, tangentMatrix).xy;
 
 		//// Offset UVs in that direction to account for depth (using height map and some geometry)
-		//float texDepth = gParallaxDepth * (Textures[4].Sample(Sampler, uv).r - 0.5f);
+		//float texDepth = gParallaxDepth * (MATERIAL_TEXTURE(4).Sample(Sampler, uv).r - 0.5f);
 		//uv += texDepth * textureOffsetDir;
 		
-		float displacement = Textures[4].Sample(Sampler, uv).r - 0.5f;
+		float displacement = MATERIAL_TEXTURE(2).Sample(Sampler, uv).a - 0.5f;
 		float3 parallaxOffset = mul(invTangentMatrix, v); // Transform camera normal into tangent space (so it is local to texture)
 		float2 uv = pIn.UV + gParallaxDepth * displacement * parallaxOffset.xy;
 	}
 		
 	// Extract normal from map and shift to -1 to 1 range
-	float3 textureNormal = 2.0f * Textures[2].Sample(Sampler, uv).rgb - 1.0f;
+	// Only x and y are read so two channel BC5 maps work, z is rebuilt from them
+	float3 textureNormal;
+	textureNormal.xy = 2.0f * MATERIAL_TEXTURE(1).Sample(Sampler, uv).rg - 1.0f;
+	textureNormal.z = sqrt(saturate(1.0f - dot(textureNormal.xy, textureNormal.xy)));
 	textureNormal.y = -textureNormal.y;
 
 	// Convert normal from tangent space to world space
@@ -97,21 +102,22 @@ float4 PS(VOut pIn) : SV_Target
 	
 	// Sample PBR textures
 
-	float3 albedo = Textures[0].Sample(Sampler, uv).rgb;
-	float roughness = Textures[1].Sample(Sampler, uv).r;
-	float metalness = Textures[3].Sample(Sampler, uv).r;
-	float ao = Textures[5].Sample(Sampler, uv).r;
-	float3 emissive = Textures[6].Sample(Sampler, uv);
+	float3 albedo = MATERIAL_TEXTURE(0).Sample(Sampler, uv).rgb;
+	float4 packed = MATERIAL_TEXTURE(2).Sample(Sampler, uv);
+	float roughness = packed.r;
+	float metalness = packed.g;
+	float ao = packed.b;
+	float3 emissive = MATERIAL_TEXTURE(3).Sample(Sampler, uv);
 	
 	// Return lighting or debug texture
 	if (TexDebugIndex == 0) return CalculateLighting(albedo, roughness, metalness, ao, n, v, emissive);
-	else if (TexDebugIndex == 1) return Textures[0].Sample(Sampler, uv);
-	else if (TexDebugIndex == 2) return Textures[1].Sample(Sampler, uv);
-	else if (TexDebugIndex == 3) return Textures[2].Sample(Sampler, uv);
-	else if (TexDebugIndex == 4) return Textures[3].Sample(Sampler, uv);
-	else if (TexDebugIndex == 5) return Textures[4].Sample(Sampler, uv);
-	else if (TexDebugIndex == 6) return Textures[5].Sample(Sampler, uv);
-	else if (TexDebugIndex == 7) return Textures[6].Sample(Sampler, uv);
+	else if (TexDebugIndex == 1) return MATERIAL_TEXTURE(0).Sample(Sampler, uv);
+	else if (TexDebugIndex == 2) return float4(roughness.xxx, 1.0f);
+	else if (TexDebugIndex == 3) return MATERIAL_TEXTURE(1).Sample(Sampler, uv);
+	else if (TexDebugIndex == 4) return float4(metalness.xxx, 1.0f);
+	else if (TexDebugIndex == 5) return float4(packed.aaa, 1.0f);
+	else if (TexDebugIndex == 6) return float4(ao.xxx, 1.0f);
+	else if (TexDebugIndex == 7) return MATERIAL_TEXTURE(3).Sample(Sampler, uv);
 
 	return CalculateLighting(albedo, roughness, metalness, ao, n, v, emissive);
 }
\ No newline at end of file
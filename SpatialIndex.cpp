@@ -0,0 +1,412 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+// Leaves are grown by this fraction of their size, and at least the minimum, so small moves stay inside
+const float FAT_BOUNDS_SCALE = 0.1f;
+const float FAT_BOUNDS_MIN = 0.1f;
+
+SpatialIndex::Bounds SpatialIndex::Union(const Bounds& a, const Bounds& b)
+{
+	Bounds result;
+	XMStoreFloat3(&result.Min, XMVectorMin(XMLoadFloat3(&a.Min), XMLoadFloat3(&b.Min)));
+	XMStoreFloat3(&result.Max, XMVectorMax(XMLoadFloat3(&a.Max), XMLoadFloat3(&b.Max)));
+	return result;
+}
+
+float SpatialIndex::Area(const Bounds& bounds)
+{
+	float x = bounds.Max.x - bounds.Min.x;
+	float y = bounds.Max.y - bounds.Min.y;
+	float z = bounds.Max.z - bounds.Min.z;
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+bool SpatialIndex::Contains(const Bounds& outer, const Bounds& inner)
+{
+	return outer.Min.x <= inner.Min.x && outer.Min.y <= inner.Min.y && outer.Min.z <= inner.Min.z &&
+		outer.Max.x >= inner.Max.x && outer.Max.y >= inner.Max.y && outer.Max.z >= inner.Max.z;
+}
+
+SpatialIndex::Bounds SpatialIndex::Fatten(const BoundingBox& bounds)
+{
+	XMVECTOR center = XMLoadFloat3(&bounds.Center);
+	XMVECTOR extents = XMLoadFloat3(&bounds.Extents);
+	extents = XMVectorMax(XMVectorScale(extents, 1.0f + FAT_BOUNDS_SCALE), XMVectorAdd(extents, XMVectorReplicate(FAT_BOUNDS_MIN)));
+
+	Bounds result;
+	XMStoreFloat3(&result.Min, XMVectorSubtract(center, extents));
+	XMStoreFloat3(&result.Max, XMVectorAdd(center, extents));
+	return result;
+}
+
+BoundingBox SpatialIndex::ToBoundingBox(const Bounds& bounds)
+{
+	BoundingBox box;
+	BoundingBox::CreateFromPoints(box, XMLoadFloat3(&bounds.Min), XMLoadFloat3(&bounds.Max));
+	return box;
+}
+
+int SpatialIndex::Insert(const BoundingBox& bounds, Model* object)
+{
+	int leaf = AllocateNode();
+	mNodes[leaf].Box = Fatten(bounds);
+	mNodes[leaf].ObjectBounds = bounds;
+	mNodes[leaf].Object = object;
+	mNodes[leaf].Height = 0;
+
+	InsertLeaf(leaf);
+	mObjectCount++;
+	return leaf;
+}
+
+void SpatialIndex::Remove(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	mObjectCount--;
+}
+
+bool SpatialIndex::Move(int proxy, const BoundingBox& bounds)
+{
+	mNodes[proxy].ObjectBounds = bounds;
+
+	// Still inside its fat box, nothing above the leaf depends on the exact bounds
+	Bounds exact;
+	XMStoreFloat3(&exact.Min, XMVectorSubtract(XMLoadFloat3(&bounds.Center), XMLoadFloat3(&bounds.Extents)));
+	XMStoreFloat3(&exact.Max, XMVectorAdd(XMLoadFloat3(&bounds.Center), XMLoadFloat3(&bounds.Extents)));
+	if (Contains(mNodes[proxy].Box, exact)) return false;
+
+	RemoveLeaf(proxy);
+	mNodes[proxy].Box = Fatten(bounds);
+	InsertLeaf(proxy);
+	return true;
+}
+
+void SpatialIndex::QueryFrustum(const BoundingFrustum& frustum, std::vector<Model*>& results) const
+{
+	if (mRoot < 0) return;
+
+	// Nodes with a flag for whether the frustum is already known to contain them
+	std::vector<std::pair<int, bool>> stack;
+	stack.push_back({ mRoot, false });
+
+	while (!stack.empty())
+	{
+		auto [index, contained] = stack.back();
+		stack.pop_back();
+		const Node& node = mNodes[index];
+
+		if (!contained)
+		{
+			ContainmentType containment = frustum.Contains(node.IsLeaf() ? node.ObjectBounds : ToBoundingBox(node.Box));
+			if (containment == DISJOINT) continue;
+			contained = containment == CONTAINS;
+		}
+
+		if (node.IsLeaf())
+		{
+			results.push_back(node.Object);
+			continue;
+		}
+
+		stack.push_back({ node.Child1, contained });
+		stack.push_back({ node.Child2, contained });
+	}
+}
+
+void SpatialIndex::QueryRadius(const BoundingSphere& sphere, std::vector<Model*>& results) const
+{
+	if (mRoot < 0) return;
+
+	std::vector<int> stack;
+	stack.push_back(mRoot);
+
+	while (!stack.empty())
+	{
+		const Node& node = mNodes[stack.back()];
+		stack.pop_back();
+
+		if (node.IsLeaf())
+		{
+			if (sphere.Intersects(node.ObjectBounds)) results.push_back(node.Object);
+			continue;
+		}
+
+		if (!sphere.Intersects(ToBoundingBox(node.Box))) continue;
+		stack.push_back(node.Child1);
+		stack.push_back(node.Child2);
+	}
+}
+
+Model* SpatialIndex::RayCast(FXMVECTOR origin, FXMVECTOR direction, float& distance) const
+{
+	Model* closest = nullptr;
+	distance = FLT_MAX;
+	if (mRoot < 0) return nullptr;
+
+	std::vector<int> stack;
+	stack.push_back(mRoot);
+
+	while (!stack.empty())
+	{
+		const Node& node = mNodes[stack.back()];
+		stack.pop_back();
+
+		// Skip anything that starts further away than the closest hit so far
+		float hit = 0.0f;
+		if (node.IsLeaf())
+		{
+			if (node.ObjectBounds.Intersects(origin, direction, hit) && hit < distance)
+			{
+				distance = hit;
+				closest = node.Object;
+			}
+			continue;
+		}
+
+		BoundingBox box = ToBoundingBox(node.Box);
+		bool inside = box.Contains(origin) == CONTAINS;
+		if (!inside && (!box.Intersects(origin, direction, hit) || hit >= distance)) continue;
+
+		stack.push_back(node.Child1);
+		stack.push_back(node.Child2);
+	}
+
+	return closest;
+}
+
+int SpatialIndex::AllocateNode()
+{
+	if (mFreeList < 0)
+	{
+		mNodes.emplace_back();
+		return (int)mNodes.size() - 1;
+	}
+
+	int node = mFreeList;
+	mFreeList = mNodes[node].Parent;
+	mNodes[node] = Node();
+	return node;
+}
+
+void SpatialIndex::FreeNode(int node)
+{
+	mNodes[node] = Node();
+	mNodes[node].Parent = mFreeList;
+	mFreeList = node;
+}
+
+void SpatialIndex::InsertLeaf(int leaf)
+{
+	if (mRoot < 0)
+	{
+		mRoot = leaf;
+		mNodes[leaf].Parent = -1;
+		return;
+	}
+
+	// Walk down to the sibling that makes the tree's total surface area grow least
+	Bounds leafBox = mNodes[leaf].Box;
+	int index = mRoot;
+	while (!mNodes[index].IsLeaf())
+	{
+		const Node& node = mNodes[index];
+		float area = Area(node.Box);
+		float combinedArea = Area(Union(node.Box, leafBox));
+
+		// Cost of pairing with this node, and of pushing the leaf further down
+		float cost = 2.0f * combinedArea;
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		auto childCost = [&](int child)
+		{
+			float growth = Area(Union(leafBox, mNodes[child].Box));
+			if (!mNodes[child].IsLeaf()) growth -= Area(mNodes[child].Box);
+			return growth + inheritanceCost;
+		};
+		float cost1 = childCost(node.Child1);
+		float cost2 = childCost(node.Child2);
+
+		if (cost < cost1 && cost < cost2) break;
+		index = cost1 < cost2 ? node.Child1 : node.Child2;
+	}
+
+	// New parent for the sibling and the leaf
+	int sibling = index;
+	int newParent = AllocateNode();
+	int oldParent = mNodes[sibling].Parent;
+	mNodes[newParent].Parent = oldParent;
+	mNodes[newParent].Box = Union(leafBox, mNodes[sibling].Box);
+	mNodes[newParent].Height = mNodes[sibling].Height + 1;
+	mNodes[newParent].Child1 = sibling;
+	mNodes[newParent].Child2 = leaf;
+	mNodes[sibling].Parent = newParent;
+	mNodes[leaf].Parent = newParent;
+
+	if (oldParent >= 0)
+	{
+		if (mNodes[oldParent].Child1 == sibling) mNodes[oldParent].Child1 = newParent;
+		else mNodes[oldParent].Child2 = newParent;
+	}
+	else
+	{
+		mRoot = newParent;
+	}
+
+	Refit(mNodes[leaf].Parent);
+}
+
+void SpatialIndex::RemoveLeaf(int leaf)
+{
+	if (leaf == mRoot)
+	{
+		mRoot = -1;
+		return;
+	}
+
+	// The sibling takes the parent's place
+	int parent = mNodes[leaf].Parent;
+	int grandParent = mNodes[parent].Parent;
+	int sibling = mNodes[parent].Child1 == leaf ? mNodes[parent].Child2 : mNodes[parent].Child1;
+
+	if (grandParent >= 0)
+	{
+		if (mNodes[grandParent].Child1 == parent) mNodes[grandParent].Child1 = sibling;
+		else mNodes[grandParent].Child2 = sibling;
+		mNodes[sibling].Parent = grandParent;
+		FreeNode(parent);
+
+		Refit(grandParent);
+	}
+	else
+	{
+		mRoot = sibling;
+		mNodes[sibling].Parent = -1;
+		FreeNode(parent);
+	}
+}
+
+void SpatialIndex::Refit(int node)
+{
+	while (node >= 0)
+	{
+		node = Balance(node);
+
+		Node& current = mNodes[node];
+		current.Height = 1 + std::max(mNodes[current.Child1].Height, mNodes[current.Child2].Height);
+		current.Box = Union(mNodes[current.Child1].Box, mNodes[current.Child2].Box);
+
+		node = current.Parent;
+	}
+}
+
+int SpatialIndex::Balance(int iA)
+{
+	Node& A = mNodes[iA];
+	if (A.IsLeaf() || A.Height < 2) return iA;
+
+	int iB = A.Child1;
+	int iC = A.Child2;
+	Node& B = mNodes[iB];
+	Node& C = mNodes[iC];
+
+	int balance = C.Height - B.Height;
+
+	// Rotate C up
+	if (balance > 1)
+	{
+		int iF = C.Child1;
+		int iG = C.Child2;
+		Node& F = mNodes[iF];
+		Node& G = mNodes[iG];
+
+		C.Child1 = iA;
+		C.Parent = A.Parent;
+		A.Parent = iC;
+
+		if (C.Parent >= 0)
+		{
+			if (mNodes[C.Parent].Child1 == iA) mNodes[C.Parent].Child1 = iC;
+			else mNodes[C.Parent].Child2 = iC;
+		}
+		else
+		{
+			mRoot = iC;
+		}
+
+		// The taller of C's children stays with C
+		if (F.Height > G.Height)
+		{
+			C.Child2 = iF;
+			A.Child2 = iG;
+			G.Parent = iA;
+			A.Box = Union(B.Box, G.Box);
+			C.Box = Union(A.Box, F.Box);
+			A.Height = 1 + std::max(B.Height, G.Height);
+			C.Height = 1 + std::max(A.Height, F.Height);
+		}
+		else
+		{
+			C.Child2 = iG;
+			A.Child2 = iF;
+			F.Parent = iA;
+			A.Box = Union(B.Box, F.Box);
+			C.Box = Union(A.Box, G.Box);
+			A.Height = 1 + std::max(B.Height, F.Height);
+			C.Height = 1 + std::max(A.Height, G.Height);
+		}
+
+		return iC;
+	}
+
+	// Rotate B up
+	if (balance < -1)
+	{
+		int iD = B.Child1;
+		int iE = B.Child2;
+		Node& D = mNodes[iD];
+		Node& E = mNodes[iE];
+
+		B.Child1 = iA;
+		B.Parent = A.Parent;
+		A.Parent = iB;
+
+		if (B.Parent >= 0)
+		{
+			if (mNodes[B.Parent].Child1 == iA) mNodes[B.Parent].Child1 = iB;
+			else mNodes[B.Parent].Child2 = iB;
+		}
+		else
+		{
+			mRoot = iB;
+		}
+
+		if (D.Height > E.Height)
+		{
+			B.Child2 = iD;
+			A.Child1 = iE;
+			E.Parent = iA;
+			A.Box = Union(C.Box, E.Box);
+			B.Box = Union(A.Box, D.Box);
+			A.Height = 1 + std::max(C.Height, E.Height);
+			B.Height = 1 + std::max(A.Height, D.Height);
+		}
+		else
+		{
+			B.Child2 = iE;
+			A.Child1 = iD;
+			D.Parent = iA;
+			A.Box = Union(C.Box, D.Box);
+			B.Box = Union(A.Box, E.Box);
+			A.Height = 1 + std::max(C.Height, D.Height);
+			B.Height = 1 + std::max(A.Height, E.Height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
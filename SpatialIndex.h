@@ -0,0 +1,82 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+class Model;
+
+// Dynamic bounding volume tree over the world bounds of models, for frustum, ray and radius queries in log time
+// Leaves hold a box a little larger than the object so small moves leave the tree alone; a move that leaves
+// the larger box reinserts just that leaf. Inserts pick the sibling that grows the tree's surface area least and
+// rotations keep it balanced
+class SpatialIndex
+{
+public:
+	// Returns the object's proxy, used to move and remove it
+	int Insert(const DirectX::BoundingBox& bounds, Model* object);
+	void Remove(int proxy);
+
+	// Update an object's bounds, returns true if the tree had to change
+	bool Move(int proxy, const DirectX::BoundingBox& bounds);
+
+	// Objects whose bounds are at least partly inside
+	void QueryFrustum(const DirectX::BoundingFrustum& frustum, std::vector<Model*>& results) const;
+	void QueryRadius(const DirectX::BoundingSphere& sphere, std::vector<Model*>& results) const;
+
+	// Closest object whose bounds the ray hits, nullptr if none. Direction must be normalised
+	Model* RayCast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float& distance) const;
+
+	size_t GetObjectCount() const { return mObjectCount; }
+	int GetHeight() const { return mRoot < 0 ? 0 : mNodes[mRoot].Height; }
+
+private:
+	struct Bounds
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+	};
+
+	struct Node
+	{
+		// Fat bounds for leaves, union of the children otherwise
+		Bounds Box;
+
+		// Exact bounds of a leaf's object
+		DirectX::BoundingBox ObjectBounds;
+		Model* Object = nullptr;
+
+		// Next free node while unused
+		int Parent = -1;
+		int Child1 = -1;
+		int Child2 = -1;
+
+		// Leaves are 0, unused nodes -1
+		int Height = -1;
+
+		bool IsLeaf() const { return Child1 < 0; }
+	};
+
+	static Bounds Union(const Bounds& a, const Bounds& b);
+	static float Area(const Bounds& bounds);
+	static bool Contains(const Bounds& outer, const Bounds& inner);
+	static Bounds Fatten(const DirectX::BoundingBox& bounds);
+	static DirectX::BoundingBox ToBoundingBox(const Bounds& bounds);
+
+	int AllocateNode();
+	void FreeNode(int node);
+
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+
+	// Rotate a subtree whose children differ in height by more than one, returns the subtree's new root
+	int Balance(int node);
+
+	// Refit boxes and heights from a node up to the root
+	void Refit(int node);
+
+	std::vector<Node> mNodes;
+	int mRoot = -1;
+	int mFreeList = -1;
+	size_t mObjectCount = 0;
+};
@@ -10,40 +10,44 @@ TerrainChunk::TerrainChunk(ID3D12GraphicsCommandList* commandList, FastNoiseLite
 TerrainChunk::~TerrainChunk()
 {
 	delete mMesh;
-	mTriangles.clear();
-	mVertices.clear();
 }
 
 void TerrainChunk::CreateMeshGeometry(ID3D12GraphicsCommandList* commandList)
 {
     mMesh = new Mesh();
-    
-    GenerateGrid(mSize,mSpacing,mVertices,mTriangles);
-    ApplyNoise(0.35,6,mVertices);
 
-    mMesh->mIndices.resize(mTriangles.size() * 3);
+    // Working geometry only lives for the duration of this function
+    std::vector<XMFLOAT3> positions;
+    std::vector<Triangle> triangles;
+    GenerateGrid(mSize,mSpacing,positions,triangles);
+    ApplyNoise(0.35,6,positions);
+
+    std::vector<uint32_t> indices(triangles.size() * 3);
 
     int index = 0;
-    for (auto& triangle : mTriangles)
+    for (auto& triangle : triangles)
     {
-        mMesh->mIndices[index] = triangle.Point[0];
-        mMesh->mIndices[index + 1] = triangle.Point[1];
-        mMesh->mIndices[index + 2] = triangle.Point[2];
+        indices[index] = triangle.Point[0];
+        indices[index + 1] = triangle.Point[1];
+        indices[index + 2] = triangle.Point[2];
         index += 3;
     }
+    std::vector<Triangle>().swap(triangles);
 
-    auto normals = CalculateNormals(mVertices, mMesh->mIndices);
+    auto normals = CalculateNormals(positions, indices);
 
-    mMesh->mVertices.resize(mVertices.size());
+    std::vector<Vertex> vertices(positions.size());
 
     index = 0;
-    for (auto& vertex : mVertices)
+    for (auto& vertex : positions)
     {
-        mMesh->mVertices[index].Pos = AddFloat3(vertex,mPosition).Pos;
-        mMesh->mVertices[index].Normal = normals[index];
+        vertices[index].Pos = AddFloat3(vertex,mPosition).Pos;
+        vertices[index].Normal = normals[index];
         index++;
     }
 
+    // Hand the geometry to the mesh, it is freed once the upload completes
+    mMesh->SetGeometry(std::move(vertices), std::move(indices));
     mMesh->CalculateBufferData(D3DDevice.Get(),commandList);
 }
 
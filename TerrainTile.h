@@ -18,7 +18,5 @@ private:
 	void GenerateGrid(int size, float spacing, std::vector<XMFLOAT3>& vertices, std::vector<Triangle>& triangles);
 	void ApplyNoise(float frequency, int octaves, std::vector<XMFLOAT3>& vertices);
 	FastNoiseLite* mNoise;
-	std::vector<Triangle> mTriangles;
-	std::vector<XMFLOAT3> mVertices;
 };
 
@@ -0,0 +1,52 @@
+#include "TextureArrayBuilder.h"
+#include "TexturePacker.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace DirectX;
+
+size_t TextureArrayBuilder::GetSizeClass(const std::wstring& path)
+{
+	TexMetadata metadata;
+	bool dds = path.size() > 4 && _wcsicmp(path.c_str() + path.size() - 4, L".dds") == 0;
+	HRESULT hr = dds ?
+		GetMetadataFromDDSFile(path.c_str(), DDS_FLAGS_NONE, metadata) :
+		GetMetadataFromWICFile(path.c_str(), WIC_FLAGS_NONE, metadata);
+	if (FAILED(hr)) return 0;
+
+	size_t largest = std::max(metadata.width, metadata.height);
+	size_t size = 4;
+	while (size < largest) size *= 2;
+	return size;
+}
+
+bool TextureArrayBuilder::Build(const std::vector<std::wstring>& sources, size_t size, ScratchImage& array)
+{
+	if (sources.empty()) return false;
+
+	ScratchImage base;
+	if (FAILED(base.Initialize2D(DXGI_FORMAT_R8G8B8A8_UNORM, size, size, sources.size(), 1))) return false;
+
+	for (size_t slice = 0; slice < sources.size(); ++slice)
+	{
+		ScratchImage image;
+		if (!TexturePacker::LoadSource(sources[slice], image)) return false;
+
+		// Scale up to the class size
+		if (image.GetMetadata().width != size || image.GetMetadata().height != size)
+		{
+			ScratchImage resized;
+			if (FAILED(Resize(*image.GetImage(0, 0, 0), size, size, TEX_FILTER_DEFAULT, resized))) return false;
+			image = std::move(resized);
+		}
+
+		const Image* source = image.GetImage(0, 0, 0);
+		const Image* target = base.GetImage(0, slice, 0);
+		for (size_t y = 0; y < size; ++y)
+		{
+			memcpy(target->pixels + y * target->rowPitch, source->pixels + y * source->rowPitch, size * 4);
+		}
+	}
+
+	return SUCCEEDED(GenerateMipMaps(base.GetImages(), base.GetImageCount(), base.GetMetadata(), TEX_FILTER_DEFAULT, 0, array));
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <DirectXTex.h>
+#include <string>
+#include <vector>
+
+// Builds texture arrays out of many small textures so meshes using them can share one descriptor
+// Textures are grouped by size class, the next power of two of their largest side, and scaled to a square
+// of that size. UVs are normalised so scaling does not change how they map or wrap
+class TextureArrayBuilder
+{
+public:
+	// 0 if the file header could not be read
+	static size_t GetSizeClass(const std::wstring& path);
+
+	// One RGBA8 slice per source in order, size x size with a full mip chain
+	static bool Build(const std::vector<std::wstring>& sources, size_t size, DirectX::ScratchImage& array);
+};
@@ -0,0 +1,377 @@
+#include "TextureCache.h"
+#include "TextureArrayBuilder.h"
+#include "Common.h"
+#include <fstream>
+#include <algorithm>
+
+// Textures loaded with generated mips are different resources from the same file without them
+static std::wstring MakePathKey(const std::wstring& path, bool mips)
+{
+	return mips ? path + L"|mips" : path;
+}
+
+static std::pair<uint64_t, bool> MakeContentKey(uint64_t hash, bool mips)
+{
+	return { hash, mips };
+}
+
+static bool IsDDS(const std::wstring& path)
+{
+	return path.size() > 4 && _wcsicmp(path.c_str() + path.size() - 4, L".dds") == 0;
+}
+
+// Whether two files hold exactly the same bytes, read in chunks so a mismatch stops early
+static bool FilesMatch(const std::wstring& a, const std::wstring& b)
+{
+	if (a == b) return true;
+
+	std::ifstream fileA(a, std::ios::binary | std::ios::ate);
+	std::ifstream fileB(b, std::ios::binary | std::ios::ate);
+	if (!fileA || !fileB || fileA.tellg() != fileB.tellg()) return false;
+
+	size_t remaining = (size_t)fileA.tellg();
+	fileA.seekg(0);
+	fileB.seekg(0);
+
+	const size_t CHUNK_SIZE = 64 * 1024;
+	std::vector<char> chunkA(CHUNK_SIZE), chunkB(CHUNK_SIZE);
+	while (remaining > 0)
+	{
+		size_t size = std::min(CHUNK_SIZE, remaining);
+		if (!fileA.read(chunkA.data(), size) || !fileB.read(chunkB.data(), size) || memcmp(chunkA.data(), chunkB.data(), size) != 0) return false;
+		remaining -= size;
+	}
+	return true;
+}
+
+TextureCache::TextureCache(int firstDescriptor, int descriptorCount)
+	: mNextDescriptor(firstDescriptor), mEndDescriptor(firstDescriptor + descriptorCount), mDecoder(*Jobs)
+{
+}
+
+TextureCache::~TextureCache()
+{
+	// Any handles still held after this point would release into a dead cache
+	mPendingReleases.clear();
+}
+
+TextureHandle TextureCache::Load(const std::wstring& path, bool generateMips)
+{
+	auto pathKey = MakePathKey(path, generateMips);
+	auto byPath = mByPath.find(pathKey);
+	if (byPath != mByPath.end())
+	{
+		if (auto texture = byPath->second.lock()) return texture;
+	}
+
+	// Dds files with mips start with only their smallest ones and stream the rest, without reading the whole file
+	if (Streamer && IsDDS(path))
+	{
+		if (auto texture = LoadStreamed(path, pathKey, generateMips)) return texture;
+	}
+
+	// Read and decoded on a worker if it was prefetched
+	auto decoded = mDecoder.Take(path);
+	if (decoded && decoded->Failed)
+	{
+		mDecoder.Recycle(std::move(decoded));
+	}
+	else if (decoded)
+	{
+		auto texture = Load(path, pathKey, generateMips, decoded->ContentHash, decoded->FileData, decoded.get());
+		mDecoder.Recycle(std::move(decoded));
+		return texture;
+	}
+
+	// Read the file once, it is hashed and then decoded from memory
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) return nullptr;
+
+	std::vector<uint8_t> data((size_t)file.tellg());
+	file.seekg(0);
+	if (data.empty() || !file.read(reinterpret_cast<char*>(data.data()), data.size())) return nullptr;
+
+	return Load(path, pathKey, generateMips, HashBytes(data.data(), data.size()), data, nullptr);
+}
+
+void TextureCache::Prefetch(const std::wstring& path, bool generateMips)
+{
+	// Already loaded under this name
+	auto byPath = mByPath.find(MakePathKey(path, generateMips));
+	if (byPath != mByPath.end() && !byPath->second.expired()) return;
+
+	// Streamed dds files only read their header and smallest mips, reading them whole here would be wasted
+	if (Streamer && IsDDS(path)) return;
+
+	mDecoder.Queue(path);
+}
+
+TextureHandle TextureCache::FindContent(const std::wstring& path, const std::wstring& pathKey, bool generateMips, uint64_t hash, size_t fileSize)
+{
+	// Same image under another name. A matching hash is only a candidate, the files are compared byte for byte so
+	// two different files sharing a hash never share a texture
+	auto byContent = mByContent.find(MakeContentKey(hash, generateMips));
+	if (byContent == mByContent.end()) return nullptr;
+
+	auto texture = byContent->second.lock();
+	if (!texture || texture->FileSize != fileSize || !FilesMatch(texture->Path, path)) return nullptr;
+
+	AddPathKey(texture, pathKey);
+	return texture;
+}
+
+TextureHandle TextureCache::LoadStreamed(const std::wstring& path, const std::wstring& pathKey, bool generateMips)
+{
+	StreamedTextureFile file;
+	if (!TextureStreamer::ReadInitial(path, file)) return nullptr;
+
+	// Keyed by the header and the mips read, the rest of the file is compared if that matches another texture
+	uint64_t hash = HashBytes(file.Data.data(), file.Data.size());
+	if (auto texture = FindContent(path, pathKey, generateMips, hash, file.FileSize)) return texture;
+
+	auto texture = new CachedTexture();
+	if (!Streamer->CreateInitial(file, texture))
+	{
+		delete texture;
+		return nullptr;
+	}
+
+	texture->Path = path;
+	texture->ContentHash = hash;
+	texture->FileSize = file.FileSize;
+	texture->Mips = generateMips;
+	auto handle = Add(texture, pathKey);
+	Streamer->Track(handle);
+	return handle;
+}
+
+TextureHandle TextureCache::Load(const std::wstring& path, const std::wstring& pathKey, bool generateMips, uint64_t hash,
+	const std::vector<uint8_t>& data, const DecodedImage* decoded)
+{
+	if (auto texture = FindContent(path, pathKey, generateMips, hash, data.size())) return texture;
+
+	ComPtr<ID3D12Resource> resource;
+	bool loaded = false;
+	if (IsDDS(path)) loaded = Uploader->LoadDDSTexture(data.data(), data.size(), resource.GetAddressOf());
+	else if (decoded) loaded = Uploader->LoadDecodedTexture(decoded->Pixels.data(), decoded->Width, decoded->Height, decoded->SRGB, resource.GetAddressOf(), generateMips);
+	else loaded = Uploader->LoadWICTexture(data.data(), data.size(), resource.GetAddressOf(), generateMips);
+	if (!loaded) return nullptr;
+
+	return Add(resource, path, pathKey, hash, data.size(), generateMips);
+}
+
+TextureHandle TextureCache::LoadPacked(const std::wstring sources[TexturePacker::CHANNEL_COUNT])
+{
+	// Packed textures are keyed by their sources, there is no file to hash
+	std::wstring pathKey = L"packed";
+	for (int i = 0; i < TexturePacker::CHANNEL_COUNT; ++i)
+	{
+		pathKey += L'|' + sources[i];
+	}
+
+	auto byPath = mByPath.find(pathKey);
+	if (byPath != mByPath.end())
+	{
+		if (auto texture = byPath->second.lock()) return texture;
+	}
+
+	DirectX::ScratchImage packed;
+	if (!TexturePacker::Pack(sources, packed)) return nullptr;
+
+	auto resource = UploadImage(packed);
+	if (!resource) return nullptr;
+
+	return Add(resource, pathKey, pathKey, HashBytes(pathKey.data(), pathKey.size() * sizeof(wchar_t)), 0, true);
+}
+
+TextureHandle TextureCache::LoadArray(const std::vector<std::wstring>& sources, size_t size)
+{
+	// Arrays are keyed by their size and slices in order
+	std::wstring pathKey = L"array|" + std::to_wstring(size);
+	for (auto& source : sources)
+	{
+		pathKey += L'|' + source;
+	}
+
+	auto byPath = mByPath.find(pathKey);
+	if (byPath != mByPath.end())
+	{
+		if (auto texture = byPath->second.lock()) return texture;
+	}
+
+	DirectX::ScratchImage array;
+	if (!TextureArrayBuilder::Build(sources, size, array)) return nullptr;
+
+	auto resource = UploadImage(array);
+	if (!resource) return nullptr;
+
+	return Add(resource, pathKey, pathKey, HashBytes(pathKey.data(), pathKey.size() * sizeof(wchar_t)), 0, true, true);
+}
+
+TextureHandle TextureCache::LoadDefaultArray()
+{
+	const std::wstring pathKey = L"array|white";
+	auto byPath = mByPath.find(pathKey);
+	if (byPath != mByPath.end())
+	{
+		if (auto texture = byPath->second.lock()) return texture;
+	}
+
+	DirectX::ScratchImage white;
+	if (FAILED(white.Initialize2D(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1))) return nullptr;
+	memset(white.GetPixels(), 0xFF, white.GetPixelsSize());
+
+	auto resource = UploadImage(white);
+	if (!resource) return nullptr;
+
+	return Add(resource, pathKey, pathKey, HashBytes(pathKey.data(), pathKey.size() * sizeof(wchar_t)), 0, true, true);
+}
+
+ComPtr<ID3D12Resource> TextureCache::UploadImage(const DirectX::ScratchImage& image)
+{
+	ComPtr<ID3D12Resource> resource;
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	if (FAILED(DirectX::CreateTexture(D3DDevice.Get(), image.GetMetadata(), resource.GetAddressOf())) ||
+		FAILED(DirectX::PrepareUpload(D3DDevice.Get(), image.GetImages(), image.GetImageCount(), image.GetMetadata(), subresources)))
+	{
+		return nullptr;
+	}
+
+	// Pixels are copied into the staging ring here, so the image can go
+	Uploader->UploadTexture(resource.Get(), subresources.data(), (UINT)subresources.size());
+	return resource;
+}
+
+TextureHandle TextureCache::Add(ComPtr<ID3D12Resource> resource, const std::wstring& path, const std::wstring& pathKey, uint64_t hash, size_t fileSize,
+	bool mips, bool array)
+{
+	auto texture = new CachedTexture();
+	texture->Path = path;
+	texture->ContentHash = hash;
+	texture->FileSize = fileSize;
+	texture->Mips = mips;
+	texture->Array = array;
+	texture->Resource = resource;
+	return Add(texture, pathKey);
+}
+
+TextureHandle TextureCache::Add(CachedTexture* texture, const std::wstring& pathKey)
+{
+	texture->DescriptorIndex = AllocateDescriptor();
+	CreateSRV(texture);
+
+	TextureHandle handle(texture, [this](CachedTexture* released) { Release(released); });
+	AddPathKey(handle, pathKey);
+	mByContent[MakeContentKey(texture->ContentHash, texture->Mips)] = handle;
+	mTextureCount++;
+	return handle;
+}
+
+void TextureCache::AddPathKey(const TextureHandle& texture, const std::wstring& pathKey)
+{
+	mByPath[pathKey] = texture;
+	texture->PathKeys.push_back(pathKey);
+}
+
+void TextureCache::ReplaceResource(CachedTexture* texture, ComPtr<ID3D12Resource> resource)
+{
+	// Frames in flight may still be sampling the old one
+	mPendingReleases.push_back({ texture->Resource, -1, 0 });
+	texture->Resource = resource;
+	CreateSRV(texture);
+	texture->Version++;
+}
+
+void TextureCache::Release(CachedTexture* texture)
+{
+	// Drop lookups that pointed at this texture, unless the name has since been loaded again
+	for (auto& pathKey : texture->PathKeys)
+	{
+		auto byPath = mByPath.find(pathKey);
+		if (byPath != mByPath.end() && byPath->second.expired()) mByPath.erase(byPath);
+	}
+
+	auto byContent = mByContent.find(MakeContentKey(texture->ContentHash, texture->Mips));
+	if (byContent != mByContent.end() && byContent->second.expired()) mByContent.erase(byContent);
+
+	// The GPU may still be sampling it, so keep the resource and descriptor until the next fence
+	mPendingReleases.push_back({ texture->Resource, texture->DescriptorIndex, 0 });
+	mTextureCount--;
+	delete texture;
+}
+
+void TextureCache::FenceReleases(UINT64 fenceValue)
+{
+	for (auto& release : mPendingReleases)
+	{
+		if (release.FenceValue == 0) release.FenceValue = fenceValue;
+	}
+}
+
+void TextureCache::ReleaseCompleted(UINT64 completedFenceValue)
+{
+	for (auto& release : mPendingReleases)
+	{
+		if (release.FenceValue != 0 && release.FenceValue <= completedFenceValue && release.DescriptorIndex >= 0)
+		{
+			mFreeDescriptors.push_back(release.DescriptorIndex);
+		}
+	}
+
+	mPendingReleases.erase(std::remove_if(mPendingReleases.begin(), mPendingReleases.end(),
+		[completedFenceValue](const PendingRelease& release)
+		{
+			return release.FenceValue != 0 && release.FenceValue <= completedFenceValue;
+		}), mPendingReleases.end());
+}
+
+int TextureCache::AllocateDescriptor()
+{
+	if (!mFreeDescriptors.empty())
+	{
+		int index = mFreeDescriptors.back();
+		mFreeDescriptors.pop_back();
+		return index;
+	}
+
+	if (mNextDescriptor >= mEndDescriptor)
+	{
+		MessageBox(0, L"Texture cache is out of descriptors", L"Error", MB_OK);
+		return -1;
+	}
+	return mNextDescriptor++;
+}
+
+void TextureCache::CreateSRV(CachedTexture* texture)
+{
+	if (texture->DescriptorIndex < 0) return;
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(SrvDescriptorHeap->mHeap->GetCPUDescriptorHandleForHeapStart());
+	hDescriptor.Offset(texture->DescriptorIndex, CbvSrvUavDescriptorSize);
+
+	auto desc = texture->Resource->GetDesc();
+
+	// Create descriptor
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = desc.Format;
+	if (texture->Array)
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.MipLevels = desc.MipLevels;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = desc.DepthOrArraySize;
+		srvDesc.Texture2DArray.ResourceMinLODClamp = 0.0f;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = desc.MipLevels;
+		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+	}
+
+	// Create SRV
+	D3DDevice->CreateShaderResourceView(texture->Resource.Get(), &srvDesc, hDescriptor);
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include "d3dx12.h"
+#include "TexturePacker.h"
+#include "TextureDecoder.h"
+
+#include <windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <map>
+
+using Microsoft::WRL::ComPtr;
+
+// A texture shared by every material that uses it, with an SRV that never moves
+struct CachedTexture
+{
+	std::wstring Path;
+	uint64_t ContentHash = 0;
+	bool Mips = false;
+
+	// Size of the file it was loaded from, checked with the hash before comparing it with another file
+	size_t FileSize = 0;
+
+	// Keys it is registered under in the path lookup, dropped when it is released
+	std::vector<std::wstring> PathKeys;
+
+	// Viewed as a Texture2DArray, even with one slice
+	bool Array = false;
+	ComPtr<ID3D12Resource> Resource;
+	int DescriptorIndex = -1;
+
+	// Bumped when Resource is replaced, copies of the descriptor need refreshing
+	UINT Version = 0;
+
+	// Mip streaming, see TextureStreamer. Mips finer than ResidentMip are not on the GPU
+	bool Streamed = false;
+	DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+	UINT Width = 0;
+	UINT Height = 0;
+	int MipCount = 1;
+	std::vector<UINT64> MipOffsets;
+	int InitialMip = 0;
+	int ResidentMip = 0;
+	int NeededMip = 0;
+	UINT64 ResidentBytes = 0;
+	UINT64 LastNeededFrame = 0;
+};
+
+// Holding a handle keeps the texture loaded
+using TextureHandle = std::shared_ptr<CachedTexture>;
+
+// Loads each texture once for the whole engine. Textures are found by path and by a hash of the file
+// contents, so the same image under two names is only decoded and uploaded once.
+// When the last handle goes the texture and its descriptor are freed after the GPU is done with them
+class TextureCache
+{
+public:
+	// Stable descriptors are taken from this range of the SRV heap
+	TextureCache(int firstDescriptor, int descriptorCount);
+	~TextureCache();
+
+	// Returns nullptr if the file could not be loaded
+	TextureHandle Load(const std::wstring& path, bool generateMips = false);
+
+	// Start reading and decoding a file on a worker thread so a later Load only has to upload it
+	// Queue everything about to be loaded first, then load in any order
+	void Prefetch(const std::wstring& path, bool generateMips = false);
+
+	// Drop prefetched files that were never loaded
+	void CancelPrefetches() { mDecoder.CancelAll(); }
+
+	// Single channel maps packed into one RGBA texture with mips, see TexturePacker. Returns nullptr if packing failed
+	TextureHandle LoadPacked(const std::wstring sources[TexturePacker::CHANNEL_COUNT]);
+
+	// Sources scaled to size x size in one texture array, slices in order. See TextureArrayBuilder
+	TextureHandle LoadArray(const std::vector<std::wstring>& sources, size_t size);
+
+	// 1x1 white array with one slice, for materials whose array could not be built. nullptr if it could not be created
+	TextureHandle LoadDefaultArray();
+
+	// Textures released since the last call are freed once this fence completes
+	void FenceReleases(UINT64 fenceValue);
+	void ReleaseCompleted(UINT64 completedFenceValue);
+
+	size_t GetTextureCount() const { return mTextureCount; }
+
+	// Swap in a new resource for a texture, e.g. with more or fewer mips. The old one is freed after the next fence
+	void ReplaceResource(CachedTexture* texture, ComPtr<ID3D12Resource> resource);
+
+private:
+	struct PendingRelease
+	{
+		ComPtr<ID3D12Resource> Resource;
+		int DescriptorIndex;
+		UINT64 FenceValue;
+	};
+
+	// Load from file contents, or pixels already decoded by the decoder
+	TextureHandle Load(const std::wstring& path, const std::wstring& pathKey, bool generateMips, uint64_t hash,
+		const std::vector<uint8_t>& data, const DecodedImage* decoded);
+
+	// Dds file with only its smallest mips loaded, see TextureStreamer. nullptr if it is not one to stream
+	TextureHandle LoadStreamed(const std::wstring& path, const std::wstring& pathKey, bool generateMips);
+
+	// A texture already loaded from a file with the same contents, registered under pathKey. nullptr if there is none
+	TextureHandle FindContent(const std::wstring& path, const std::wstring& pathKey, bool generateMips, uint64_t hash, size_t fileSize);
+
+	// Create a resource for an image built on the CPU and queue its upload
+	ComPtr<ID3D12Resource> UploadImage(const DirectX::ScratchImage& image);
+
+	// Register a newly uploaded texture
+	TextureHandle Add(ComPtr<ID3D12Resource> resource, const std::wstring& path, const std::wstring& pathKey, uint64_t hash, size_t fileSize,
+		bool mips, bool array = false);
+	TextureHandle Add(CachedTexture* texture, const std::wstring& pathKey);
+
+	// Look a texture up under another name
+	void AddPathKey(const TextureHandle& texture, const std::wstring& pathKey);
+
+	// Called when the last handle to a texture is dropped
+	void Release(CachedTexture* texture);
+
+	int AllocateDescriptor();
+	void CreateSRV(CachedTexture* texture);
+
+	// Handles that keep a texture loaded are the only strong references
+	std::unordered_map<std::wstring, std::weak_ptr<CachedTexture>> mByPath;
+	// By content hash and whether it has generated mips
+	std::map<std::pair<uint64_t, bool>, std::weak_ptr<CachedTexture>> mByContent;
+
+	int mNextDescriptor = 0;
+	int mEndDescriptor = 0;
+	std::vector<int> mFreeDescriptors;
+
+	std::vector<PendingRelease> mPendingReleases;
+	size_t mTextureCount = 0;
+
+	TextureDecoder mDecoder;
+};
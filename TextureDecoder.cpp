@@ -0,0 +1,245 @@
+#include "TextureDecoder.h"
+#include "ImageDecoder.h"
+#include "Hash.h"
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cwctype>
+#include <cstring>
+
+// Buffers held for reuse, anything past this is freed
+const size_t MAX_POOLED_BUFFERS = 16;
+
+// Largest 2D texture D3D12 can create
+const uint32_t MAX_IMAGE_SIZE = 16384;
+
+TextureDecoder::TextureDecoder(JobSystem& jobs)
+	: mJobSystem(jobs)
+{
+}
+
+TextureDecoder::~TextureDecoder()
+{
+	CancelAll();
+
+	// Jobs still queued or running refer to the decoder
+	for (auto& job : mAbandoned)
+	{
+		mJobSystem.Wait(job->Done);
+	}
+}
+
+void TextureDecoder::Queue(const std::wstring& path)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	if (mJobs.count(path)) return;
+
+	// Forget abandoned jobs that have run since
+	mAbandoned.erase(std::remove_if(mAbandoned.begin(), mAbandoned.end(), [](const auto& job) { return job->Done.IsDone(); }), mAbandoned.end());
+
+	auto job = std::make_shared<Job>();
+	job->Image = std::make_unique<DecodedImage>();
+	job->Image->Path = path;
+	mJobs[path] = job;
+	mJobSystem.Run([this, job]() { RunJob(job); }, &job->Done);
+}
+
+std::unique_ptr<DecodedImage> TextureDecoder::Take(const std::wstring& path)
+{
+	std::shared_ptr<Job> job;
+	bool started;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		auto found = mJobs.find(path);
+		if (found == mJobs.end()) return nullptr;
+		job = found->second;
+		mJobs.erase(found);
+
+		// Not started yet, so decode it here rather than wait for a worker to get to it
+		started = job->Started;
+		if (!started)
+		{
+			job->Started = true;
+			mAbandoned.push_back(job);
+		}
+	}
+
+	if (started)
+	{
+		// Runs other jobs while it waits
+		mJobSystem.Wait(job->Done);
+		return std::move(job->Image);
+	}
+
+	Process(*job->Image);
+	return std::move(job->Image);
+}
+
+void TextureDecoder::Recycle(std::unique_ptr<DecodedImage> image)
+{
+	if (!image) return;
+
+	std::lock_guard<std::mutex> lock(mPoolLock);
+	for (auto buffer : { &image->FileData, &image->Pixels })
+	{
+		if (buffer->capacity() == 0) continue;
+		mPool.push_back(std::move(*buffer));
+	}
+
+	// Keep the largest buffers, they fit the most images
+	if (mPool.size() > MAX_POOLED_BUFFERS)
+	{
+		std::sort(mPool.begin(), mPool.end(), [](const auto& a, const auto& b) { return a.capacity() > b.capacity(); });
+		mPool.resize(MAX_POOLED_BUFFERS);
+	}
+}
+
+void TextureDecoder::CancelAll()
+{
+	std::vector<std::unique_ptr<DecodedImage>> finished;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		for (auto& [path, job] : mJobs)
+		{
+			// Jobs drop their image when they see they were cancelled
+			if (job->Done.IsDone()) finished.push_back(std::move(job->Image));
+			else
+			{
+				job->Cancelled = true;
+				mAbandoned.push_back(job);
+			}
+		}
+		mJobs.clear();
+	}
+
+	for (auto& image : finished)
+	{
+		Recycle(std::move(image));
+	}
+}
+
+void TextureDecoder::RunJob(const std::shared_ptr<Job>& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		if (job->Started || job->Cancelled) return;
+		job->Started = true;
+	}
+
+	Process(*job->Image);
+
+	bool cancelled;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		cancelled = job->Cancelled;
+	}
+	if (cancelled) Recycle(std::move(job->Image));
+}
+
+TextureDecoder::BenchmarkResults TextureDecoder::Benchmark(JobSystem& jobs, const std::vector<std::wstring>& paths)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	BenchmarkResults results;
+	TextureDecoder decoder(jobs);
+
+	// Files that fail are left out of both passes so they time the same work
+	std::vector<std::wstring> decodable;
+	Clock::duration serialTime{};
+	for (auto& path : paths)
+	{
+		auto image = std::make_unique<DecodedImage>();
+		image->Path = path;
+		auto start = Clock::now();
+		decoder.Process(*image);
+		if (!image->Failed && !image->Pixels.empty())
+		{
+			serialTime += Clock::now() - start;
+			decodable.push_back(path);
+			results.Megapixels += image->Width * (double)image->Height / 1000000.0;
+		}
+		decoder.Recycle(std::move(image));
+	}
+
+	auto start = Clock::now();
+	for (auto& path : decodable) decoder.Queue(path);
+	for (auto& path : decodable) decoder.Recycle(decoder.Take(path));
+	auto parallelTime = Clock::now() - start;
+
+	results.Files = decodable.size();
+	results.SerialMs = std::chrono::duration<double, std::milli>(serialTime).count();
+	results.ParallelMs = std::chrono::duration<double, std::milli>(parallelTime).count();
+	return results;
+}
+
+bool TextureDecoder::IsDDS(const std::wstring& path)
+{
+	static const wchar_t EXTENSION[] = L".dds";
+	const size_t length = 4;
+	if (path.size() <= length) return false;
+	for (size_t i = 0; i < length; ++i)
+	{
+		if ((wchar_t)std::towlower(path[path.size() - length + i]) != EXTENSION[i]) return false;
+	}
+	return true;
+}
+
+void TextureDecoder::Process(DecodedImage& image)
+{
+	std::ifstream file(std::filesystem::path(image.Path), std::ios::binary | std::ios::ate);
+	size_t size = file ? (size_t)file.tellg() : 0;
+	AcquireBuffer(image.FileData, size);
+	file.seekg(0);
+	if (size == 0 || !file.read(reinterpret_cast<char*>(image.FileData.data()), size))
+	{
+		image.Failed = true;
+		return;
+	}
+
+	image.ContentHash = HashBytes(image.FileData.data(), image.FileData.size());
+
+	if (IsDDS(image.Path)) return;
+
+	image.Failed = !DecodeImage(image);
+}
+
+bool TextureDecoder::DecodeImage(DecodedImage& image)
+{
+	ImageInfo info;
+	if (!ImageDecoder::ReadInfo(image.FileData.data(), image.FileData.size(), info) ||
+		info.Width > MAX_IMAGE_SIZE || info.Height > MAX_IMAGE_SIZE)
+	{
+		return false;
+	}
+
+	// Every source format is expanded to RGBA8 straight into a pooled buffer
+	AcquireBuffer(image.Pixels, (size_t)info.Width * info.Height * 4);
+	if (!ImageDecoder::Decode(image.FileData.data(), image.FileData.size(), info, image.Pixels.data())) return false;
+
+	image.Width = info.Width;
+	image.Height = info.Height;
+	image.SRGB = info.SRGB;
+	return true;
+}
+
+void TextureDecoder::AcquireBuffer(std::vector<uint8_t>& buffer, size_t size)
+{
+	{
+		std::lock_guard<std::mutex> lock(mPoolLock);
+
+		// Smallest pooled buffer that fits
+		auto best = mPool.end();
+		for (auto it = mPool.begin(); it != mPool.end(); ++it)
+		{
+			if (it->capacity() >= size && (best == mPool.end() || it->capacity() < best->capacity())) best = it;
+		}
+
+		if (best != mPool.end())
+		{
+			buffer = std::move(*best);
+			mPool.erase(best);
+		}
+	}
+
+	buffer.resize(size);
+}
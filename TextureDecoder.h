@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include "JobSystem.h"
+
+// A texture file read and, for jpg/png, decoded to RGBA8 on a worker thread
+struct DecodedImage
+{
+	std::wstring Path;
+	uint64_t ContentHash = 0;
+	bool Failed = false;
+
+	// File contents, loaded as they are for dds files and compared against cached textures with the same hash
+	std::vector<uint8_t> FileData;
+
+	// Tightly packed RGBA8 rows, empty for dds files
+	std::vector<uint8_t> Pixels;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+
+	// Pixels are sRGB encoded and should be sampled through an sRGB format, see ImageInfo
+	bool SRGB = false;
+};
+
+// Reads and decodes texture files as jobs on the engine's job system so startups with many textures use every core
+// Callers queue the files they are about to load and take the results in any order, waiting only if a file
+// is still being decoded. Pixel and file buffers come from a pool and go back to it once uploaded
+// Has no Windows or graphics API dependency, so it can be benchmarked headless on any platform
+class TextureDecoder
+{
+public:
+	// Decode jobs run on the given job system, which must outlive the decoder
+	TextureDecoder(JobSystem& jobs);
+	~TextureDecoder();
+
+	// Start reading a file, does nothing if it is already queued
+	void Queue(const std::wstring& path);
+
+	// Finished image for a queued file, waiting for it if needed. nullptr if the file was never queued
+	// A queued file no worker has started yet is decoded on the calling thread instead
+	std::unique_ptr<DecodedImage> Take(const std::wstring& path);
+
+	// Give an image's buffers back to the pool
+	void Recycle(std::unique_ptr<DecodedImage> image);
+
+	// Forget queued files that were not taken, finished images are recycled
+	void CancelAll();
+
+	// Time to read and decode a set of files, on one thread and then queued as jobs as a model load does
+	struct BenchmarkResults
+	{
+		size_t Files = 0;				// Decoded without errors, failed files are left out of the timings
+		double Megapixels = 0;
+		double SerialMs = 0;			// One file after another on the calling thread
+		double ParallelMs = 0;			// Every file queued, then taken in order
+	};
+	static BenchmarkResults Benchmark(JobSystem& jobs, const std::vector<std::wstring>& paths);
+
+private:
+	struct Job
+	{
+		std::unique_ptr<DecodedImage> Image;
+		bool Started = false;
+		bool Cancelled = false;
+
+		// Done once the job has run, whether it decoded the file or found it already taken or cancelled
+		JobCounter Done;
+	};
+
+	// Job queued for a file, decodes it unless it was taken or cancelled first
+	void RunJob(const std::shared_ptr<Job>& job);
+	void Process(DecodedImage& image);
+
+	// Dds files are already in their GPU format and are not decoded
+	static bool IsDDS(const std::wstring& path);
+
+	// Decode jpg/png file contents into the image's pixels, see ImageDecoder. It needs no COM or Windows codecs
+	bool DecodeImage(DecodedImage& image);
+
+	// Buffer with at least this much room, reusing pooled memory when there is some
+	void AcquireBuffer(std::vector<uint8_t>& buffer, size_t size);
+
+	JobSystem& mJobSystem;
+	std::mutex mLock;
+
+	std::unordered_map<std::wstring, std::shared_ptr<Job>> mJobs;
+
+	// Jobs taken or cancelled before they finished, the job system may still hold them so they are waited for
+	// before the decoder goes away
+	std::vector<std::shared_ptr<Job>> mAbandoned;
+
+	// Released buffers, largest kept up to a limit
+	std::mutex mPoolLock;
+	std::vector<std::vector<uint8_t>> mPool;
+};
@@ -0,0 +1,109 @@
+#include "TextureIndex.h"
+#include <algorithm>
+#include <cwctype>
+
+namespace
+{
+	// File name suffix for each map, some sources use "metallic" for metalness
+	struct MapName
+	{
+		const wchar_t* Name;
+		TextureMap Map;
+	};
+
+	const MapName MAP_NAMES[] =
+	{
+		{ L"albedo", TextureMap::Albedo },
+		{ L"roughness", TextureMap::Roughness },
+		{ L"normal", TextureMap::Normal },
+		{ L"metalness", TextureMap::Metalness },
+		{ L"metallic", TextureMap::Metalness },
+		{ L"height", TextureMap::Height },
+		{ L"ao", TextureMap::AO },
+		{ L"emissive", TextureMap::Emissive },
+		{ L"packed", TextureMap::Packed },
+	};
+
+	// Lower is better, transcoded output first then the order the loaders were tried in
+	int ExtensionRank(const std::wstring& extension, bool transcoded)
+	{
+		if (transcoded) return 0;
+		if (extension == L".dds") return 1;
+		if (extension == L".jpg") return 2;
+		if (extension == L".png") return 3;
+		return -1;
+	}
+
+	std::wstring ToLower(std::wstring text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), [](wchar_t c) { return (wchar_t)std::towlower(c); });
+		return text;
+	}
+}
+
+std::wstring TextureIndex::MakeKey(const std::wstring& materialPath, TextureMap map)
+{
+	std::wstring key = ToLower(materialPath);
+	std::replace(key.begin(), key.end(), L'\\', L'/');
+	key += L'|';
+	key += (wchar_t)(L'0' + (int)map);
+	return key;
+}
+
+bool TextureIndex::ParseFileName(const std::filesystem::path& path, std::wstring& materialPath, TextureMap& map, int& rank)
+{
+	// Transcoder output is <material><separator><map>.bc.dds
+	std::wstring stem = path.stem().wstring();
+	std::wstring extension = ToLower(path.extension().wstring());
+	bool transcoded = extension == L".dds" && stem.size() > 3 && ToLower(stem.substr(stem.size() - 3)) == TRANSCODED_SUFFIX;
+	if (transcoded) stem.resize(stem.size() - 3);
+
+	rank = ExtensionRank(extension, transcoded);
+	if (rank < 0) return false;
+
+	// Split the name at the last separator and see if the rest names a map
+	size_t separator = stem.find_last_of(L"-_");
+	if (separator == std::wstring::npos || separator == 0) return false;
+
+	std::wstring suffix = ToLower(stem.substr(separator + 1));
+	for (auto& mapName : MAP_NAMES)
+	{
+		if (suffix != mapName.Name) continue;
+
+		materialPath = (path.parent_path() / stem.substr(0, separator)).generic_wstring();
+		map = mapName.Map;
+		return true;
+	}
+	return false;
+}
+
+void TextureIndex::Build(const std::wstring& root)
+{
+	mEntries.clear();
+	mFileCount = 0;
+
+	std::error_code error;
+	for (auto it = std::filesystem::recursive_directory_iterator(root, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+	{
+		if (!it->is_regular_file(error)) continue;
+
+		std::wstring materialPath;
+		TextureMap map;
+		int rank;
+		if (!ParseFileName(it->path(), materialPath, map, rank)) continue;
+
+		auto key = MakeKey(materialPath, map);
+		auto existing = mEntries.find(key);
+		if (existing == mEntries.end() || rank < existing->second.Rank)
+		{
+			mEntries[key] = { it->path().generic_wstring(), rank };
+		}
+		mFileCount++;
+	}
+}
+
+std::wstring TextureIndex::Find(const std::wstring& materialPath, TextureMap map) const
+{
+	auto entry = mEntries.find(MakeKey(materialPath, map));
+	return entry != mEntries.end() ? entry->second.Path : std::wstring();
+}
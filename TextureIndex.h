@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <filesystem>
+
+// Texture maps a material can have. The first MATERIAL_TEXTURE_COUNT are the material's descriptor table in order,
+// the single channel maps after them are combined into the packed map
+enum class TextureMap
+{
+	Albedo,
+	Normal,
+	Packed,
+	Emissive,
+	Roughness,
+	Metalness,
+	Height,
+	AO,
+	Count
+};
+
+const int MATERIAL_TEXTURE_COUNT = (int)TextureMap::Roughness;
+
+// Every texture file under a directory, found with one walk at startup
+// Files are named <material><separator><map>.<extension> with '-' or '_' as the separator,
+// lookups are in memory so no loader ever opens a file that does not exist
+class TextureIndex
+{
+public:
+	// Walk the directory and everything below it
+	void Build(const std::wstring& root);
+
+	// Best file for a material and map, preferring transcoded dds, then dds, jpg and png. Empty if there is none
+	// The material path includes its directory, e.g. Models/octostone
+	std::wstring Find(const std::wstring& materialPath, TextureMap map) const;
+
+	bool HasMap(const std::wstring& materialPath, TextureMap map) const { return !Find(materialPath, map).empty(); }
+
+	size_t GetFileCount() const { return mFileCount; }
+
+	// Splits a texture file name into its material and map. Rank orders files for the same map, lower is better
+	static bool ParseFileName(const std::filesystem::path& path, std::wstring& materialPath, TextureMap& map, int& rank);
+
+	// Stem suffix of block compressed files written by the transcoder, e.g. octostone-albedo.bc.dds
+	static constexpr const wchar_t* TRANSCODED_SUFFIX = L".bc";
+
+private:
+	struct Entry
+	{
+		std::wstring Path;
+		int Rank;
+	};
+
+	static std::wstring MakeKey(const std::wstring& materialPath, TextureMap map);
+
+	std::unordered_map<std::wstring, Entry> mEntries;
+	size_t mFileCount = 0;
+};
@@ -0,0 +1,73 @@
+#include "TexturePacker.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+bool TexturePacker::LoadSource(const std::wstring& path, ScratchImage& image)
+{
+	ScratchImage loaded;
+	bool dds = path.size() > 4 && _wcsicmp(path.c_str() + path.size() - 4, L".dds") == 0;
+	HRESULT hr = dds ?
+		LoadFromDDSFile(path.c_str(), DDS_FLAGS_NONE, nullptr, loaded) :
+		LoadFromWICFile(path.c_str(), WIC_FLAGS_IGNORE_SRGB, nullptr, loaded);
+	if (FAILED(hr)) return false;
+
+	const Image* top = loaded.GetImage(0, 0, 0);
+	if (IsCompressed(top->format))
+	{
+		return SUCCEEDED(Decompress(*top, DXGI_FORMAT_R8G8B8A8_UNORM, image));
+	}
+	if (top->format != DXGI_FORMAT_R8G8B8A8_UNORM)
+	{
+		return SUCCEEDED(Convert(*top, DXGI_FORMAT_R8G8B8A8_UNORM, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, image));
+	}
+	return SUCCEEDED(image.InitializeFromImage(*top));
+}
+
+bool TexturePacker::Pack(const std::wstring sources[CHANNEL_COUNT], ScratchImage& packed)
+{
+	ScratchImage channels[CHANNEL_COUNT];
+	size_t width = 4;
+	size_t height = 4;
+
+	for (int i = 0; i < CHANNEL_COUNT; ++i)
+	{
+		if (sources[i].empty()) continue;
+		if (!LoadSource(sources[i], channels[i])) return false;
+
+		width = std::max(width, channels[i].GetMetadata().width);
+		height = std::max(height, channels[i].GetMetadata().height);
+	}
+
+	// Scale any smaller sources up to the largest
+	for (auto& channel : channels)
+	{
+		if (!channel.GetImageCount()) continue;
+		if (channel.GetMetadata().width == width && channel.GetMetadata().height == height) continue;
+
+		ScratchImage resized;
+		if (FAILED(Resize(*channel.GetImage(0, 0, 0), width, height, TEX_FILTER_DEFAULT, resized))) return false;
+		channel = std::move(resized);
+	}
+
+	ScratchImage base;
+	if (FAILED(base.Initialize2D(DXGI_FORMAT_R8G8B8A8_UNORM, width, height, 1, 1))) return false;
+
+	// Take the red channel of each source, they are all greyscale
+	const Image* target = base.GetImage(0, 0, 0);
+	for (size_t y = 0; y < height; ++y)
+	{
+		uint8_t* row = target->pixels + y * target->rowPitch;
+		for (int c = 0; c < CHANNEL_COUNT; ++c)
+		{
+			const Image* source = channels[c].GetImageCount() ? channels[c].GetImage(0, 0, 0) : nullptr;
+			const uint8_t* sourceRow = source ? source->pixels + y * source->rowPitch : nullptr;
+			for (size_t x = 0; x < width; ++x)
+			{
+				row[x * 4 + c] = sourceRow ? sourceRow[x * 4] : 255;
+			}
+		}
+	}
+
+	return SUCCEEDED(GenerateMipMaps(*target, TEX_FILTER_DEFAULT, 0, packed));
+}
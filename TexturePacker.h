@@ -0,0 +1,22 @@
+#pragma once
+
+#include "TextureIndex.h"
+#include <DirectXTex.h>
+#include <string>
+
+// Packs a material's single channel maps into one RGBA texture, so the PBR shader needs one descriptor
+// and one fetch for all of them instead of four
+class TexturePacker
+{
+public:
+	// Map stored in each channel of the packed texture: R roughness, G metalness, B ambient occlusion, A height
+	static constexpr int CHANNEL_COUNT = 4;
+	static constexpr TextureMap CHANNELS[CHANNEL_COUNT] = { TextureMap::Roughness, TextureMap::Metalness, TextureMap::AO, TextureMap::Height };
+
+	// Sources are file paths in channel order, empty for a map the material does not have which is filled with white
+	// Sources of different sizes are scaled to the largest. The result is RGBA8 with a full mip chain
+	static bool Pack(const std::wstring sources[CHANNEL_COUNT], DirectX::ScratchImage& packed);
+
+	// Top level of any dds, jpg or png, decompressed and converted to RGBA8
+	static bool LoadSource(const std::wstring& path, DirectX::ScratchImage& image);
+};
@@ -0,0 +1,326 @@
+#include "TextureStreamer.h"
+#include "Common.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <cstring>
+
+using namespace DirectX;
+
+// Textures start with mips no larger than this across
+const UINT INITIAL_MIP_SIZE = 64;
+
+// Dds files start with a magic number and a header, and a DX10 extension after it for formats older headers can't describe
+const size_t DDS_HEADER_SIZE = 4 + 124;
+const size_t DDS_DX10_HEADER_SIZE = DDS_HEADER_SIZE + 20;
+const size_t DDS_FOURCC_OFFSET = 4 + 72 + 8;
+
+TextureStreamer::TextureStreamer(UINT64 budget) : mBudget(budget)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// Let a read in progress finish before anything it uses goes
+	if (mRequest && mRequest->Loading.valid()) mRequest->Loading.wait();
+}
+
+bool TextureStreamer::ReadInitial(const std::wstring& path, StreamedTextureFile& file)
+{
+	std::ifstream stream(path, std::ios::binary | std::ios::ate);
+	if (!stream) return false;
+	file.FileSize = (size_t)stream.tellg();
+
+	// Magic and header, then the DX10 extension when the pixel format's four cc says there is one
+	uint8_t header[DDS_DX10_HEADER_SIZE] = {};
+	size_t headerRead = std::min(file.FileSize, DDS_DX10_HEADER_SIZE);
+	stream.seekg(0);
+	if (headerRead < DDS_HEADER_SIZE || !stream.read(reinterpret_cast<char*>(header), headerRead)) return false;
+
+	bool dx10 = memcmp(header + DDS_FOURCC_OFFSET, "DX10", 4) == 0;
+	file.HeaderSize = dx10 ? DDS_DX10_HEADER_SIZE : DDS_HEADER_SIZE;
+	if (headerRead < file.HeaderSize) return false;
+
+	auto& metadata = file.Metadata;
+	if (FAILED(GetMetadataFromDDSMemory(header, file.HeaderSize, DDS_FLAGS_NONE, metadata))) return false;
+	if (metadata.dimension != TEX_DIMENSION_TEXTURE2D || metadata.arraySize != 1 || metadata.mipLevels <= 1) return false;
+
+	// Older uncompressed formats can be expanded or swizzled on load, so their data is not what the GPU takes
+	if (!dx10 && !IsCompressed(metadata.format)) return false;
+
+	// A single 2D texture stores its mips one after another
+	file.MipOffsets.resize(metadata.mipLevels + 1);
+	UINT64 offset = file.HeaderSize;
+	for (size_t mip = 0; mip < metadata.mipLevels; ++mip)
+	{
+		size_t rowPitch, slicePitch;
+		if (FAILED(ComputePitch(metadata.format, std::max<size_t>(1, metadata.width >> mip), std::max<size_t>(1, metadata.height >> mip), rowPitch, slicePitch))) return false;
+		file.MipOffsets[mip] = offset;
+		offset += slicePitch;
+	}
+	file.MipOffsets[metadata.mipLevels] = offset;
+	if (offset > file.FileSize) return false;
+
+	// Block compressed resources need a top level made of whole blocks, which limits how far down they can start
+	int mipCount = (int)metadata.mipLevels;
+	int coarsest = 0;
+	while (coarsest + 1 < mipCount)
+	{
+		size_t width = std::max<size_t>(1, metadata.width >> (coarsest + 1));
+		size_t height = std::max<size_t>(1, metadata.height >> (coarsest + 1));
+		if (IsCompressed(metadata.format) && (width % 4 != 0 || height % 4 != 0)) break;
+		coarsest++;
+	}
+
+	file.InitialMip = 0;
+	while (file.InitialMip < coarsest && (std::max(metadata.width, metadata.height) >> file.InitialMip) > INITIAL_MIP_SIZE) file.InitialMip++;
+
+	// The smallest mips are at the end, read them straight in after the header
+	UINT64 tailOffset = file.MipOffsets[file.InitialMip];
+	file.Data.resize(file.HeaderSize + (size_t)(offset - tailOffset));
+	memcpy(file.Data.data(), header, file.HeaderSize);
+	stream.seekg(tailOffset);
+	return (bool)stream.read(reinterpret_cast<char*>(file.Data.data() + file.HeaderSize), file.Data.size() - file.HeaderSize);
+}
+
+bool TextureStreamer::CreateInitial(const StreamedTextureFile& file, CachedTexture* texture)
+{
+	texture->Format = file.Metadata.format;
+	texture->Width = (UINT)file.Metadata.width;
+	texture->Height = (UINT)file.Metadata.height;
+	texture->MipCount = (int)file.Metadata.mipLevels;
+	texture->MipOffsets = file.MipOffsets;
+
+	texture->Resource = CreateResource(texture, file.InitialMip, file.Data.data() + file.HeaderSize);
+	if (!texture->Resource) return false;
+
+	texture->Streamed = true;
+	texture->InitialMip = file.InitialMip;
+	texture->ResidentMip = file.InitialMip;
+	texture->NeededMip = file.InitialMip;
+	texture->ResidentBytes = GetSize(texture, file.InitialMip);
+	return true;
+}
+
+void TextureStreamer::Track(const std::shared_ptr<CachedTexture>& texture)
+{
+	mTextures.push_back(texture);
+}
+
+void TextureStreamer::RequestSize(CachedTexture* texture, float pixels)
+{
+	if (!texture->Streamed) return;
+
+	// Each mip halves the texels across, so use the coarsest one that still has a texel per pixel
+	float texels = (float)std::max(texture->Width, texture->Height);
+	int mip = pixels > 0.0f ? (int)std::floor(std::log2(std::max(texels / pixels, 1.0f))) : texture->InitialMip;
+	mip = std::clamp(mip, 0, texture->InitialMip);
+
+	texture->NeededMip = std::min(texture->NeededMip, mip);
+	texture->LastNeededFrame = mFrame;
+}
+
+void TextureStreamer::Update()
+{
+	// Released textures free their memory through the cache
+	mTextures.erase(std::remove_if(mTextures.begin(), mTextures.end(),
+		[](const std::weak_ptr<CachedTexture>& texture) { return texture.expired(); }), mTextures.end());
+
+	mResidentBytes = 0;
+	for (auto& weak : mTextures)
+	{
+		mResidentBytes += weak.lock()->ResidentBytes;
+	}
+
+	FinishRequest();
+
+	// Start reading the texture furthest from the mips it needs
+	if (!mRequest)
+	{
+		std::shared_ptr<CachedTexture> furthest;
+		for (auto& weak : mTextures)
+		{
+			auto texture = weak.lock();
+			if (texture->LastNeededFrame != mFrame || texture->NeededMip >= texture->ResidentMip) continue;
+			if (!furthest || texture->ResidentMip - texture->NeededMip > furthest->ResidentMip - furthest->NeededMip) furthest = texture;
+		}
+
+		if (furthest)
+		{
+			// Settle for fewer extra mips if the budget cannot fit them all. MakeRoom only evicts once it knows it
+			// will succeed, so trying a mip that doesn't fit costs nothing
+			for (int mip = furthest->NeededMip; mip < furthest->ResidentMip; ++mip)
+			{
+				if (!MakeRoom(GetSize(furthest.get(), mip) - furthest->ResidentBytes, furthest.get())) continue;
+
+				// Only the mips that are missing are read
+				mRequest = std::make_unique<Request>();
+				mRequest->Texture = furthest;
+				mRequest->Mip = mip;
+				mRequest->ResidentMip = furthest->ResidentMip;
+				std::wstring path = furthest->Path;
+				size_t fileSize = furthest->FileSize;
+				UINT64 begin = furthest->MipOffsets[mip];
+				UINT64 end = furthest->MipOffsets[furthest->ResidentMip];
+				mRequest->Loading = Jobs->Async([path, fileSize, begin, end]() { return ReadMips(path, fileSize, begin, end); });
+				break;
+			}
+		}
+	}
+
+	// Needs are gathered again next frame
+	for (auto& weak : mTextures)
+	{
+		auto texture = weak.lock();
+		texture->NeededMip = texture->InitialMip;
+	}
+	mFrame++;
+}
+
+std::vector<uint8_t> TextureStreamer::ReadMips(std::wstring path, size_t fileSize, UINT64 begin, UINT64 end)
+{
+	std::vector<uint8_t> data;
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file || (size_t)file.tellg() != fileSize) return data;
+
+	data.resize((size_t)(end - begin));
+	file.seekg(begin);
+	if (!file.read(reinterpret_cast<char*>(data.data()), data.size())) data.clear();
+	return data;
+}
+
+void TextureStreamer::FinishRequest()
+{
+	if (!mRequest || mRequest->Loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+	auto data = mRequest->Loading.get();
+	auto texture = mRequest->Texture.lock();
+	int mip = mRequest->Mip;
+	int residentMip = mRequest->ResidentMip;
+	mRequest.reset();
+
+	// Released or evicted while reading, or the file has changed since it was first loaded
+	if (data.empty() || !texture || texture->ResidentMip != residentMip) return;
+
+	auto resource = CreateResource(texture.get(), mip, data.data());
+	if (!resource) return;
+
+	Textures->ReplaceResource(texture.get(), resource);
+	mResidentBytes -= texture->ResidentBytes;
+	texture->ResidentMip = mip;
+	texture->ResidentBytes = GetSize(texture.get(), mip);
+	mResidentBytes += texture->ResidentBytes;
+}
+
+int TextureStreamer::GetEvictionTarget(const CachedTexture* texture) const
+{
+	return texture->LastNeededFrame == mFrame ? texture->NeededMip : texture->InitialMip;
+}
+
+bool TextureStreamer::MakeRoom(UINT64 bytes, const CachedTexture* keep)
+{
+	if (mResidentBytes + bytes <= mBudget) return true;
+
+	// Textures holding finer mips than they need this frame, least recently needed first
+	std::vector<std::shared_ptr<CachedTexture>> candidates;
+	UINT64 freeable = 0;
+	for (auto& weak : mTextures)
+	{
+		auto texture = weak.lock();
+		int target = GetEvictionTarget(texture.get());
+		if (texture.get() == keep || texture->ResidentMip >= target) continue;
+
+		candidates.push_back(texture);
+		freeable += texture->ResidentBytes - GetSize(texture.get(), target);
+	}
+
+	// Cutting back every candidate would still not fit it, so leave them all as they are
+	if (mResidentBytes - freeable + bytes > mBudget) return false;
+
+	std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a->LastNeededFrame < b->LastNeededFrame; });
+	for (auto& texture : candidates)
+	{
+		if (mResidentBytes + bytes <= mBudget) break;
+
+		mResidentBytes -= texture->ResidentBytes;
+		Evict(texture.get(), GetEvictionTarget(texture.get()));
+		mResidentBytes += texture->ResidentBytes;
+	}
+
+	return mResidentBytes + bytes <= mBudget;
+}
+
+void TextureStreamer::Evict(CachedTexture* texture, int firstMip)
+{
+	UINT width = std::max(1u, texture->Width >> firstMip);
+	UINT height = std::max(1u, texture->Height >> firstMip);
+	auto desc = CD3DX12_RESOURCE_DESC::Tex2D(texture->Format, width, height, 1, (UINT16)(texture->MipCount - firstMip));
+
+	ComPtr<ID3D12Resource> resource;
+	if (FAILED(D3DDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&resource))))
+	{
+		return;
+	}
+
+	// The coarse mips are already on the GPU, copy them across
+	Uploader->CopyTextureMips(resource.Get(), texture->Resource.Get(), firstMip - texture->ResidentMip, texture->MipCount - firstMip);
+
+	Textures->ReplaceResource(texture, resource);
+	texture->ResidentMip = firstMip;
+	texture->ResidentBytes = GetSize(texture, firstMip);
+}
+
+ComPtr<ID3D12Resource> TextureStreamer::CreateResource(const CachedTexture* texture, int firstMip, const uint8_t* data)
+{
+	UINT width = std::max(1u, texture->Width >> firstMip);
+	UINT height = std::max(1u, texture->Height >> firstMip);
+	auto desc = CD3DX12_RESOURCE_DESC::Tex2D(texture->Format, width, height, 1, (UINT16)(texture->MipCount - firstMip));
+
+	ComPtr<ID3D12Resource> resource;
+	if (FAILED(D3DDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&resource))))
+	{
+		return nullptr;
+	}
+
+	// Mips are tightly packed in the file, each one straight after the last
+	int uploadEnd = texture->Resource ? texture->ResidentMip : texture->MipCount;
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	for (int mip = firstMip; mip < uploadEnd; ++mip)
+	{
+		size_t rowPitch, slicePitch;
+		if (FAILED(ComputePitch(texture->Format, std::max(1u, texture->Width >> mip), std::max(1u, texture->Height >> mip), rowPitch, slicePitch))) return nullptr;
+		subresources.push_back({ data + (texture->MipOffsets[mip] - texture->MipOffsets[firstMip]), (LONG_PTR)rowPitch, (LONG_PTR)slicePitch });
+	}
+
+	if (texture->Resource)
+	{
+		Uploader->CopyTextureMips(resource.Get(), texture->Resource.Get(), 0, texture->MipCount - texture->ResidentMip,
+			subresources.data(), (UINT)subresources.size());
+	}
+	else
+	{
+		Uploader->UploadTexture(resource.Get(), subresources.data(), (UINT)subresources.size());
+	}
+	return resource;
+}
+
+UINT64 TextureStreamer::GetSize(const CachedTexture* texture, int firstMip)
+{
+	UINT width = std::max(1u, texture->Width >> firstMip);
+	UINT height = std::max(1u, texture->Height >> firstMip);
+	auto desc = CD3DX12_RESOURCE_DESC::Tex2D(texture->Format, width, height, 1, (UINT16)(texture->MipCount - firstMip));
+	return D3DDevice->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+}
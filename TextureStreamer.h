@@ -0,0 +1,106 @@
+#pragma once
+#include "d3dx12.h"
+
+#include <windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+#include <DirectXTex.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+
+using Microsoft::WRL::ComPtr;
+
+struct CachedTexture;
+
+// Default amount of video memory streamed textures may use
+const UINT64 DEFAULT_TEXTURE_BUDGET = 512ull * 1024 * 1024;
+
+// The header and smallest mips of a dds file, all of it a streamed texture reads to start with
+struct StreamedTextureFile
+{
+	DirectX::TexMetadata Metadata;
+	size_t FileSize = 0;
+	int InitialMip = 0;
+
+	// Where each mip starts in the file, followed by the end of the last one
+	std::vector<UINT64> MipOffsets;
+
+	// The header, then the mips from InitialMip down as they are laid out in the file
+	std::vector<uint8_t> Data;
+	size_t HeaderSize = 0;
+};
+
+// Streams mip levels of dds textures in and out by how large they are on screen
+// Textures start with only their smallest mips, read from the end of the file without the rest. Each frame the finest
+// mip anything asked for is compared with what is resident; only the missing finer mips are read on a worker thread,
+// and the texture's resource is replaced with one holding them and a GPU copy of the mips it had.
+// When that would go over the budget, the least recently needed textures are cut back to their smallest mips first
+class TextureStreamer
+{
+public:
+	TextureStreamer(UINT64 budget = DEFAULT_TEXTURE_BUDGET);
+	~TextureStreamer();
+
+	// Read a dds file's header and just the smallest mips a streamed texture starts with. Returns false for textures
+	// that are not worth streaming, cube maps, arrays and anything without a mip chain, and for legacy formats that
+	// are converted on load. Those should be loaded whole instead
+	static bool ReadInitial(const std::wstring& path, StreamedTextureFile& file);
+
+	// Create the texture's resource with the mips ReadInitial read
+	bool CreateInitial(const StreamedTextureFile& file, CachedTexture* texture);
+
+	// Start streaming a texture created by CreateInitial once the cache has a handle to it
+	void Track(const std::shared_ptr<CachedTexture>& texture);
+
+	// A texture is drawn covering about this many pixels across this frame
+	void RequestSize(CachedTexture* texture, float pixels);
+
+	// Once per frame after the requests: finish a read, make room in the budget and start the next read
+	void Update();
+
+	void SetBudget(UINT64 budget) { mBudget = budget; }
+	UINT64 GetBudget() const { return mBudget; }
+	UINT64 GetResidentBytes() const { return mResidentBytes; }
+
+private:
+	struct Request
+	{
+		std::weak_ptr<CachedTexture> Texture;
+		int Mip;
+
+		// Resident mip when the read started, the data only fills the gap down to it
+		int ResidentMip;
+		std::future<std::vector<uint8_t>> Loading;
+	};
+
+	// Bytes [begin, end) of a file, empty if it could not be read or is no longer fileSize long. Runs on a worker thread
+	static std::vector<uint8_t> ReadMips(std::wstring path, size_t fileSize, UINT64 begin, UINT64 end);
+
+	// Resource holding mips from firstMip down. Mips finer than the resident ones are uploaded from data, laid out as
+	// in the file, and the resident ones are copied across from the texture's current resource
+	static ComPtr<ID3D12Resource> CreateResource(const CachedTexture* texture, int firstMip, const uint8_t* data);
+
+	// Video memory a texture takes with mips from firstMip down
+	static UINT64 GetSize(const CachedTexture* texture, int firstMip);
+
+	// Drop the finer mips of a texture with a GPU copy, no file read needed
+	void Evict(CachedTexture* texture, int firstMip);
+
+	void FinishRequest();
+
+	// Mip a texture can be cut back to this frame
+	int GetEvictionTarget(const CachedTexture* texture) const;
+
+	// Free space for a texture to grow by this many bytes. Returns false without evicting anything if evicting
+	// everything it could would still not be enough
+	bool MakeRoom(UINT64 bytes, const CachedTexture* keep);
+
+	std::vector<std::weak_ptr<CachedTexture>> mTextures;
+	std::unique_ptr<Request> mRequest;
+
+	UINT64 mBudget = 0;
+	UINT64 mResidentBytes = 0;
+	UINT64 mFrame = 1;
+};
@@ -0,0 +1,202 @@
+#include "TextureTranscoder.h"
+#include <DirectXTex.h>
+#include <windows.h>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cwctype>
+
+using namespace DirectX;
+
+namespace
+{
+	DXGI_FORMAT GetCompressedFormat(TextureMap map, bool srgb)
+	{
+		switch (map)
+		{
+		case TextureMap::Albedo: return srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+		case TextureMap::Normal: return DXGI_FORMAT_BC5_UNORM;
+		case TextureMap::Emissive: return srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+		default: return DXGI_FORMAT_BC7_UNORM;
+		}
+	}
+
+	// Only colour maps keep the sRGB flag from the file, the rest are data
+	bool IsColourMap(TextureMap map)
+	{
+		return map == TextureMap::Albedo || map == TextureMap::Emissive;
+	}
+}
+
+std::wstring TextureTranscoder::GetOutputFileName(const std::wstring& source)
+{
+	std::filesystem::path path(source);
+	path.replace_extension(std::wstring(TextureIndex::TRANSCODED_SUFFIX) + L".dds");
+	return path.generic_wstring();
+}
+
+// Output exists and was written after every source changed
+static bool IsUpToDate(const std::wstring& output, const std::wstring* sources, int sourceCount)
+{
+	std::error_code error;
+	if (!std::filesystem::exists(output, error)) return false;
+
+	auto outputTime = std::filesystem::last_write_time(output, error);
+	for (int i = 0; i < sourceCount; ++i)
+	{
+		if (sources[i].empty()) continue;
+		if (std::filesystem::last_write_time(sources[i], error) > outputTime) return false;
+	}
+	return true;
+}
+
+void TextureTranscoder::Scan(const std::wstring& root)
+{
+	mJobs.clear();
+	mSkippedCount = 0;
+
+	// Best source for each material map and whether a dds was already provided for it
+	struct Candidate
+	{
+		std::filesystem::path Source;
+		int Rank = INT_MAX;
+		TextureMap Map = TextureMap::Albedo;
+		bool HasDDS = false;
+	};
+	std::unordered_map<std::wstring, Candidate> candidates;
+
+	// Materials with single channel maps to pack, by lower case name
+	std::unordered_map<std::wstring, std::wstring> packedMaterials;
+
+	std::error_code error;
+	for (auto it = std::filesystem::recursive_directory_iterator(root, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+	{
+		if (!it->is_regular_file(error)) continue;
+
+		std::wstring materialPath;
+		TextureMap map;
+		int rank;
+		if (!TextureIndex::ParseFileName(it->path(), materialPath, map, rank)) continue;
+
+		std::wstring key = materialPath;
+		std::transform(key.begin(), key.end(), key.begin(), [](wchar_t c) { return (wchar_t)std::towlower(c); });
+
+		// Single channel maps only reach the GPU packed, and packed maps are our own output
+		if ((int)map >= MATERIAL_TEXTURE_COUNT)
+		{
+			packedMaterials[key] = materialPath;
+			continue;
+		}
+		if (map == TextureMap::Packed) continue;
+
+		auto& candidate = candidates[key + L'|' + (wchar_t)(L'0' + (int)map)];
+		candidate.Map = map;
+
+		// Rank 0 is our own output, 1 is a dds that came with the asset
+		if (rank == 1) candidate.HasDDS = true;
+		else if (rank > 1 && rank < candidate.Rank)
+		{
+			candidate.Source = it->path();
+			candidate.Rank = rank;
+		}
+	}
+
+	for (auto& [key, candidate] : candidates)
+	{
+		if (candidate.HasDDS || candidate.Source.empty()) continue;
+
+		Job job;
+		job.Sources[0] = candidate.Source.generic_wstring();
+		job.Output = GetOutputFileName(job.Sources[0]);
+		job.Map = candidate.Map;
+
+		if (IsUpToDate(job.Output, job.Sources, 1)) mSkippedCount++;
+		else mJobs.push_back(job);
+	}
+
+	// Packed maps are built from the best file for each channel, including any dds
+	TextureIndex index;
+	index.Build(root);
+	for (auto& [key, materialPath] : packedMaterials)
+	{
+		Job job;
+		for (int i = 0; i < TexturePacker::CHANNEL_COUNT; ++i)
+		{
+			job.Sources[i] = index.Find(materialPath, TexturePacker::CHANNELS[i]);
+		}
+		job.Output = materialPath + L"-packed" + TextureIndex::TRANSCODED_SUFFIX + L".dds";
+		job.Map = TextureMap::Packed;
+
+		if (IsUpToDate(job.Output, job.Sources, TexturePacker::CHANNEL_COUNT)) mSkippedCount++;
+		else mJobs.push_back(job);
+	}
+}
+
+int TextureTranscoder::Run(unsigned int threadCount)
+{
+	if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, (unsigned int)mJobs.size());
+
+	std::atomic<size_t> nextJob = 0;
+	std::atomic<int> failed = 0;
+
+	auto worker = [&]()
+	{
+		// WIC needs COM on every thread that decodes
+		CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+		for (size_t i = nextJob++; i < mJobs.size(); i = nextJob++)
+		{
+			if (!Transcode(mJobs[i])) failed++;
+		}
+		CoUninitialize();
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	return failed;
+}
+
+bool TextureTranscoder::Transcode(const Job& job)
+{
+	ScratchImage mipChain;
+	bool srgb = false;
+	if (job.Map == TextureMap::Packed)
+	{
+		if (!TexturePacker::Pack(job.Sources, mipChain)) return false;
+	}
+	else
+	{
+		ScratchImage image;
+		WIC_FLAGS wicFlags = IsColourMap(job.Map) ? WIC_FLAGS_NONE : WIC_FLAGS_IGNORE_SRGB;
+		if (FAILED(LoadFromWICFile(job.Sources[0].c_str(), wicFlags, nullptr, image))) return false;
+
+		// Full mip chain down to 1x1
+		if (FAILED(GenerateMipMaps(*image.GetImage(0, 0, 0), TEX_FILTER_DEFAULT, 0, mipChain))) return false;
+		srgb = IsSRGB(image.GetMetadata().format);
+	}
+
+	// Block compressed textures need a top level that is a whole number of 4x4 blocks
+	const auto& metadata = mipChain.GetMetadata();
+	if (metadata.width % 4 != 0 || metadata.height % 4 != 0) return false;
+
+	// Quick BC7 mode keeps a full rebuild to minutes rather than hours
+	DXGI_FORMAT format = GetCompressedFormat(job.Map, srgb);
+	ScratchImage compressed;
+	if (FAILED(Compress(mipChain.GetImages(), mipChain.GetImageCount(), metadata, format,
+		TEX_COMPRESS_BC7_QUICK, TEX_THRESHOLD_DEFAULT, compressed))) return false;
+
+	// Write to a temporary file first so a cancelled build never leaves a truncated texture
+	std::wstring tempFileName = job.Output + L".tmp";
+	if (FAILED(SaveToDDSFile(compressed.GetImages(), compressed.GetImageCount(), compressed.GetMetadata(), DDS_FLAGS_NONE, tempFileName.c_str()))) return false;
+
+	return MoveFileExW(tempFileName.c_str(), job.Output.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
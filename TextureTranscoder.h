@@ -0,0 +1,39 @@
+#pragma once
+
+#include "TexturePacker.h"
+#include <string>
+#include <vector>
+
+// Asset build step that converts jpg and png textures to block compressed dds with a full mip chain
+// Output is written next to the source as <name>.bc.dds, which the texture index prefers over everything else.
+// The codec is picked by map: BC7 for albedo and packed maps, BC5 for normals and BC1 for emissive.
+// Single channel maps are not converted on their own, they are packed into <material>-packed.bc.dds
+class TextureTranscoder
+{
+public:
+	// Packed jobs have a source per channel, the rest just the first
+	struct Job
+	{
+		std::wstring Sources[TexturePacker::CHANNEL_COUNT];
+		std::wstring Output;
+		TextureMap Map;
+	};
+
+	// Find every source image under the directory that needs converting
+	// Maps that already have a hand made dds are left alone, as are outputs newer than their source
+	void Scan(const std::wstring& root);
+
+	// Convert everything found by Scan, one image per thread. Returns the number that failed
+	int Run(unsigned int threadCount = 0);
+
+	const std::vector<Job>& GetJobs() const { return mJobs; }
+	size_t GetSkippedCount() const { return mSkippedCount; }
+
+	static std::wstring GetOutputFileName(const std::wstring& source);
+
+private:
+	static bool Transcode(const Job& job);
+
+	std::vector<Job> mJobs;
+	size_t mSkippedCount = 0;
+};
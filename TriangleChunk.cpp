@@ -22,8 +22,8 @@ TriangleChunk::TriangleChunk(Vertex v1, Vertex v2, Vertex v3, float frequency, i
 	mMesh = new Mesh();
 
 	// Calculate buffer data
-	mMesh->mVertices = mVertices;
-	mMesh->mIndices = mIndices;
+	mMesh->SetGeometry(std::move(mVertices), std::move(mIndices));
+	mVertexMap.clear();
 	mMesh->CalculateBufferData(D3DDevice.Get(), commandList);
 }
 
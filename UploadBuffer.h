@@ -12,6 +12,7 @@ class UploadBuffer
 public:
 	UploadBuffer(ID3D12Device* device, UINT elementCount, bool constant)
 	{
+		mElementCount = elementCount;
 		mElementSize = sizeof(T);
 		if (constant)
 		{
@@ -43,11 +44,16 @@ public:
 		memcpy(&mData[element * mElementSize], &data, sizeof(T));
 	}
 
+	// Mapped elements of a buffer that isn't constant, for writing many at once
+	T* GetElements() { return mElementSize == sizeof(T) ? reinterpret_cast<T*>(mData) : nullptr; }
+
 	ID3D12Resource* GetBuffer() { return mUploadBuffer.Get(); }
+	UINT GetElementCount() const { return mElementCount; }
 
 private:
 	ComPtr<ID3D12Resource> mUploadBuffer;
 	BYTE* mData = nullptr;
 	UINT mElementSize = 0;
+	UINT mElementCount = 0;
 };
 
@@ -0,0 +1,357 @@
+#include "UploadManager.h"
+#include <DDSTextureLoader.h>
+#include <WICTextureLoader.h>
+#include <algorithm>
+#include <memory>
+
+// Alignment of buffer copies within the ring
+const UINT64 BUFFER_UPLOAD_ALIGNMENT = 16;
+
+// Build a box filtered mip chain for an RGBA8 image
+static void GenerateMipChain(const D3D12_SUBRESOURCE_DATA& baseLevel, UINT width, UINT height, UINT mipLevels,
+	std::vector<std::vector<uint8_t>>& mipData, std::vector<D3D12_SUBRESOURCE_DATA>& subresources)
+{
+	mipData.resize(mipLevels);
+	subresources.push_back(baseLevel);
+
+	const uint8_t* source = static_cast<const uint8_t*>(baseLevel.pData);
+	LONG_PTR sourcePitch = baseLevel.RowPitch;
+
+	for (UINT level = 1; level < mipLevels; level++)
+	{
+		UINT mipWidth = std::max(1u, width / 2);
+		UINT mipHeight = std::max(1u, height / 2);
+
+		auto& data = mipData[level];
+		data.resize(mipWidth * mipHeight * 4);
+
+		for (UINT y = 0; y < mipHeight; y++)
+		{
+			// Clamp so odd sized levels reuse their last row and column
+			const uint8_t* row0 = source + std::min(y * 2, height - 1) * sourcePitch;
+			const uint8_t* row1 = source + std::min(y * 2 + 1, height - 1) * sourcePitch;
+
+			for (UINT x = 0; x < mipWidth; x++)
+			{
+				UINT x0 = std::min(x * 2, width - 1) * 4;
+				UINT x1 = std::min(x * 2 + 1, width - 1) * 4;
+
+				for (UINT c = 0; c < 4; c++)
+				{
+					UINT sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+					data[(y * mipWidth + x) * 4 + c] = uint8_t((sum + 2) / 4);
+				}
+			}
+		}
+
+		D3D12_SUBRESOURCE_DATA subresource = {};
+		subresource.pData = data.data();
+		subresource.RowPitch = mipWidth * 4;
+		subresource.SlicePitch = subresource.RowPitch * mipHeight;
+		subresources.push_back(subresource);
+
+		source = data.data();
+		sourcePitch = subresource.RowPitch;
+		width = mipWidth;
+		height = mipHeight;
+	}
+}
+
+// Mips are built on the CPU, so force a format the filter understands
+static DirectX::WIC_LOADER_FLAGS GetWICLoadFlags(bool generateMips)
+{
+	if (generateMips) return DirectX::WIC_LOADER_FORCE_RGBA32 | DirectX::WIC_LOADER_MIP_RESERVE;
+	return DirectX::WIC_LOADER_DEFAULT;
+}
+
+UploadManager::UploadManager(ID3D12Device* device, ID3D12CommandQueue* commandQueue, UINT64 ringSize)
+	: mDevice(device), mCommandQueue(commandQueue), mRing(ringSize)
+{
+	// Create the ring and leave it mapped for its whole lifetime
+	if (FAILED(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(ringSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(mRingBuffer.GetAddressOf()))))
+	{
+		MessageBox(0, L"Upload ring creation failed", L"Error", MB_OK);
+	}
+
+	if (FAILED(mRingBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mRingData))))
+	{
+		MessageBox(0, L"Upload ring map failed", L"Error", MB_OK);
+	}
+
+	if (FAILED(mDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence))))
+	{
+		MessageBox(0, L"Upload fence creation failed", L"Error", MB_OK);
+	}
+}
+
+UploadManager::~UploadManager()
+{
+	if (mRingBuffer) { mRingBuffer->Unmap(0, nullptr); mRingData = nullptr; }
+}
+
+UploadManager::StagingAllocation UploadManager::AllocateStaging(UINT64 size, UINT64 alignment)
+{
+	StagingAllocation staging;
+
+	// Nothing to copy, callers skip the upload when there is no resource
+	if (size == 0) return staging;
+
+	UINT64 offset = mRing.Allocate(size, alignment);
+	if (offset != RingAllocator::INVALID_OFFSET)
+	{
+		staging.Resource = mRingBuffer.Get();
+		staging.Offset = offset;
+		staging.CPUAddress = mRingData + offset;
+		return staging;
+	}
+
+	// Ring is full, use a buffer of our own rather than waiting for space
+	ComPtr<ID3D12Resource> overflow;
+	if (FAILED(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(overflow.GetAddressOf()))))
+	{
+		MessageBox(0, L"Upload buffer creation failed", L"Error", MB_OK);
+		return staging;
+	}
+
+	overflow->Map(0, nullptr, reinterpret_cast<void**>(&staging.CPUAddress));
+	staging.Resource = overflow.Get();
+	staging.Offset = 0;
+	mOverflowBuffers.push_back({ overflow, 0 });
+	return staging;
+}
+
+ID3D12GraphicsCommandList* UploadManager::GetCommandList()
+{
+	if (mRecording) return mCommandList.Get();
+
+	// Reuse an allocator the GPU has finished with, otherwise make another
+	UINT64 completed = mFence->GetCompletedValue();
+	auto free = std::find_if(mCommandAllocators.begin(), mCommandAllocators.end(),
+		[completed](const std::pair<ComPtr<ID3D12CommandAllocator>, UINT64>& allocator) { return allocator.second <= completed; });
+
+	if (free != mCommandAllocators.end())
+	{
+		mCurrentAllocator = free->first;
+		mCommandAllocators.erase(free);
+		mCurrentAllocator->Reset();
+	}
+	else
+	{
+		mDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(mCurrentAllocator.ReleaseAndGetAddressOf()));
+	}
+
+	if (!mCommandList)
+	{
+		mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, mCurrentAllocator.Get(), nullptr, IID_PPV_ARGS(mCommandList.GetAddressOf()));
+	}
+	else
+	{
+		mCommandList->Reset(mCurrentAllocator.Get(), nullptr);
+	}
+
+	mRecording = true;
+	return mCommandList.Get();
+}
+
+void UploadManager::UploadBuffer(GPUBufferHeap* heap, const GPUBufferAllocation& destination, const void* data, UINT64 size)
+{
+	StagingAllocation staging = AllocateStaging(size, BUFFER_UPLOAD_ALIGNMENT);
+	if (!staging.Resource) return;
+
+	memcpy(staging.CPUAddress, data, size);
+	heap->CopyToAllocation(GetCommandList(), destination, staging.Resource, staging.Offset);
+	if (std::find(mCopiedHeaps.begin(), mCopiedHeaps.end(), heap) == mCopiedHeaps.end()) mCopiedHeaps.push_back(heap);
+}
+
+void UploadManager::UploadTexture(ID3D12Resource* texture, const D3D12_SUBRESOURCE_DATA* subresources, UINT numSubresources)
+{
+	UINT64 size = GetRequiredIntermediateSize(texture, 0, numSubresources);
+	StagingAllocation staging = AllocateStaging(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	if (!staging.Resource) return;
+
+	// Textures are created in the copy dest state by the loaders
+	auto commandList = GetCommandList();
+	UpdateSubresources(commandList, texture, staging.Resource, staging.Offset, 0, numSubresources, subresources);
+
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture,
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+void UploadManager::CopyTextureMips(ID3D12Resource* destination, ID3D12Resource* source, UINT firstSourceMip, UINT mipCount,
+	const D3D12_SUBRESOURCE_DATA* finerMips, UINT finerMipCount)
+{
+	auto commandList = GetCommandList();
+	if (finerMipCount > 0)
+	{
+		UINT64 size = GetRequiredIntermediateSize(destination, 0, finerMipCount);
+		StagingAllocation staging = AllocateStaging(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+		if (staging.Resource) UpdateSubresources(commandList, destination, staging.Resource, staging.Offset, 0, finerMipCount, finerMips);
+	}
+
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(source,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE));
+
+	for (UINT mip = 0; mip < mipCount; ++mip)
+	{
+		CD3DX12_TEXTURE_COPY_LOCATION destinationLocation(destination, finerMipCount + mip);
+		CD3DX12_TEXTURE_COPY_LOCATION sourceLocation(source, firstSourceMip + mip);
+		commandList->CopyTextureRegion(&destinationLocation, 0, 0, 0, &sourceLocation, nullptr);
+	}
+
+	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(destination,
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+bool UploadManager::LoadDDSTexture(const wchar_t* fileName, ID3D12Resource** texture, bool* isCubeMap)
+{
+	std::unique_ptr<uint8_t[]> ddsData;
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	DirectX::DDS_ALPHA_MODE mode = DirectX::DDS_ALPHA_MODE_OPAQUE;
+
+	if (FAILED(DirectX::LoadDDSTextureFromFile(mDevice, fileName, texture, ddsData, subresources, 0, &mode, isCubeMap)))
+	{
+		return false;
+	}
+
+	UploadTexture(*texture, subresources.data(), (UINT)subresources.size());
+	return true;
+}
+
+bool UploadManager::LoadDDSTexture(const uint8_t* data, size_t size, ID3D12Resource** texture, bool* isCubeMap)
+{
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	DirectX::DDS_ALPHA_MODE mode = DirectX::DDS_ALPHA_MODE_OPAQUE;
+
+	// Subresources point into the file data, which outlives the copy into the ring
+	if (FAILED(DirectX::LoadDDSTextureFromMemory(mDevice, data, size, texture, subresources, 0, &mode, isCubeMap)))
+	{
+		return false;
+	}
+
+	UploadTexture(*texture, subresources.data(), (UINT)subresources.size());
+	return true;
+}
+
+bool UploadManager::LoadWICTexture(const wchar_t* fileName, ID3D12Resource** texture, bool generateMips)
+{
+	std::unique_ptr<uint8_t[]> decodedData;
+	D3D12_SUBRESOURCE_DATA subresource = {};
+
+	if (FAILED(DirectX::LoadWICTextureFromFileEx(mDevice, fileName, 0, D3D12_RESOURCE_FLAG_NONE, GetWICLoadFlags(generateMips), texture, decodedData, subresource)))
+	{
+		return false;
+	}
+
+	UploadWICTexture(*texture, subresource, generateMips);
+	return true;
+}
+
+bool UploadManager::LoadWICTexture(const uint8_t* data, size_t size, ID3D12Resource** texture, bool generateMips)
+{
+	std::unique_ptr<uint8_t[]> decodedData;
+	D3D12_SUBRESOURCE_DATA subresource = {};
+
+	if (FAILED(DirectX::LoadWICTextureFromMemoryEx(mDevice, data, size, 0, D3D12_RESOURCE_FLAG_NONE, GetWICLoadFlags(generateMips), texture, decodedData, subresource)))
+	{
+		return false;
+	}
+
+	UploadWICTexture(*texture, subresource, generateMips);
+	return true;
+}
+
+bool UploadManager::LoadDecodedTexture(const uint8_t* pixels, UINT width, UINT height, bool srgb, ID3D12Resource** texture, bool generateMips)
+{
+	// Room for the whole chain when mips are generated, like the WIC loader's mip reserve
+	UINT16 mipLevels = 1;
+	if (generateMips)
+	{
+		while ((std::max(width, height) >> mipLevels) > 0) mipLevels++;
+	}
+
+	if (FAILED(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM, width, height, 1, mipLevels),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(texture))))
+	{
+		return false;
+	}
+
+	D3D12_SUBRESOURCE_DATA subresource = {};
+	subresource.pData = pixels;
+	subresource.RowPitch = width * 4;
+	subresource.SlicePitch = subresource.RowPitch * height;
+
+	UploadWICTexture(*texture, subresource, generateMips);
+	return true;
+}
+
+void UploadManager::UploadWICTexture(ID3D12Resource* texture, const D3D12_SUBRESOURCE_DATA& subresource, bool generateMips)
+{
+	auto desc = texture->GetDesc();
+	if (!generateMips || desc.MipLevels <= 1)
+	{
+		UploadTexture(texture, &subresource, 1);
+		return;
+	}
+
+	std::vector<std::vector<uint8_t>> mipData;
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	GenerateMipChain(subresource, (UINT)desc.Width, desc.Height, desc.MipLevels, mipData, subresources);
+
+	UploadTexture(texture, subresources.data(), (UINT)subresources.size());
+}
+
+UINT64 UploadManager::Submit()
+{
+	if (!mRecording) return mFenceValue;
+
+	for (auto heap : mCopiedHeaps) heap->FinishCopies(mCommandList.Get());
+	mCopiedHeaps.clear();
+
+	mCommandList->Close();
+	ID3D12CommandList* commandLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(commandLists), commandLists);
+	mRecording = false;
+
+	// Everything recorded since the last submit completes at this fence
+	mFenceValue++;
+	mCommandQueue->Signal(mFence.Get(), mFenceValue);
+
+	mRing.FinishAllocations(mFenceValue);
+	for (auto& overflow : mOverflowBuffers)
+	{
+		if (overflow.second == 0) overflow.second = mFenceValue;
+	}
+	mCommandAllocators.push_back({ mCurrentAllocator, mFenceValue });
+	mCurrentAllocator = nullptr;
+
+	return mFenceValue;
+}
+
+void UploadManager::ReleaseCompleted()
+{
+	UINT64 completed = mFence->GetCompletedValue();
+	mRing.Release(completed);
+
+	mOverflowBuffers.erase(std::remove_if(mOverflowBuffers.begin(), mOverflowBuffers.end(),
+		[completed](const std::pair<ComPtr<ID3D12Resource>, UINT64>& overflow)
+		{
+			return overflow.second != 0 && overflow.second <= completed;
+		}), mOverflowBuffers.end());
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "d3dx12.h"
+
+#include <windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+#include <vector>
+#include "RingAllocator.h"
+#include "GPUBufferHeap.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Size of the persistently mapped staging ring
+const UINT64 DEFAULT_UPLOAD_RING_SIZE = 64 * 1024 * 1024;
+
+// Owns every CPU to GPU copy. Data is written into a staging ring straight away
+// and the copies are submitted together once per frame, so callers never wait on the GPU
+class UploadManager
+{
+public:
+	UploadManager(ID3D12Device* device, ID3D12CommandQueue* commandQueue, UINT64 ringSize = DEFAULT_UPLOAD_RING_SIZE);
+	~UploadManager();
+
+	// Copy data into a range of the buffer heap
+	void UploadBuffer(GPUBufferHeap* heap, const GPUBufferAllocation& destination, const void* data, UINT64 size);
+
+	// Copy subresources into a texture and leave it ready for pixel shaders
+	void UploadTexture(ID3D12Resource* texture, const D3D12_SUBRESOURCE_DATA* subresources, UINT numSubresources);
+
+	// Copy a run of mips from one texture into another, e.g. to drop a texture's finest mips. Finer mips to go above
+	// them can be given as data, e.g. to add mips to a texture while keeping the ones it has
+	// The source is left as a copy source, the destination must start in the copy dest state
+	void CopyTextureMips(ID3D12Resource* destination, ID3D12Resource* source, UINT firstSourceMip, UINT mipCount,
+		const D3D12_SUBRESOURCE_DATA* finerMips = nullptr, UINT finerMipCount = 0);
+
+	// Load a texture file and queue its upload, returns false if the file could not be loaded
+	bool LoadDDSTexture(const wchar_t* fileName, ID3D12Resource** texture, bool* isCubeMap = nullptr);
+	bool LoadWICTexture(const wchar_t* fileName, ID3D12Resource** texture, bool generateMips = false);
+
+	// Same as above for file contents already in memory
+	bool LoadDDSTexture(const uint8_t* data, size_t size, ID3D12Resource** texture, bool* isCubeMap = nullptr);
+	bool LoadWICTexture(const uint8_t* data, size_t size, ID3D12Resource** texture, bool generateMips = false);
+
+	// Create an RGBA8 texture for pixels decoded elsewhere, e.g. by the texture decoder, and queue their upload
+	bool LoadDecodedTexture(const uint8_t* pixels, UINT width, UINT height, bool srgb, ID3D12Resource** texture, bool generateMips = false);
+
+	// Execute copies recorded since the last submit and return the fence value they complete at
+	UINT64 Submit();
+
+	// Reclaim staging memory for copies the GPU has finished
+	void ReleaseCompleted();
+
+	UINT64 GetCompletedFenceValue() const { return mFence->GetCompletedValue(); }
+	UINT64 GetSubmittedFenceValue() const { return mFenceValue; }
+
+private:
+	struct StagingAllocation
+	{
+		ID3D12Resource* Resource = nullptr;
+		UINT64 Offset = 0;
+		BYTE* CPUAddress = nullptr;
+	};
+
+	// Space in the ring, or a temporary buffer if the ring is full. Empty for a size of 0
+	StagingAllocation AllocateStaging(UINT64 size, UINT64 alignment);
+
+	// Decoded WIC images are uploaded with a CPU built mip chain when asked for
+	void UploadWICTexture(ID3D12Resource* texture, const D3D12_SUBRESOURCE_DATA& subresource, bool generateMips);
+
+	// Start recording if nothing has been recorded since the last submit
+	ID3D12GraphicsCommandList* GetCommandList();
+
+	ID3D12Device* mDevice = nullptr;
+	ID3D12CommandQueue* mCommandQueue = nullptr;
+
+	// Staging ring
+	ComPtr<ID3D12Resource> mRingBuffer;
+	BYTE* mRingData = nullptr;
+	RingAllocator mRing;
+
+	// Buffer heaps copied into since the last submit, their blocks are made readable again before it
+	std::vector<GPUBufferHeap*> mCopiedHeaps;
+
+	// Temporary buffers for copies that did not fit in the ring, with their fence value (0 until submitted)
+	std::vector<std::pair<ComPtr<ID3D12Resource>, UINT64>> mOverflowBuffers;
+
+	// Command objects, allocators are reused once their fence completes
+	std::vector<std::pair<ComPtr<ID3D12CommandAllocator>, UINT64>> mCommandAllocators;
+	ComPtr<ID3D12CommandAllocator> mCurrentAllocator;
+	ComPtr<ID3D12GraphicsCommandList> mCommandList;
+	bool mRecording = false;
+
+	ComPtr<ID3D12Fence> mFence;
+	UINT64 mFenceValue = 0;
+};
@@ -8,9 +8,11 @@
 
 #include <DirectXMath.h>
 #include "FastNoiseLite.h"
+#include "Hash.h"
 #include <assimp/scene.h>
 #include <vector>
 #include <array>  
+#include <memory>
 //#include "FrameResource.h"
 
 using namespace std;
@@ -64,7 +66,9 @@ struct PerMaterialConstants
 	XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
 	float Roughness = 0.25f;
 	float Metallic = 0.0f;
-	XMFLOAT3 padding;
+	float TextureSlice = 0.0f;
+	UINT TextureIndex = 0;
+	float padding;
 	XMFLOAT4X4 MatTransform = MakeIdentity4x4();
 };
 struct PerObjectConstants
@@ -73,6 +77,19 @@ struct PerObjectConstants
 	bool parallax;
 	XMFLOAT3 padding;
 };
+// One object's transform, kept in a buffer indexed by object id and only rewritten when the object moves
+struct ObjectConstants
+{
+	XMFLOAT4X4 WorldMatrix;
+	UINT Parallax = 0;
+	XMFLOAT3 padding;
+};
+// One instance of a batched draw, read by the model shaders as a structured buffer
+struct InstanceConstants
+{
+	UINT ObjectIndex = 0;
+	UINT MaterialIndex = 0;
+};
 struct PerFrameConstants
 {
 	XMFLOAT4X4 ViewMatrix = MakeIdentity4x4();
@@ -99,7 +116,14 @@ struct Material
 
 	int CBIndex = -1;
 	int DiffuseSRVIndex = -1;
-	int NumFramesDirty = 3;
+
+	// Slice of the texture array at DiffuseSRVIndex, for materials that share one
+	int TextureSlice = 0;
+
+	// Materials whose textures can stream have a table per frame resource, this far apart
+	// Only the current frame's table is rewritten when a texture changes, like the constant buffers
+	int SRVFrameStride = 0;
+	int NumTableFramesDirty = 0;
 
 	// Material constant buffer data used for shading.
 	XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -109,6 +133,8 @@ struct Material
 	XMFLOAT4X4 MatTransform = MakeIdentity4x4();
 };
 
+struct CachedTexture;
+
 // Texture struct
 struct Texture
 {
@@ -117,52 +143,13 @@ struct Texture
 	aiString AIPath;
 	wstring Path;
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
-	Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
-};
 
-// Helper function to create a bufferf
-static ComPtr<ID3D12Resource> CreateDefaultBuffer(const void* initData, UINT64 byteSize, ComPtr<ID3D12Resource>& uploadBuffer, 
-													ComPtr<ID3D12Device> d3DDevice, ComPtr<ID3D12GraphicsCommandList> commandList)
-{
-	ComPtr<ID3D12Resource> defaultBuffer;
-
-	// Create the default buffer resource
-	d3DDevice->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
-		D3D12_RESOURCE_STATE_COMMON,
-		nullptr,
-		IID_PPV_ARGS(defaultBuffer.GetAddressOf()));
-
-	// Create intermediate upload heap to copy CPU data to buffer
-	d3DDevice->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(uploadBuffer.GetAddressOf()));
-
-
-	// Describe the data to copy
-	D3D12_SUBRESOURCE_DATA subResourceData = {};
-	subResourceData.pData = initData;
-	subResourceData.RowPitch = byteSize;
-	subResourceData.SlicePitch = subResourceData.RowPitch;
-
-	// Schedule to copy the data to the default buffer resource
-	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
-		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+	// Reference to the shared copy in the texture cache, if it came from there
+	std::shared_ptr<CachedTexture> Cached;
 
-	UpdateSubresources<1>(commandList.Get(), defaultBuffer.Get(), uploadBuffer.Get(), 0, 0, 1, &subResourceData);
-
-	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
-		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
-
-
-	return defaultBuffer;
-}
+	// Version of the cached texture this material's tables were last written with
+	UINT Version = 0;
+};
 
 static UINT CalculateConstantBufferSize(UINT size)
 {
@@ -306,7 +293,7 @@ static float FractalBrownianMotion(FastNoiseLite* fastNoise, XMFLOAT3 fractalInp
 }
 
 // Calculate normals on an array of vertices and indices
-static std::vector<XMFLOAT3> CalculateNormals(std::vector<XMFLOAT3> vertices, std::vector<uint32_t> indices)
+static std::vector<XMFLOAT3> CalculateNormals(const std::vector<XMFLOAT3>& vertices, const std::vector<uint32_t>& indices)
 {
 	std::vector<XMFLOAT3> normals;
 
@@ -1,5 +1,8 @@
 #include "App.h"
+#include "TextureTranscoder.h"
+#include "Benchmarks.h"
 #include <memory>
+#include <stdexcept>
 //using namespace DirectX;
 
 int WINAPI WinMain(HINSTANCE hInstance, [[maybe_unused]] HINSTANCE prevInstance, [[maybe_unused]] PSTR cmdLine, int showCmd)
@@ -9,8 +12,37 @@ int WINAPI WinMain(HINSTANCE hInstance, [[maybe_unused]] HINSTANCE prevInstance,
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
     #endif
 
-    // Create the app
-    auto app = std::make_unique<App>();
+    // Asset build step, convert textures and exit
+    if (cmdLine && strstr(cmdLine, "-transcode"))
+    {
+        TextureTranscoder transcoder;
+        transcoder.Scan(L"Models");
+        int failed = transcoder.Run();
+
+        std::wstring summary = std::to_wstring(transcoder.GetJobs().size() - failed) + L" textures converted, " +
+            std::to_wstring(transcoder.GetSkippedCount()) + L" up to date, " + std::to_wstring(failed) + L" failed";
+        MessageBox(0, summary.c_str(), L"Texture transcoder", MB_OK);
+        return failed == 0 ? 0 : 1;
+    }
+
+    // CPU benchmarks, no window or device is created
+    if (cmdLine && strstr(cmdLine, "-benchmark"))
+    {
+        std::string report = Benchmarks::Run(L"Models");
+        MessageBoxA(0, report.c_str(), "Benchmarks", MB_OK);
+        return 0;
+    }
+
+    // Create the app, graphics setup and the frame loop throw when the device can't be created or a command fails
+    try
+    {
+        auto app = std::make_unique<App>();
+    }
+    catch (const std::exception& error)
+    {
+        MessageBoxA(0, error.what(), "Error", MB_OK);
+        return 1;
+    }
 
     return 0;
 }
\ No newline at end of file